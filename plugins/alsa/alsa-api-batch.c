@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2018 "IoT.bzh"
+ * Author Fulup Ar Foll <fulup@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Mixer 'batch' verb: volume/mute/ramp changes of many streams in one call.
+ * Every operation is validated before any is applied. Native gains and mute
+ * signals are then posted to every copy thread in one tight pass, controls are
+ * written afterwards (their event echo is ignored by native gains).
+ */
+
+#define _GNU_SOURCE  // needed for vasprintf
+
+#include "alsa-softmixer.h"
+#include <string.h>
+
+#define VOL_CONTROL_MAX  100
+#define VOL_CONTROL_MIN  0
+
+typedef struct {
+    AlsaStreamAudioT *stream;
+    long curvol;
+    long volume;            // -1 when unchanged
+    int mute;               // -1 when unchanged
+    AlsaVolRampT *ramp;
+    json_object *rampJ;     // softvol ramps still go through the ramp timer
+} BatchOpT;
+
+// volume as integer, or string "N", "=N" absolute, "+N" "-N" relative to current one
+STATIC int BatchParseVolume(json_object *volumeJ, long curvol, long *volume) {
+    const char *volS;
+    long value;
+
+    switch (json_object_get_type(volumeJ)) {
+        case json_type_int:
+            *volume = json_object_get_int(volumeJ);
+            break;
+        case json_type_string:
+            volS = json_object_get_string(volumeJ);
+            if (sscanf((volS[0] == '+' || volS[0] == '-' || volS[0] == '=') ? &volS[1] : volS, "%ld", &value) != 1) goto OnErrorExit;
+            *volume = (volS[0] == '+') ? curvol + value : (volS[0] == '-') ? curvol - value : value;
+            break;
+        default:
+            goto OnErrorExit;
+    }
+
+    if (*volume < VOL_CONTROL_MIN) *volume = VOL_CONTROL_MIN;
+    if (*volume > VOL_CONTROL_MAX) *volume = VOL_CONTROL_MAX;
+    return 0;
+
+OnErrorExit:
+    return -1;
+}
+
+// one batch entry per stream, later operations on the same stream override earlier ones
+STATIC BatchOpT *BatchGetOp(BatchOpT *ops, int *count, AlsaStreamAudioT *stream) {
+    for (int idx = 0; idx < *count; idx++) {
+        if (ops[idx].stream == stream) return &ops[idx];
+    }
+
+    BatchOpT *op = &ops[(*count)++];
+    op->stream = stream;
+    op->volume = -1;
+    op->mute = -1;
+    return op;
+}
+
+STATIC int BatchAddOne(SoftMixerT *mixer, AFB_ReqT request, json_object *opJ, BatchOpT *ops, int *count) {
+    json_object *volumeJ = NULL, *rampJ = NULL, *rampVolJ = NULL;
+    const char *streamUid = NULL, *sinkUid = NULL, *rampUid = NULL;
+    AlsaVolRampT *ramp = NULL;
+    int mute = -1, found = 0;
+
+    int error = wrap_json_unpack(opJ, "{s?s,s?s,s?o,s?b,s?o !}"
+            , "stream", &streamUid
+            , "sink", &sinkUid
+            , "volume", &volumeJ
+            , "mute", &mute
+            , "ramp", &rampJ
+            );
+    if (error || (!streamUid == !sinkUid) || (volumeJ && rampJ)) {
+        AFB_ReqFailF(request, "invalid-syntax", "batch operation expect {'stream'|'sink', 'volume'|'ramp', 'mute'} op=%s", json_object_get_string(opJ));
+        goto OnErrorExit;
+    }
+
+    if (rampJ) {
+        error = wrap_json_unpack(rampJ, "{ss,so !}", "uid", &rampUid, "volume", &rampVolJ);
+        ramp = error ? NULL : ApiRampGetByUid(mixer, rampUid);
+        if (!ramp) {
+            AFB_ReqFailF(request, "invalid-ramp", "batch ramp expect {'uid':existing-ramp, 'volume':value} op=%s", json_object_get_string(opJ));
+            goto OnErrorExit;
+        }
+        volumeJ = rampVolJ;
+    }
+
+    // 'sink' selects every stream playing to a zone or sound card
+    for (int idx = 0; mixer->streams[idx]; idx++) {
+        AlsaStreamAudioT *stream = mixer->streams[idx];
+        if (streamUid && strcasecmp(stream->uid, streamUid)) continue;
+        if (sinkUid && (!stream->sink || strcasecmp(stream->sink, sinkUid))) continue;
+
+        BatchOpT *op = BatchGetOp(ops, count, stream);
+        found++;
+
+        if (mute != -1) op->mute = mute;
+        if (!volumeJ) continue;
+
+        error = AlsaCtlNumidGetLong(mixer, stream->sndcard, stream->volume, &op->curvol);
+        if (error) {
+            AFB_ReqFailF(request, "invalid-numid", "batch stream=%s fail to get volume numid=%d", stream->uid, stream->volume);
+            goto OnErrorExit;
+        }
+
+        error = BatchParseVolume(volumeJ, op->curvol, &op->volume);
+        if (error) {
+            AFB_ReqFailF(request, "not-integer", "batch stream=%s volume should be integer or '[+|-|=]N' string op=%s", stream->uid, json_object_get_string(opJ));
+            goto OnErrorExit;
+        }
+        op->ramp = ramp;
+        op->rampJ = rampJ;
+    }
+
+    if (!found) {
+        AFB_ReqFailF(request, "not-found", "mixer=%s no stream for %s=%s", mixer->uid, streamUid ? "stream" : "sink", streamUid ? streamUid : sinkUid);
+        goto OnErrorExit;
+    }
+    return 0;
+
+OnErrorExit:
+    return -1;
+}
+
+// {"ops": [{"stream": "uid"|"sink": "zone-uid", "volume": 40|"+10", "mute": bool, "ramp": {"uid": "ramp-uid", "volume": 80}}, ...]}
+PUBLIC int ApiBatchApply(SoftMixerT *mixer, AFB_ReqT request, json_object *argsJ) {
+    BatchOpT *ops = calloc(mixer->max.streams + 1, sizeof (BatchOpT));
+    json_object *opsJ = argsJ, *responseJ;
+    int count = 0, error;
+
+    if (json_object_is_type(argsJ, json_type_object)) {
+        error = wrap_json_unpack(argsJ, "{so !}", "ops", &opsJ);
+        if (error) opsJ = NULL;
+    }
+    if (!json_object_is_type(opsJ, json_type_array)) {
+        AFB_ReqFailF(request, "invalid-syntax", "batch expect {'ops':[{'stream'|'sink', 'volume', 'mute', 'ramp'}, ...]} args=%s", json_object_get_string(argsJ));
+        goto OnErrorExit;
+    }
+
+    // validate everything first, nothing is applied on error
+    for (int idx = 0; idx < (int) json_object_array_length(opsJ); idx++) {
+        error = BatchAddOne(mixer, request, json_object_array_get_idx(opsJ, idx), ops, &count);
+        if (error) goto OnErrorExit;
+    }
+
+    // audio side first: native gains and mutes are picked up by every copy thread on its next period
+    for (int idx = 0; idx < count; idx++) {
+        BatchOpT *op = &ops[idx];
+        AlsaPcmCtlT *pcmIn = op->stream->copy ? op->stream->copy->pcmIn : NULL;
+        if (!pcmIn) continue;
+
+        if (op->volume >= 0 && pcmIn->gain)
+            AlsaPcmCopyVolumeSignal(mixer, pcmIn, op->volume, op->ramp ? AlsaVolRampUsec(op->ramp, op->curvol, op->volume) : 0);
+        if (op->mute != -1)
+            AlsaPcmCopyMuteSignal(mixer, pcmIn, op->mute);
+    }
+
+    // then controls, which carry the state and drive softvol when volume is not native
+    responseJ = json_object_new_object();
+    for (int idx = 0; idx < count; idx++) {
+        BatchOpT *op = &ops[idx];
+        AlsaStreamAudioT *stream = op->stream;
+        AlsaPcmCtlT *pcmIn = stream->copy ? stream->copy->pcmIn : NULL;
+        json_object *streamJ = json_object_new_object();
+
+        error = 0;
+        if (op->volume >= 0) {
+            if (op->ramp && !(pcmIn && pcmIn->gain)) error += AlsaVolRampApply(mixer, stream->sndcard, stream, op->rampJ);
+            else error += AlsaCtlNumidSetLong(mixer, stream->sndcard, stream->volume, op->volume);
+            json_object_object_add(streamJ, "volume", json_object_new_int((int) op->volume));
+        }
+        if (op->mute != -1) {
+            error += AlsaCtlNumidSetLong(mixer, stream->sndcard, stream->mute, op->mute);
+            json_object_object_add(streamJ, "mute", json_object_new_boolean(op->mute));
+        }
+        if (error) {
+            AFB_ApiError(mixer->api, "%s: mixer=%s stream=%s fail to write controls", __func__, mixer->uid, stream->uid);
+            json_object_object_add(streamJ, "error", json_object_new_boolean(true));
+        }
+        json_object_object_add(responseJ, stream->uid, streamJ);
+    }
+
+    free(ops);
+    AFB_ReqSuccess(request, responseJ, NULL);
+    return 0;
+
+OnErrorExit:
+    free(ops);
+    return -1;
+}
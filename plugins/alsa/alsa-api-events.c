@@ -0,0 +1,397 @@
+/*
+ * Copyright (C) 2018 "IoT.bzh"
+ * Author Fulup Ar Foll <fulup@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Change events: clients subscribe per stream ("stream/<uid>") or per sink
+ * ("sink/<uid>", every stream playing to that zone or sound card). Volume,
+ * mute and activity come from the ctl event handler, xruns from copy statistics
+ * polled on the main loop. Changes are coalesced: each event is pushed at most
+ * 'max_rate' times per second, with the latest state. The polling timer only
+ * runs while some event has listeners.
+ */
+
+#define _GNU_SOURCE  // needed for vasprintf
+
+#include "alsa-softmixer.h"
+#include <string.h>
+
+#define EVENTS_DEFAULT_RATE 10
+
+typedef struct {
+    const char *uid;        // kept across stream close/attach, so are subscriptions
+    const char *sink;
+    AFB_EventT event;       // NULL when only its sink is subscribed
+    int listeners;
+    long volume;
+    int mute;
+    int active;             // -1 until the loop reports it
+    unsigned int xruns;
+    bool dirty;             // changed since last stream event
+    bool sinkDirty;         // changed since last sink event
+    uint64_t lastUsec;
+} EventStreamT;
+
+typedef struct {
+    const char *uid;
+    AFB_EventT event;
+    int listeners;
+    uint64_t lastUsec;
+} EventSinkT;
+
+struct AlsaEventsS {
+    uint64_t minUsec;
+    sd_event_source *timer;
+    int nstreams;
+    EventStreamT **streams;
+    int nsinks;
+    EventSinkT **sinks;
+};
+
+STATIC EventSinkT *EventsSinkFind(AlsaEventsT *events, const char *uid) {
+    for (int idx = 0; uid && idx < events->nsinks; idx++) {
+        if (!strcasecmp(events->sinks[idx]->uid, uid)) return events->sinks[idx];
+    }
+    return NULL;
+}
+
+STATIC EventStreamT *EventsStreamFind(AlsaEventsT *events, const char *uid) {
+    for (int idx = 0; idx < events->nstreams; idx++) {
+        if (!strcasecmp(events->streams[idx]->uid, uid)) return events->streams[idx];
+    }
+    return NULL;
+}
+
+STATIC AlsaStreamAudioT *EventsStreamByUid(SoftMixerT *mixer, const char *uid) {
+    for (int idx = 0; mixer->streams[idx]; idx++) {
+        if (!strcasecmp(mixer->streams[idx]->uid, uid)) return mixer->streams[idx];
+    }
+    return NULL;
+}
+
+// state cache of a stream, seeded from its controls (one read, later updates come with ctl events)
+STATIC EventStreamT *EventsStreamGet(SoftMixerT *mixer, AlsaStreamAudioT *stream) {
+    AlsaEventsT *events = mixer->events.handle;
+    EventStreamT *entry = EventsStreamFind(events, stream->uid);
+    long mute = 0;
+
+    if (!entry) {
+        entry = calloc(1, sizeof (EventStreamT));
+        entry->uid = strdup(stream->uid);
+        entry->active = -1;
+        events->streams = realloc(events->streams, (events->nstreams + 1) * sizeof (void*));
+        events->streams[events->nstreams++] = entry;
+    }
+
+    if (entry->sink) free((char*) entry->sink);
+    entry->sink = stream->sink ? strdup(stream->sink) : NULL;
+
+    (void) AlsaCtlNumidGetLong(mixer, stream->sndcard, stream->volume, &entry->volume);
+    if (!AlsaCtlNumidGetLong(mixer, stream->sndcard, stream->mute, &mute)) entry->mute = (int) mute;
+    return entry;
+}
+
+STATIC json_object *EventsStreamJson(EventStreamT *entry) {
+    json_object *stateJ;
+
+    wrap_json_pack(&stateJ, "{ss,si,sb,si}"
+            , "stream", entry->uid
+            , "volume", (int) entry->volume
+            , "mute", entry->mute
+            , "xruns", (int) entry->xruns
+            );
+    if (entry->active >= 0) json_object_object_add(stateJ, "active", json_object_new_boolean(entry->active));
+    return stateJ;
+}
+
+// streams of one sink, all of them or only the ones changed since last sink event
+STATIC json_object *EventsSinkJson(AlsaEventsT *events, EventSinkT *sink, bool changed) {
+    json_object *streamsJ = json_object_new_object();
+    json_object *responseJ;
+
+    for (int idx = 0; idx < events->nstreams; idx++) {
+        EventStreamT *entry = events->streams[idx];
+        if (!entry->sink || strcasecmp(entry->sink, sink->uid)) continue;
+        if (changed) {
+            if (!entry->sinkDirty) continue;
+            entry->sinkDirty = false;
+        }
+        json_object_object_add(streamsJ, entry->uid, EventsStreamJson(entry));
+    }
+
+    wrap_json_pack(&responseJ, "{ss,so}", "sink", sink->uid, "streams", streamsJ);
+    return responseJ;
+}
+
+// push pending changes of every object whose last event is older than the coalescing interval
+STATIC void EventsFlush(SoftMixerT *mixer) {
+    AlsaEventsT *events = mixer->events.handle;
+    uint64_t now;
+
+    sd_event_now(mixer->sdLoop, CLOCK_MONOTONIC, &now);
+
+    for (int idx = 0; idx < events->nstreams; idx++) {
+        EventStreamT *entry = events->streams[idx];
+        if (!entry->dirty || !entry->event || now - entry->lastUsec < events->minUsec) continue;
+
+        entry->dirty = false;
+        entry->lastUsec = now;
+        if (AFB_EventPush(entry->event, EventsStreamJson(entry)) == 0) entry->listeners = 0;
+    }
+
+    for (int sdx = 0; sdx < events->nsinks; sdx++) {
+        EventSinkT *sink = events->sinks[sdx];
+        bool pending = false;
+
+        if (now - sink->lastUsec < events->minUsec) continue;
+        for (int idx = 0; !pending && idx < events->nstreams; idx++) {
+            EventStreamT *entry = events->streams[idx];
+            pending = entry->sinkDirty && entry->sink && !strcasecmp(entry->sink, sink->uid);
+        }
+        if (!pending) continue;
+
+        sink->lastUsec = now;
+        if (AFB_EventPush(sink->event, EventsSinkJson(events, sink, true)) == 0) sink->listeners = 0;
+    }
+}
+
+// listeners only drop on unsubscribe or when a push reached nobody (client gone)
+STATIC bool EventsListened(AlsaEventsT *events) {
+    for (int idx = 0; idx < events->nstreams; idx++) {
+        if (events->streams[idx]->listeners > 0) return true;
+    }
+    for (int idx = 0; idx < events->nsinks; idx++) {
+        if (events->sinks[idx]->listeners > 0) return true;
+    }
+    return false;
+}
+
+// (re)start the polling timer after a subscription, stop it once nobody listens
+STATIC void EventsArm(SoftMixerT *mixer) {
+    AlsaEventsT *events = mixer->events.handle;
+    int enabled = SD_EVENT_OFF;
+    uint64_t usec;
+
+    (void) sd_event_source_get_enabled(events->timer, &enabled);
+
+    if (!EventsListened(events)) {
+        if (enabled != SD_EVENT_OFF) sd_event_source_set_enabled(events->timer, SD_EVENT_OFF);
+        return;
+    }
+    if (enabled != SD_EVENT_OFF) return;
+
+    sd_event_now(mixer->sdLoop, CLOCK_MONOTONIC, &usec);
+    sd_event_source_set_time(events->timer, usec + events->minUsec);
+    sd_event_source_set_enabled(events->timer, SD_EVENT_ON);
+}
+
+// xruns are counted by copy threads, poll them here rather than from the audio path
+STATIC int EventsTimerCB(sd_event_source* source, uint64_t timer, void* handle) {
+    SoftMixerT *mixer = (SoftMixerT*) handle;
+    AlsaEventsT *events = mixer->events.handle;
+
+    for (int idx = 0; idx < events->nstreams; idx++) {
+        EventStreamT *entry = events->streams[idx];
+        AlsaStreamAudioT *stream = EventsStreamByUid(mixer, entry->uid);
+        if (!stream || !stream->copy) continue;
+
+        unsigned int xruns = atomic_load_explicit(&stream->copy->stats.capture.xruns, memory_order_relaxed)
+                + atomic_load_explicit(&stream->copy->stats.playback.xruns, memory_order_relaxed);
+        if (xruns == entry->xruns) continue;
+
+        entry->xruns = xruns;
+        entry->dirty = entry->sinkDirty = true;
+    }
+
+    EventsFlush(mixer);
+
+    if (!EventsListened(events)) {
+        sd_event_source_set_enabled(source, SD_EVENT_OFF);
+        return 0;
+    }
+
+    sd_event_source_set_time(source, timer + events->minUsec);
+    sd_event_source_set_enabled(source, SD_EVENT_ON);
+    return 0;
+}
+
+// created by the first subscription, nothing runs until a client asks for events
+STATIC AlsaEventsT *EventsCreate(SoftMixerT *mixer) {
+    AlsaEventsT *events = mixer->events.handle;
+    uint64_t usec;
+
+    if (events) return events;
+
+    events = calloc(1, sizeof (AlsaEventsT));
+    events->minUsec = 1000000 / (mixer->events.maxRate > 0 ? mixer->events.maxRate : EVENTS_DEFAULT_RATE);
+
+    sd_event_now(mixer->sdLoop, CLOCK_MONOTONIC, &usec);
+    int error = sd_event_add_time(mixer->sdLoop, &events->timer, CLOCK_MONOTONIC, usec + events->minUsec, events->minUsec / 4, EventsTimerCB, mixer);
+    if (error < 0) {
+        AFB_ApiError(mixer->api, "%s: mixer=%s fail to add events timer error=%s", __func__, mixer->uid, strerror(-error));
+        free(events);
+        return NULL;
+    }
+
+    mixer->events.handle = events;
+    return events;
+}
+
+// ctl event handler: a registered control of 'stream' changed
+PUBLIC void AlsaEventsStream(SoftMixerT *mixer, AlsaStreamAudioT *stream, RegistryNumidT type, long value) {
+    AlsaEventsT *events = mixer->events.handle;
+    if (!events) return;
+
+    // streams only get a state cache once they, or their sink, are subscribed
+    EventStreamT *entry = EventsStreamFind(events, stream->uid);
+    if (!entry) {
+        if (!EventsSinkFind(events, stream->sink)) return;
+        entry = EventsStreamGet(mixer, stream);
+    }
+
+    switch (type) {
+        case FONTEND_NUMID_VOLUME:
+            if (entry->volume == value) return;
+            entry->volume = value;
+            break;
+        case FONTEND_NUMID_PAUSE:
+            if (entry->mute == (int) value) return;
+            entry->mute = (int) value;
+            break;
+        case FONTEND_NUMID_RUN:
+            if (entry->active == (int) value) return;
+            entry->active = (int) value;
+            break;
+        default:
+            return;
+    }
+
+    entry->dirty = entry->sinkDirty = true;
+    EventsFlush(mixer);
+}
+
+// {"stream": "uid"} or {"sink": "zone|sound card uid"}, response holds the current state
+PUBLIC int ApiEventsSubscribe(SoftMixerT *mixer, AFB_ReqT request, json_object *argsJ, bool subscribe) {
+    const char *streamUid = NULL, *sinkUid = NULL;
+    AFB_EventT event = NULL;
+    int *listeners;
+    json_object *responseJ;
+    char *name = NULL;
+
+    int error = wrap_json_unpack(argsJ, "{s?s,s?s !}", "stream", &streamUid, "sink", &sinkUid);
+    if (error || !streamUid == !sinkUid) {
+        AFB_ReqFailF(request, "invalid-syntax", "%s expect {'stream':uid} or {'sink':uid} args=%s",
+                     subscribe ? "subscribe" : "unsubscribe", json_object_get_string(argsJ));
+        goto OnErrorExit;
+    }
+
+    // unsubscribe only reads existing state, it never creates events or caches
+    AlsaEventsT *events = subscribe ? EventsCreate(mixer) : mixer->events.handle;
+    if (!events && subscribe) {
+        AFB_ReqFailF(request, "internal-error", "mixer=%s fail to start events", mixer->uid);
+        goto OnErrorExit;
+    }
+
+    if (streamUid) {
+        EventStreamT *entry = NULL;
+
+        if (!subscribe) {
+            if (events) entry = EventsStreamFind(events, streamUid);
+            if (!entry || !entry->event) {
+                AFB_ReqFailF(request, "not-subscribed", "mixer=%s no event for stream uid=%s", mixer->uid, streamUid);
+                goto OnErrorExit;
+            }
+        } else {
+            AlsaStreamAudioT *stream = EventsStreamByUid(mixer, streamUid);
+            if (!stream) {
+                AFB_ReqFailF(request, "not-found", "mixer=%s no stream uid=%s", mixer->uid, streamUid);
+                goto OnErrorExit;
+            }
+
+            entry = EventsStreamGet(mixer, stream);
+            if (!entry->event) {
+                if (asprintf(&name, "stream/%s", entry->uid) == -1) goto OnErrorExit;
+                entry->event = AFB_EventMake(mixer->api, name);
+            }
+        }
+        event = entry->event;
+        listeners = &entry->listeners;
+        responseJ = EventsStreamJson(entry);
+
+    } else {
+        EventSinkT *sink = NULL;
+
+        if (!subscribe) {
+            if (events) sink = EventsSinkFind(events, sinkUid);
+            if (!sink) {
+                AFB_ReqFailF(request, "not-subscribed", "mixer=%s no event for sink uid=%s", mixer->uid, sinkUid);
+                goto OnErrorExit;
+            }
+        } else {
+            bool zone = false;
+            for (int idx = 0; mixer->zones[idx]; idx++) {
+                if (!strcasecmp(mixer->zones[idx]->uid, sinkUid)) zone = true;
+            }
+            if (!zone && !ApiSinkGetByUid(mixer, sinkUid)) {
+                AFB_ReqFailF(request, "not-found", "mixer=%s no zone or sink uid=%s", mixer->uid, sinkUid);
+                goto OnErrorExit;
+            }
+
+            sink = EventsSinkFind(events, sinkUid);
+            if (!sink) {
+                sink = calloc(1, sizeof (EventSinkT));
+                sink->uid = strdup(sinkUid);
+                if (asprintf(&name, "sink/%s", sink->uid) == -1) goto OnErrorExit;
+                sink->event = AFB_EventMake(mixer->api, name);
+                events->sinks = realloc(events->sinks, (events->nsinks + 1) * sizeof (void*));
+                events->sinks[events->nsinks++] = sink;
+            }
+
+            // current state of every stream playing there
+            for (int idx = 0; mixer->streams[idx]; idx++) {
+                AlsaStreamAudioT *stream = mixer->streams[idx];
+                if (stream->sink && !strcasecmp(stream->sink, sinkUid)) (void) EventsStreamGet(mixer, stream);
+            }
+        }
+        event = sink->event;
+        listeners = &sink->listeners;
+        responseJ = EventsSinkJson(events, sink, false);
+    }
+
+    if (!AFB_EventIsValid(event)) {
+        json_object_put(responseJ);
+        AFB_ReqFailF(request, "internal-error", "mixer=%s fail to create event=%s", mixer->uid, name);
+        goto OnErrorExit;
+    }
+
+    error = subscribe ? AFB_ReqSubscribe(request, event) : AFB_ReqUnsubscribe(request, event);
+    if (error) {
+        json_object_put(responseJ);
+        AFB_ReqFailF(request, "subscribe-fail", "mixer=%s fail to %s stream=%s sink=%s", mixer->uid,
+                     subscribe ? "subscribe" : "unsubscribe", streamUid, sinkUid);
+        goto OnErrorExit;
+    }
+
+    if (subscribe) (*listeners)++;
+    else if (*listeners > 0) (*listeners)--;
+    EventsArm(mixer);
+
+    free(name);
+    AFB_ReqSuccess(request, responseJ, NULL);
+    return 0;
+
+OnErrorExit:
+    free(name);
+    return -1;
+}
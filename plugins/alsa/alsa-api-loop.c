@@ -47,10 +47,83 @@ PUBLIC AlsaLoopSubdevT *ApiLoopFindSubdev(SoftMixerT *mixer, const char *streamU
     return NULL;
 }
 
-STATIC AlsaLoopSubdevT *ProcessOneSubdev(SoftMixerT *mixer, AlsaSndLoopT *loop, json_object *subdevJ) {
-    AlsaLoopSubdevT *subdev = calloc(1, sizeof (AlsaPcmCtlT));
+// snd-aloop exposes each cable state as PCM iface controls addressed by device/subdevice
+STATIC int LoopSubdevNumid(AlsaSndLoopT *loop, AlsaLoopSubdevT *subdev, const char *ctlName) {
+    snd_ctl_elem_id_t *elemId;
+    snd_ctl_elem_info_t *elemInfo;
 
-    int error = wrap_json_unpack(subdevJ, "{s?s, si,si !}"
+    snd_ctl_elem_id_alloca(&elemId);
+    snd_ctl_elem_info_alloca(&elemInfo);
+
+    snd_ctl_elem_id_set_interface(elemId, SND_CTL_ELEM_IFACE_PCM);
+    snd_ctl_elem_id_set_name(elemId, ctlName);
+    snd_ctl_elem_id_set_device(elemId, loop->capture);
+    snd_ctl_elem_id_set_subdevice(elemId, subdev->index);
+    snd_ctl_elem_info_set_id(elemInfo, elemId);
+
+    if (snd_ctl_elem_info(loop->sndcard->ctl, elemInfo) < 0) return 0;
+    return (int) snd_ctl_elem_info_get_numid(elemInfo);
+}
+
+// assert loop capture device exists from ctl enumeration and return its subdev count
+STATIC int LoopProbeCapture(SoftMixerT *mixer, AlsaSndLoopT *loop) {
+    snd_pcm_info_t *pcmInfo;
+    int device = -1;
+    int error;
+
+    snd_pcm_info_alloca(&pcmInfo);
+
+    do {
+        error = snd_ctl_pcm_next_device(loop->sndcard->ctl, &device);
+    } while (!error && device >= 0 && device != loop->capture);
+
+    if (error || device < 0) {
+        AFB_ApiError(mixer->api, "%s: loop=%s no capture device=%d", __func__, loop->uid, loop->capture);
+        goto OnErrorExit;
+    }
+
+    snd_pcm_info_set_device(pcmInfo, loop->capture);
+    snd_pcm_info_set_subdevice(pcmInfo, 0);
+    snd_pcm_info_set_stream(pcmInfo, SND_PCM_STREAM_CAPTURE);
+    error = snd_ctl_pcm_info(loop->sndcard->ctl, pcmInfo);
+    if (error < 0) {
+        AFB_ApiError(mixer->api, "%s: loop=%s device=%d not a capture device error=%s", __func__, loop->uid, loop->capture, snd_strerror(error));
+        goto OnErrorExit;
+    }
+
+    return (int) snd_pcm_info_get_subdevices_count(pcmInfo);
+
+OnErrorExit:
+    return -1;
+}
+
+// once the playback side of a loop subdev runs, capture has to match its params
+PUBLIC int ApiLoopCheckSubdev(SoftMixerT *mixer, AlsaSndLoopT *loop, AlsaLoopSubdevT *subdev, AlsaPcmHwInfoT *params) {
+    long active, rate, format, channels;
+
+    if (!subdev->slave.rate || !subdev->slave.format || !subdev->slave.channels) return 0;
+    if (AlsaCtlNumidGetLong(mixer, loop->sndcard, subdev->numid, &active) || !active) return 0;
+
+    if (AlsaCtlNumidGetLong(mixer, loop->sndcard, subdev->slave.rate, &rate)
+            || AlsaCtlNumidGetLong(mixer, loop->sndcard, subdev->slave.format, &format)
+            || AlsaCtlNumidGetLong(mixer, loop->sndcard, subdev->slave.channels, &channels))
+        return 0;
+
+    if ((params->rate && rate != params->rate) || (format != params->format) || (params->channels && channels != params->channels)) {
+        AFB_ApiError(mixer->api, "%s: loop=%s subdev=%d playing [%ld,%s,%ldch] does not match capture [%d,%s,%dch]", __func__,
+                     loop->uid, subdev->index, rate, snd_pcm_format_name((snd_pcm_format_t) format), channels,
+                     params->rate, params->formatS, params->channels);
+        return -1;
+    }
+
+    return 0;
+}
+
+STATIC AlsaLoopSubdevT *ProcessOneSubdev(SoftMixerT *mixer, AlsaSndLoopT *loop, json_object *subdevJ, int scount) {
+    AlsaLoopSubdevT *subdev = calloc(1, sizeof (AlsaLoopSubdevT));
+    snd_pcm_info_t *pcmInfo;
+
+    int error = wrap_json_unpack(subdevJ, "{s?s, si,s?i !}"
             , "uid", &subdev->uid
             , "subdev", &subdev->index
             , "numid", &subdev->numid
@@ -63,23 +136,30 @@ STATIC AlsaLoopSubdevT *ProcessOneSubdev(SoftMixerT *mixer, AlsaSndLoopT *loop,
     // subdev with no UID are dynamically attached
     if (subdev->uid) subdev->uid = strdup(subdev->uid);
 
-    // create loop subdev entry point with cardidx+device+subdev in order to open subdev and not sndcard
-    AlsaDevInfoT loopSubdev;
-    loopSubdev.devpath=NULL;
-    loopSubdev.cardid=NULL;
-    loopSubdev.pcmplug_params = NULL;
-    loopSubdev.cardidx = loop->sndcard->cid.cardidx;
-    loopSubdev.device = loop->capture;
-    loopSubdev.subdev = subdev->index;
+    // assert this loopback subdev exists in capture mode, one ioctl on the loop ctl instead of a pcm open/close
+    if (subdev->index < 0 || subdev->index >= scount) {
+        AFB_ApiError(mixer->api, "%s: loop=%s subdev=%d out of range (count=%d)", __func__, loop->uid, subdev->index, scount);
+        goto OnErrorExit;
+    }
 
-    // assert we may open this loopback subdev in capture mode
-    AlsaPcmCtlT *pcmInfo = AlsaByPathOpenPcm(mixer, &loopSubdev, SND_PCM_STREAM_CAPTURE);
-    if (!pcmInfo) goto OnErrorExit;
+    snd_pcm_info_alloca(&pcmInfo);
+    snd_pcm_info_set_device(pcmInfo, loop->capture);
+    snd_pcm_info_set_subdevice(pcmInfo, subdev->index);
+    snd_pcm_info_set_stream(pcmInfo, SND_PCM_STREAM_CAPTURE);
+    error = snd_ctl_pcm_info(loop->sndcard->ctl, pcmInfo);
+    if (error < 0) {
+        AFB_ApiError(mixer->api, "%s: loop=%s subdev=%d invalid capture error=%s", __func__, loop->uid, subdev->index, snd_strerror(error));
+        goto OnErrorExit;
+    }
+    subdev->name = strdup(snd_pcm_info_get_subdevice_name(pcmInfo));
 
-    // free PCM as we only open loop to assert it's a valid capture device
-    snd_pcm_close(pcmInfo->handle);
-    free(pcmInfo);
+    // cable state controls, run control defaults to the subdev own one
+    if (!subdev->numid) subdev->numid = LoopSubdevNumid(loop, subdev, "PCM Slave Active");
+    subdev->slave.rate = LoopSubdevNumid(loop, subdev, "PCM Slave Rate");
+    subdev->slave.format = LoopSubdevNumid(loop, subdev, "PCM Slave Format");
+    subdev->slave.channels = LoopSubdevNumid(loop, subdev, "PCM Slave Channels");
 
+    AFB_ApiInfo(mixer->api, "%s: loop=%s subdev=%d name=%s numid=%d", __func__, loop->uid, subdev->index, subdev->name, subdev->numid);
     return subdev;
 
 OnErrorExit:
@@ -126,11 +206,14 @@ STATIC AlsaSndLoopT *AttachOneLoop(SoftMixerT *mixer, const char *uid, json_obje
         }
     }
 
+    int scount = LoopProbeCapture(mixer, loop);
+    if (scount < 0) goto OnErrorExit;
+
     switch (json_object_get_type(subdevsJ)) {
         case json_type_object:
             loop->scount = 1;
             loop->subdevs = calloc(2, sizeof (void*));
-            loop->subdevs[0] = ProcessOneSubdev(mixer, loop, subdevsJ);
+            loop->subdevs[0] = ProcessOneSubdev(mixer, loop, subdevsJ, scount);
             if (!loop->subdevs[0]) goto OnErrorExit;
             break;
         case json_type_array:
@@ -138,7 +221,7 @@ STATIC AlsaSndLoopT *AttachOneLoop(SoftMixerT *mixer, const char *uid, json_obje
             loop->subdevs = calloc(loop->scount + 1, sizeof (void*));
             for (int idx = 0; idx < loop->scount; idx++) {
                 json_object *subdevJ = json_object_array_get_idx(subdevsJ, idx);
-                loop->subdevs[idx] = ProcessOneSubdev(mixer, loop, subdevJ);
+                loop->subdevs[idx] = ProcessOneSubdev(mixer, loop, subdevJ, scount);
                 if (!loop->subdevs[idx]) goto OnErrorExit;
             }
             break;
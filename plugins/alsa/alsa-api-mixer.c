@@ -31,31 +31,22 @@ static void MixerRemoveVerb(AFB_ReqT request) {
     SoftMixerT *mixer = (SoftMixerT*) afb_req_get_vcbdata(request);
     int error;
 
-    for (int idx = 0; mixer->streams[idx]->uid; idx++) {
-        AlsaStreamAudioT *stream = mixer->streams[idx];
-        AlsaPcmCopyHandleT * copy = stream->copy;
+    // streams array stays packed, remove the first one until none is left
+    while (mixer->streams[0]) {
+        AlsaStreamAudioT *stream = mixer->streams[0];
 
         AFB_ApiNotice(mixer->api, "cleaning mixer=%s stream=%s", mixer->uid, stream->uid);
 
-        error = pthread_cancel(stream->copy->rthread);
-        if (error) {
-            AFB_ReqFailF(request, "internal-error", "Fail to kill audio-stream threads mixer=%s", mixer->uid);
-            goto OnErrorExit;
-        }
-
-        error = afb_api_del_verb(mixer->api, stream->uid, (void**)&mixer);
+        error = ApiStreamRemove(mixer, stream);
         if (error) {
-            AFB_ReqFailF(request, "internal-error", "Mixer=%s fail to remove verb=%s error=%s", mixer->uid, stream->uid, strerror(error));
+            AFB_ReqFailF(request, "internal-error", "Fail to remove audio-stream mixer=%s stream=%s", mixer->uid, stream->uid);
             goto OnErrorExit;
         }
-
-        // free audio-stream dynamic structures
-        snd_pcm_close(copy->pcmIn->handle);
-        snd_pcm_close(copy->pcmOut->handle);
-        if (copy->evtsrc) sd_event_source_unref(copy->evtsrc);
-        if (copy->sdLoop) sd_event_unref(copy->sdLoop);
     }
 
+    // parked copy threads are only needed by streams
+    AlsaPcmCopyPoolFree(mixer);
+
     //    // (Fulup to be Done) registry is attached to source
     //    if (mixer->sources) ApiSourcFree (mixer);
     //    if (mixer->sinks) ApiSinkFree (mixer);
@@ -63,14 +54,10 @@ static void MixerRemoveVerb(AFB_ReqT request) {
     //    if (mixer->ramps) ApiRampFree (mixer);
     //    if (mixer->zones) ApiZoneFree (mixer);
 
-    // finally free mixer handle
-    free(mixer);
     AFB_ReqSuccess(request, NULL, "Fulup: delete might not clean everything properly");
 
-    return;
-
 OnErrorExit:
-    AFB_ReqFail(request, "internal-error", "fail to delete mixer");
+    return;
 }
 
 STATIC json_object *MixerInfoOneStream(AlsaStreamAudioT *stream, int verbose) {
@@ -269,6 +256,8 @@ STATIC json_object *MixerInfoOneZone(AlsaSndZoneT *zone, int verbose) {
             json_object_object_add(responseJ, "sinks", sinksJ);
         }
 
+        if (zone->matrix) json_object_object_add(responseJ, "matrix", AlsaMatrixJson(zone->matrix));
+
         if (zone->sources) {
             json_object *sourcesJ = json_object_new_array();
             for (int jdx = 0; zone->sources[jdx]; jdx++) {
@@ -540,6 +529,194 @@ STATIC void MixerInfoVerb(AFB_ReqT request) {
     MixerInfoAction(request, argsJ);
 }
 
+// copy statistics of every stream, or of the one given by {"uid": "xxx"}
+STATIC void MixerStatsVerb(AFB_ReqT request) {
+    SoftMixerT *mixer = (SoftMixerT*) afb_req_get_vcbdata(request);
+    json_object *argsJ = afb_req_json(request);
+    json_object *responseJ = json_object_new_object();
+    const char *uid = NULL;
+    int found = 0;
+
+    if (argsJ && json_object_get_type(argsJ) == json_type_object) {
+        int error = wrap_json_unpack(argsJ, "{s?s !}", "uid", &uid);
+        if (error) {
+            AFB_ReqFailF(request, "invalid-syntax", "stats optional 'uid' args=%s", json_object_get_string(argsJ));
+            goto OnErrorExit;
+        }
+    }
+
+    for (int idx = 0; mixer->streams[idx]; idx++) {
+        AlsaStreamAudioT *stream = mixer->streams[idx];
+        if (!stream->copy) continue;
+        if (uid && strcasecmp(stream->uid, uid)) continue;
+
+        json_object_object_add(responseJ, stream->uid, AlsaStatsJson(stream->copy));
+        found++;
+    }
+
+    if (uid && !found) {
+        AFB_ReqFailF(request, "not-found", "mixer=%s no active stream uid=%s", mixer->uid, uid);
+        goto OnErrorExit;
+    }
+
+    AFB_ReqSuccess(request, responseJ, NULL);
+    return;
+
+OnErrorExit:
+    json_object_put(responseJ);
+}
+
+// trace files only go to the runtime directory, the verb picks a file name, never a path
+STATIC char *MixerTracePath(const char *file) {
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    char *path;
+
+    if (!file) file = "smixer-trace.json";
+    if (!file[0] || file[0] == '.' || strchr(file, '/')) return NULL;
+    if (!dir || dir[0] != '/') dir = "/tmp";
+
+    if (asprintf(&path, "%s/%s", dir, file) == -1) return NULL;
+    return path;
+}
+
+STATIC void MixerTraceVerb(AFB_ReqT request) {
+    SoftMixerT *mixer = (SoftMixerT*) afb_req_get_vcbdata(request);
+    json_object *argsJ = afb_req_json(request);
+    const char *file = NULL;
+    char *path = NULL;
+    int enable = -1, clear = 0, dump = 0, count = 0;
+
+    int error = wrap_json_unpack(argsJ, "{s?b,s?b,s?b,s?s !}"
+            , "enable", &enable
+            , "clear", &clear
+            , "dump", &dump
+            , "file", &file
+            );
+    if (error) {
+        AFB_ReqFailF(request, "invalid-syntax", "trace optional {'enable':bool,'clear':bool,'dump':bool,'file':'name.json'} args=%s", json_object_get_string(argsJ));
+        return;
+    }
+
+    // dump before clear so that {"dump":true,"clear":true} restarts a fresh capture
+    if (dump || file) {
+        path = MixerTracePath(file);
+        if (!path) {
+            AFB_ReqFailF(request, "invalid-file", "mixer=%s trace file should be a plain file name file=%s", mixer->uid, file);
+            return;
+        }
+        error = AlsaTraceDump(mixer, path, &count);
+        if (error) {
+            AFB_ReqFailF(request, "dump-fail", "mixer=%s fail to write trace path=%s", mixer->uid, path);
+            free(path);
+            return;
+        }
+    }
+
+    if (clear) AlsaTraceClear();
+    if (enable >= 0) AlsaTraceEnable(enable);
+
+    json_object *responseJ;
+    wrap_json_pack(&responseJ, "{sb,si,ss*}"
+            , "enabled", atomic_load(&AlsaTraceEnabled)
+            , "count", count
+            , "path", path
+            );
+    free(path);
+    AFB_ReqSuccess(request, responseJ, NULL);
+}
+
+// per stream or per sink change events, see alsa-api-events.c
+STATIC void MixerSubscribeVerb(AFB_ReqT request) {
+    SoftMixerT *mixer = (SoftMixerT*) afb_req_get_vcbdata(request);
+    (void) ApiEventsSubscribe(mixer, request, afb_req_json(request), true);
+}
+
+STATIC void MixerUnsubscribeVerb(AFB_ReqT request) {
+    SoftMixerT *mixer = (SoftMixerT*) afb_req_get_vcbdata(request);
+    (void) ApiEventsSubscribe(mixer, request, afb_req_json(request), false);
+}
+
+// volume/mute/ramp of many streams at once, see alsa-api-batch.c
+STATIC void MixerBatchVerb(AFB_ReqT request) {
+    SoftMixerT *mixer = (SoftMixerT*) afb_req_get_vcbdata(request);
+    json_object *argsJ = afb_req_json(request);
+
+    (void) ApiBatchApply(mixer, request, argsJ);
+}
+
+// native mixing zone matrix: {"zone": "xxx"} reads it, "gains" ([[zone port gains per mix channel], ...]) replaces
+// it and "cells" ([{"in": port, "out": channel, "gain": value}, ...]) updates some of its cells
+STATIC void MixerMatrixVerb(AFB_ReqT request) {
+    SoftMixerT *mixer = (SoftMixerT*) afb_req_get_vcbdata(request);
+    json_object *argsJ = afb_req_json(request);
+    json_object *gainsJ = NULL, *cellsJ = NULL;
+    const char *uid = NULL;
+    float *gains = NULL;
+
+    int error = wrap_json_unpack(argsJ, "{ss,s?o,s?o !}"
+            , "zone", &uid
+            , "gains", &gainsJ
+            , "cells", &cellsJ
+            );
+    if (error) {
+        AFB_ReqFailF(request, "invalid-syntax", "matrix {'zone':uid, 'gains':[[...]], 'cells':[{'in','out','gain'}]} args=%s", json_object_get_string(argsJ));
+        goto OnErrorExit;
+    }
+
+    if (mixer->mixing != MIXING_NATIVE || !mixer->zones[0]) {
+        AFB_ReqFailF(request, "not-supported", "mixer=%s channel matrix requires native mixing and zones", mixer->uid);
+        goto OnErrorExit;
+    }
+
+    AlsaSndZoneT *zone = ApiZoneGetByUid(mixer, uid);
+    AlsaMatrixT *matrix = zone && zone->sinks ? ApiZoneNativeMatrix(mixer, zone) : NULL;
+    if (!matrix) {
+        AFB_ReqFailF(request, "not-found", "mixer=%s no playback zone uid=%s", mixer->uid, uid);
+        goto OnErrorExit;
+    }
+
+    if (gainsJ || cellsJ) {
+        unsigned int inputs = AlsaMatrixInputs(matrix), outputs = AlsaMatrixOutputs(matrix);
+        gains = AlsaMatrixGains(matrix, inputs, outputs);
+
+        if (gainsJ) {
+            if (!json_object_is_type(gainsJ, json_type_array) || json_object_array_length(gainsJ) != inputs) goto OnBadGains;
+            for (unsigned int idx = 0; idx < inputs; idx++) {
+                json_object *rowJ = json_object_array_get_idx(gainsJ, idx);
+                if (!json_object_is_type(rowJ, json_type_array) || json_object_array_length(rowJ) != outputs) goto OnBadGains;
+                for (unsigned int odx = 0; odx < outputs; odx++)
+                    gains[idx * outputs + odx] = (float) json_object_get_double(json_object_array_get_idx(rowJ, odx));
+            }
+        }
+
+        if (cellsJ && !json_object_is_type(cellsJ, json_type_array)) goto OnBadGains;
+        for (int cdx = 0; cellsJ && cdx < (int) json_object_array_length(cellsJ); cdx++) {
+            int in, out;
+            double gain;
+
+            error = wrap_json_unpack(json_object_array_get_idx(cellsJ, cdx), "{si,si,sF !}", "in", &in, "out", &out, "gain", &gain);
+            if (error || in < 0 || in >= (int) inputs || out < 0 || out >= (int) outputs) goto OnBadGains;
+            gains[in * outputs + out] = (float) gain;
+        }
+
+        error = ApiZoneSetMatrix(mixer, zone, gains);
+        if (error) {
+            AFB_ReqFailF(request, "matrix-fail", "mixer=%s zone=%s fail to update matrix", mixer->uid, uid);
+            goto OnErrorExit;
+        }
+        free(gains);
+    }
+
+    AFB_ReqSuccess(request, AlsaMatrixJson(zone->matrix), NULL);
+    return;
+
+OnBadGains:
+    AFB_ReqFailF(request, "invalid-gains", "zone=%s expect %dx%d gains or cells in range args=%s", uid,
+                 AlsaMatrixInputs(matrix), AlsaMatrixOutputs(matrix), json_object_get_string(argsJ));
+OnErrorExit:
+    free(gains);
+}
+
 STATIC void MixerAttachVerb(AFB_ReqT request) {
     SoftMixerT *mixer = (SoftMixerT*) afb_req_get_vcbdata(request);
     const char *uid = NULL, *prefix = NULL;
@@ -685,6 +862,12 @@ STATIC AFB_ApiVerbs CtrlApiVerbs[] = {
     { .verb = "attach", .callback = MixerAttachVerb, .info = "attach resources to mixer"},
     { .verb = "remove", .callback = MixerRemoveVerb, .info = "remove existing mixer streams, zones, ..."},
     { .verb = "info", .callback = MixerInfoVerb, .info = "list existing mixer streams, zones, ..."},
+    { .verb = "stats", .callback = MixerStatsVerb, .info = "per stream copy statistics (xruns, jitter, fill level)"},
+    { .verb = "trace", .callback = MixerTraceVerb, .info = "period level tracing, dump as chrome trace json"},
+    { .verb = "subscribe", .callback = MixerSubscribeVerb, .info = "volume/mute/activity/xrun events of a stream or sink"},
+    { .verb = "unsubscribe", .callback = MixerUnsubscribeVerb, .info = "stop events of a stream or sink"},
+    { .verb = "batch", .callback = MixerBatchVerb, .info = "validate then apply volume/mute/ramp of many streams at once"},
+    { .verb = "matrix", .callback = MixerMatrixVerb, .info = "native mixing zone channel matrix, per cell gains"},
 	{ .verb = "bluezalsa_dev", .callback = MixerBluezAlsaDevVerb, .info = "set bluez alsa device"},
     { .verb = NULL} /* marker for end of the array */
 };
@@ -762,19 +945,23 @@ CTLP_CAPI(MixerCreate, source, argsJ, responseJ) {
     source->context = mixer;
 
     int error;
+    json_object *engineJ = NULL, *startupJ = NULL, *eventsJ = NULL;
+    const char *mixing = NULL;
+    const char *volume = NULL;
     mixer->max.loops = SMIXER_DEFLT_RAMPS;
     mixer->max.sinks = SMIXER_DEFLT_SINKS;
     mixer->max.sources = SMIXER_DEFLT_SOURCES;
     mixer->max.zones = SMIXER_DEFLT_ZONES;
     mixer->max.streams = SMIXER_DEFLT_STREAMS;
     mixer->max.ramps = SMIXER_DEFLT_RAMPS;
+    mixer->engine.mode = COPY_ENGINE_THREADS;
 
     if (json_object_get_type(argsJ) != json_type_object) {
         AFB_ApiError(source->api, "_mixer_new_: invalid object type= %s", json_object_get_string(argsJ));
         goto OnErrorExit;
     }
 
-    error = wrap_json_unpack(argsJ, "{ss,s?s,s?i,s?i,s?i,s?i,s?i,s?i !}"
+    error = wrap_json_unpack(argsJ, "{ss,s?s,s?i,s?i,s?i,s?i,s?i,s?i,s?o,s?o,s?i,s?s,s?s,s?o !}"
             , "uid", &mixer->uid
             , "info", &mixer->info
             , "max_loop", &mixer->max.loops
@@ -783,9 +970,74 @@ CTLP_CAPI(MixerCreate, source, argsJ, responseJ) {
             , "max_zone", &mixer->max.zones
             , "max_stream", &mixer->max.streams
             , "max_ramp", &mixer->max.ramps
+            , "engine", &engineJ
+            , "startup", &startupJ
+            , "idle_ms", &mixer->idleMs
+            , "mixing", &mixing
+            , "volume", &volume
+            , "events", &eventsJ
             );
     if (error) {
-        AFB_ApiNotice(source->api, "_mixer_new_ missing 'uid|max_loop|max_sink|max_source|max_zone|max_stream|max_ramp' error=%s mixer=%s", wrap_json_get_error_string(error), json_object_get_string(argsJ));
+        AFB_ApiNotice(source->api, "_mixer_new_ missing 'uid|max_loop|max_sink|max_source|max_zone|max_stream|max_ramp|engine|startup|idle_ms|mixing|volume|events' error=%s mixer=%s", wrap_json_get_error_string(error), json_object_get_string(argsJ));
+        goto OnErrorExit;
+    }
+
+    if (engineJ) {
+        const char *mode = NULL;
+        error = wrap_json_unpack(engineJ, "{s?s,s?i,s?i !}"
+                , "mode", &mode
+                , "workers", &mixer->engine.workers
+                , "pool", &mixer->engine.pool
+                );
+        if (error) {
+            AFB_ApiError(source->api, "_mixer_new_ engine missing 'mode|workers|pool' error=%s engine=%s", wrap_json_get_error_string(error), json_object_get_string(engineJ));
+            goto OnErrorExit;
+        }
+
+        if (!mode || !strcasecmp(mode, "threads")) mixer->engine.mode = COPY_ENGINE_THREADS;
+        else if (!strcasecmp(mode, "shared")) mixer->engine.mode = COPY_ENGINE_SHARED;
+        else {
+            AFB_ApiError(source->api, "_mixer_new_ engine invalid mode=%s (threads|shared)", mode);
+            goto OnErrorExit;
+        }
+    }
+
+    if (startupJ) {
+        int parallel = 0, lazy = 0;
+        error = wrap_json_unpack(startupJ, "{s?b,s?b,s?i !}"
+                , "parallel", &parallel
+                , "lazy", &lazy
+                , "workers", &mixer->startup.workers
+                );
+        if (error) {
+            AFB_ApiError(source->api, "_mixer_new_ startup missing 'parallel|lazy|workers' error=%s startup=%s", wrap_json_get_error_string(error), json_object_get_string(startupJ));
+            goto OnErrorExit;
+        }
+        mixer->startup.parallel = parallel;
+        mixer->startup.lazy = lazy;
+    }
+
+    if (eventsJ) {
+        error = wrap_json_unpack(eventsJ, "{s?i !}", "max_rate", &mixer->events.maxRate);
+        if (error || mixer->events.maxRate < 0) {
+            AFB_ApiError(source->api, "_mixer_new_ events expect {'max_rate': per second} events=%s", json_object_get_string(eventsJ));
+            goto OnErrorExit;
+        }
+    }
+
+    if (!mixing || !strcasecmp(mixing, "dmix")) mixer->mixing = MIXING_DMIX;
+    else if (!strcasecmp(mixing, "native")) mixer->mixing = MIXING_NATIVE;
+    else {
+        AFB_ApiError(source->api, "_mixer_new_ invalid mixing=%s (dmix|native)", mixing);
+        goto OnErrorExit;
+    }
+
+    // native mixing has no softvol plugin in its path, volume is always native
+    if (!volume) mixer->volume = (mixer->mixing == MIXING_NATIVE) ? VOLUME_NATIVE : VOLUME_SOFTVOL;
+    else if (!strcasecmp(volume, "native")) mixer->volume = VOLUME_NATIVE;
+    else if (!strcasecmp(volume, "softvol") && mixer->mixing != MIXING_NATIVE) mixer->volume = VOLUME_SOFTVOL;
+    else {
+        AFB_ApiError(source->api, "_mixer_new_ invalid volume=%s (softvol|native, native only with native mixing)", volume);
         goto OnErrorExit;
     }
 
@@ -807,6 +1059,12 @@ CTLP_CAPI(MixerCreate, source, argsJ, responseJ) {
     error = LoadStaticVerbs(mixer, CtrlApiVerbs);
     if (error) goto OnErrorExit;
 
+    error = AlsaLogStart(mixer);
+    if (error) goto OnErrorExit;
+
+    error = AlsaPcmCopyPoolInit(mixer);
+    if (error) goto OnErrorExit;
+
     return 0;
 
 OnErrorExit:
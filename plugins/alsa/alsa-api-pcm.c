@@ -25,6 +25,10 @@
 #define CONVERT_RANGE(val, min, max) ceil((val) * ((max) - (min)) * 0.01 + (min))
 #define CONVERT_VOLUME(val, min, max) (int) CONVERT_RANGE ((double)val, (double)min, (double)max)
 
+// stream latency params bounds
+#define PCM_MAX_LATENCY_MS 10000
+#define PCM_MAX_PERIODS    64
+
 // move from volume to percentage (extract from alsa-utils)
 
 STATIC int CONVERT_PERCENT(long val, long min, long max) {
@@ -142,38 +146,29 @@ STATIC int PcmAttachOneCtl(SoftMixerT *mixer, AlsaSndCtlT *sndcard, json_object
         goto OnErrorExit;
     }
 
-    free(elemId);
-
     return 0;
 
 OnErrorExit:
-    if (elemId)free(elemId);
     return -1;
 }
 
 STATIC int PcmSetControl(SoftMixerT *mixer, AlsaSndCtlT *sndcard, AlsaSndControlT *control, volumeT volType, int *newvol, int *oldval) {
     snd_ctl_elem_id_t* elemId = NULL;
-    snd_ctl_elem_info_t *elemInfo;
+    AlsaCtlElemT *elem;
     int error, value = 0;
     long curval;
 
     assert(control->numid);
 
-    elemId = AlsaCtlGetNumidElemId(mixer, sndcard, control->numid);
-    if (!elemId) {
+    // element id and info both come from the card control cache
+    elem = AlsaCtlGetNumidElem(mixer, sndcard, control->numid);
+    if (!elem) {
         AFB_ApiError(mixer->api, "PcmSetControl sndard=%s fail to find control numid=%d", sndcard->cid.cardid, control->numid);
         goto OnErrorExit;
     }
+    elemId = elem->id;
 
-    snd_ctl_elem_info_alloca(&elemInfo);
-    snd_ctl_elem_info_set_id(elemInfo, elemId);
-
-    if (snd_ctl_elem_info(sndcard->ctl, elemInfo) < 0) {
-        AFB_ApiError(mixer->api, "PcmSetControl: sndard=%s numid=%d name='%s' not loadable", sndcard->cid.cardid, control->numid, control->name);
-        goto OnErrorExit;
-    }
-
-    if (!snd_ctl_elem_info_is_writable(elemInfo)) {
+    if (!elem->writable) {
         AFB_ApiError(mixer->api, "PcmSetControl: sndard=%s numid=%d name='%s' not writable", sndcard->cid.cardid, control->numid, control->name);
         goto OnErrorExit;
     }
@@ -184,7 +179,7 @@ STATIC int PcmSetControl(SoftMixerT *mixer, AlsaSndCtlT *sndcard, AlsaSndControl
         goto OnErrorExit;
     }
 
-    switch (snd_ctl_elem_info_get_type(elemInfo)) {
+    switch (elem->type) {
 
         case SND_CTL_ELEM_TYPE_BOOLEAN:
             error = CtlElemIdSetLong(mixer, sndcard, elemId, *newvol);
@@ -212,7 +207,7 @@ STATIC int PcmSetControl(SoftMixerT *mixer, AlsaSndCtlT *sndcard, AlsaSndControl
             break;
 
         default:
-            AFB_ApiError(mixer->api, "PcmSetControl: sndard=%s numid=%d name='%s' invalid/unsupported type=%d", sndcard->cid.cardid, control->numid, control->name, snd_ctl_elem_info_get_type(elemInfo));
+            AFB_ApiError(mixer->api, "PcmSetControl: sndard=%s numid=%d name='%s' invalid/unsupported type=%d", sndcard->cid.cardid, control->numid, control->name, elem->type);
             goto OnErrorExit;
     }
 
@@ -223,11 +218,9 @@ STATIC int PcmSetControl(SoftMixerT *mixer, AlsaSndCtlT *sndcard, AlsaSndControl
 
     *oldval = CONVERT_PERCENT(curval, control->min, control->max);
     *newvol = value;
-    free(elemId);
     return 0;
 
 OnErrorExit:
-    if (elemId)free(elemId);
     return -1;
 }
 
@@ -357,16 +350,41 @@ PUBLIC AlsaPcmHwInfoT * ApiPcmSetParams(SoftMixerT *mixer, const char *uid, json
     params->sampleSize = 0;
 
     if (paramsJ) {
+        // latency fields are unsigned or wider than int, unpack as int (-1 when absent) then check ranges
+        int latencyMs = -1, periods = -1, periodFrames = -1;
         int error =
-        	wrap_json_unpack(paramsJ, "{s?i,s?i, s?s, s?s !}",
+        	wrap_json_unpack(paramsJ, "{s?i,s?i, s?s, s?s, s?i,s?i,s?i !}",
         		             "rate",    &params->rate,
 				             "channels",&params->channels,
 				             "format",  &format,
-				             "access",  &access);
+				             "access",  &access,
+				             "latency_ms", &latencyMs,
+				             "periods", &periods,
+				             "period_frames", &periodFrames);
         if (error) {
             AFB_ApiError(mixer->api, "ApiPcmSetParams: sndcard=%s invalid params=%s", uid, json_object_get_string(paramsJ));
             goto OnErrorExit;
         }
+
+        if (latencyMs != -1 && (latencyMs <= 0 || latencyMs > PCM_MAX_LATENCY_MS)) {
+            AFB_ApiError(mixer->api, "ApiPcmSetParams: sndcard=%s latency_ms should be within ]0,%d] params=%s", uid, PCM_MAX_LATENCY_MS, json_object_get_string(paramsJ));
+            goto OnErrorExit;
+        }
+
+        // alsa refuses a single period buffer
+        if (periods != -1 && (periods < 2 || periods > PCM_MAX_PERIODS)) {
+            AFB_ApiError(mixer->api, "ApiPcmSetParams: sndcard=%s periods should be within [2,%d] params=%s", uid, PCM_MAX_PERIODS, json_object_get_string(paramsJ));
+            goto OnErrorExit;
+        }
+
+        if (periodFrames != -1 && periodFrames <= 0) {
+            AFB_ApiError(mixer->api, "ApiPcmSetParams: sndcard=%s period_frames should be > 0 params=%s", uid, json_object_get_string(paramsJ));
+            goto OnErrorExit;
+        }
+
+        if (latencyMs != -1) params->latency_ms = (unsigned int) latencyMs;
+        if (periods != -1) params->periods = (unsigned int) periods;
+        if (periodFrames != -1) params->period_frames = (snd_pcm_uframes_t) periodFrames;
     }
 
     if (!format) {
@@ -387,6 +405,7 @@ PUBLIC AlsaPcmHwInfoT * ApiPcmSetParams(SoftMixerT *mixer, const char *uid, json
     FORMAT_CHECK(U32_LE);
     FORMAT_CHECK(S24_BE);
     FORMAT_CHECK(S24_LE);
+    FORMAT_CHECK(S24_3LE);
     FORMAT_CHECK(U24_BE);
     FORMAT_CHECK(U24_LE);
     FORMAT_CHECK(S8);
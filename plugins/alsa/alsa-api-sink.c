@@ -78,6 +78,10 @@ PUBLIC int ApiSinkAttach(SoftMixerT *mixer, AFB_ReqT request, const char *uid, j
                 goto OnErrorExit;
             }
 
+            // native mixing opens the sink directly from its mix thread
+            if (mixer->mixing == MIXING_NATIVE)
+                break;
+
             // move from hardware to DMIX attach to sndcard
             if (asprintf(&dmixUid, "dmix-%s", mixer->sinks[index]->uid) == -1)
                 goto OnErrorExit;
@@ -104,6 +108,12 @@ PUBLIC int ApiSinkAttach(SoftMixerT *mixer, AFB_ReqT request, const char *uid, j
                     AFB_ReqFailF(request, "bad-pcm", "mixer=%s invalid sink= %s", mixer->uid, json_object_get_string(sinkJ));
                     goto OnErrorExit;
                 }
+                mixer->sinks[index + idx] = pcm;
+
+                // native mixing opens the sink directly from its mix thread
+                if (mixer->mixing == MIXING_NATIVE)
+                    continue;
+
                 // move from hardware to DMIX attach to sndcard
                 if (asprintf(&dmixUid, "dmix-%s", pcm->uid) == -1)
                     goto OnErrorExit;
@@ -113,7 +123,6 @@ PUBLIC int ApiSinkAttach(SoftMixerT *mixer, AFB_ReqT request, const char *uid, j
                     AFB_ReqFailF(request, "internal-error", "mixer=%s sink=%s fail to create DMIX config", mixer->uid, pcm->uid);
                     goto OnErrorExit;
                 }
-                mixer->sinks[index + idx] = pcm;
             }
             break;
         default:
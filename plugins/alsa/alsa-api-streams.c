@@ -24,6 +24,9 @@
 #include <string.h>
 #include <stdbool.h>
 #include <dlfcn.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
 
 // Set stream volume control in %
 #define VOL_CONTROL_MAX  100
@@ -69,8 +72,19 @@ STATIC void StreamApiVerbCB(AFB_ReqT request) {
     if (verbose) responseJ = json_object_new_object();
 
     if (doClose) {
-        AFB_ReqFailF(request, "internal-error", "(Fulup) Close action still to be done mixer=%s stream=%s", mixer->uid, handle->stream->uid);
-        goto OnErrorExit;
+        const char *uid = strdup(handle->stream->uid);
+
+        // stream, its verb and this handle are released
+        error = ApiStreamRemove(mixer, handle->stream);
+        if (error) {
+            AFB_ReqFailF(request, "internal-error", "Fail to close mixer=%s stream=%s", mixer->uid, uid);
+            free((char*) uid);
+            goto OnErrorExit;
+        }
+        json_object_put(responseJ);
+        AFB_ReqSuccess(request, NULL, uid);
+        free((char*) uid);
+        return;
     }
 
     if (doToggle) {
@@ -174,7 +188,8 @@ STATIC void StreamApiVerbCB(AFB_ReqT request) {
             AFB_ReqFailF(request, "StreamApiVerbCB", "Fail to get stream numids volume=%ld mute=%ld", volume, mute);
             goto OnErrorExit;
         }
-        wrap_json_pack(&responseJ, "{si,sb}", "volume", volume, "mute", !mute);
+        wrap_json_pack(&responseJ, "{si,sb,so*}", "volume", volume, "mute", !mute
+                , "stats", handle->stream->copy ? AlsaStatsJson(handle->stream->copy) : NULL);
     }
 
     AFB_ReqSuccess(request, responseJ, NULL);
@@ -184,17 +199,385 @@ OnErrorExit:
     return;
 }
 
-STATIC int CreateOneStream(SoftMixerT *mixer, const char * uid, AlsaStreamAudioT * stream) {
+// native mixing: resolve the sink and the stream channel to sink channel route (or the zone matrix),
+// the copy ring is attached to the sink mix thread at start
+STATIC int RouteNativeStream(SoftMixerT *mixer, AlsaStreamAudioT *stream, AlsaSndZoneT *zone, AlsaSndPcmT *playback) {
+    AlsaSndPcmT *sink = playback;
+    int *route = NULL;
+    int error;
+
+    // zone streams go through the zone matrix, whose channels may sit on sinks linked by a multi-card zone
+    if (!playback) {
+        sink = zone->cards ? zone->cards[0] : NULL;
+        if (!sink) {
+            AFB_ApiError(mixer->api, "%s: stream=%s fail to find sink for zone=%s", __func__, stream->uid, zone->uid);
+            goto OnErrorExit;
+        }
+    }
+
+    // no rate converter in native mode, formats are converted by the mix thread
+    if (sink->sndcard->params->rate != stream->params->rate || !AlsaConvertSupported(stream->params->format)) {
+        AFB_ApiError(mixer->api, "%s: stream=%s [%d,%s] should match sink=%s rate=%d with a S16_LE|S24_LE|S24_3LE|S32_LE|FLOAT_LE format",
+                     __func__, stream->uid, stream->params->rate, stream->params->formatS,
+                     sink->uid, sink->sndcard->params->rate);
+        goto OnErrorExit;
+    }
+
+    // sink mix thread and zone matrix are shared by streams, never create them from a parallel start
+    if (!playback) {
+        if (!ApiZoneNativeMatrix(mixer, zone)) goto OnErrorExit;
+        stream->start.zone = zone;
+    } else {
+        error = AlsaMixPrepare(mixer, sink);
+        if (error) goto OnErrorExit;
+
+        route = calloc(stream->params->channels, sizeof (int));
+        for (unsigned int idx = 0; idx < stream->params->channels; idx++)
+            route[idx] = (int) idx;
+    }
+
+    stream->start.sink = sink;
+    stream->start.route = route;
+    return 0;
+
+OnErrorExit:
+    free(route);
+    return -1;
+}
+
+// open playback and start the copy. Streams are set up beforehand on the main loop,
+// this only touches the stream own pcm and copy handle and may run from a startup worker.
+STATIC int StartOneStream(SoftMixerT *mixer, AlsaStreamAudioT *stream) {
+    AlsaPcmCtlT *capturePcm = stream->start.capture;
+    AlsaPcmCtlT *streamPcm = stream->start.playback;
     int error;
+
+    if (mixer->mixing == MIXING_NATIVE) {
+        error = AlsaPcmCopy(mixer, stream, capturePcm, NULL, stream->params);
+        if (error) goto OnErrorExit;
+
+        // nobody would ever read the copy ring: stop the copy as an idle stream does, capture stays open
+        error = AlsaMixAttach(mixer, stream->start.sink, stream->copy, stream->start.route, stream->start.zone);
+        if (error) {
+            AlsaPcmCopyStop(mixer, stream->copy, true);
+            stream->copy = NULL;
+            goto OnErrorExit;
+        }
+
+        stream->start.started = true;
+        return 0;
+    }
+
+    AFB_ApiInfo(mixer->api, "%s: Opening PCM PLAYBACK name %s", __func__, streamPcm->cid.cardid);
+
+    // everything is now ready to open playback pcm in BLOCKING mode this time
+    error = snd_pcm_open(&streamPcm->handle, streamPcm->cid.cardid, SND_PCM_STREAM_PLAYBACK, 0 /* will block*/ );
+    if (error) {
+        AFB_ApiError(mixer->api,
+                     "%s: mixer=%s stream=%s fail to open playback PCM=%s; error=%s",
+                     __func__, mixer->uid, stream->uid, streamPcm->cid.cardid, snd_strerror(error));
+        goto OnErrorExit;
+    }
+
+    // start stream pcm copy (at this both capturePcm & sink pcm should be open, we use output params to configure both in+outPCM)
+    error = AlsaPcmCopy(mixer, stream, capturePcm, streamPcm, stream->params);
+    if (error) {
+        AFB_ApiError(mixer->api, "%s: Failed to launch copy", __func__);
+        // next lazy or idle start opens playback again
+        snd_pcm_close(streamPcm->handle);
+        streamPcm->handle = NULL;
+        goto OnErrorExit;
+    }
+
+    stream->start.started = true;
+    return 0;
+
+OnErrorExit:
+    return -1;
+}
+
+// main loop side, once started: align capture pause state with loop subdev activity
+STATIC void SyncOneStream(SoftMixerT *mixer, AlsaStreamAudioT *stream) {
+    AlsaLoopSubdevT *loopDev = stream->subdev;
     long value;
+    int error;
+
+    // when using loopdev check if subdev is active or not to prevent thread from reading empty packet
+    if (!loopDev || !loopDev->numid) return;
+
+    // retrieve active/pause control and set PCM status accordingly
+    error = AlsaCtlNumidGetLong(mixer, stream->sndcard, loopDev->numid, &value);
+    if (error) return;
+
+    // toggle pause/resume (should be done after pcm_start)
+    if ((error = snd_pcm_pause(stream->start.capture->handle, !value)) < 0) {
+        AFB_ApiWarning(mixer->api, "%s: mixer=%s stream=%s fail to pause error=%s", __func__, mixer->uid, stream->uid, snd_strerror(error));
+    }
+}
+
+// loop subdev stayed inactive for mixer->idleMs: park copy threads, close playback chain and drop the ring
+STATIC int StreamIdleTimerCB(sd_event_source* source, uint64_t timer, void* context) {
+    AlsaStreamAudioT *stream = (AlsaStreamAudioT*) context;
+    SoftMixerT *mixer = (SoftMixerT*) stream->start.capture->mixer;
+
+    sd_event_source_unref(source);
+    stream->idle = NULL;
+    if (!stream->copy) return 0;
+
+    AlsaPcmCopyStop(mixer, stream->copy, true);
+    stream->copy = NULL;
+    stream->start.started = false;
+
+    AFB_ApiNotice(mixer->api, "%s: mixer=%s stream=%s idle", __func__, mixer->uid, stream->uid);
+    return 0;
+}
+
+// loop subdev run control changed (ctl event, main loop): start a lazy or idle stream, arm idle timer on inactivity
+PUBLIC int ApiStreamActivity(SoftMixerT *mixer, AlsaStreamAudioT *stream, bool active) {
+    uint64_t usec;
+    long value;
+
+    if (!active) {
+        if (mixer->idleMs > 0 && stream->start.started && !stream->idle) {
+            sd_event_now(mixer->sdLoop, CLOCK_MONOTONIC, &usec);
+            (void) sd_event_add_time(mixer->sdLoop, &stream->idle, CLOCK_MONOTONIC, usec + (uint64_t) mixer->idleMs * 1000, 10000, StreamIdleTimerCB, stream);
+        }
+        return 0;
+    }
+
+    if (stream->idle) {
+        sd_event_source_unref(stream->idle);
+        stream->idle = NULL;
+    }
+    if (stream->start.started) return 0;
+
+    // volume may have changed while waiting, native gain starts from current ctl value
+    if (mixer->volume == VOLUME_NATIVE && !AlsaCtlNumidGetLong(mixer, stream->sndcard, stream->volume, &value))
+        stream->start.volume = value;
+
+    int error = StartOneStream(mixer, stream);
+    if (error) {
+        AFB_ApiError(mixer->api, "%s: mixer=%s stream=%s start failed", __func__, mixer->uid, stream->uid);
+        return -1;
+    }
+
+    AFB_ApiNotice(mixer->api, "%s: mixer=%s stream=%s started", __func__, mixer->uid, stream->uid);
+    return 0;
+}
+
+typedef struct {
+    SoftMixerT *mixer;
+    AlsaStreamAudioT **streams;
+    int count;
+    atomic_int next;
+} StartBatchT;
+
+STATIC void *StartBatchThread(void *context) {
+    StartBatchT *batch = (StartBatchT*) context;
+
+    for (int idx = atomic_fetch_add(&batch->next, 1); idx < batch->count; idx = atomic_fetch_add(&batch->next, 1))
+        batch->streams[idx]->start.error = StartOneStream(batch->mixer, batch->streams[idx]);
+
+    return NULL;
+}
+
+// start copies of freshly attached streams: lazy ones wait for their loop subdev, others start
+// in attach order or concurrently on startup workers (the calling thread takes its share).
+// Streams failing to start are removed, they would otherwise stay registered but silent.
+STATIC int StartStreams(SoftMixerT *mixer, AlsaStreamAudioT **streams, int count) {
+    StartBatchT batch = {.mixer = mixer, .streams = alloca(count * sizeof (void*)), .count = 0};
+    int error = 0;
+
+    for (int idx = 0; idx < count; idx++) {
+        AlsaStreamAudioT *stream = streams[idx];
+        long value;
+
+        // capture zone streams run as soon as created
+        if (stream->capture) continue;
+
+        if (mixer->startup.lazy && stream->subdev && stream->subdev->numid
+                && !AlsaCtlNumidGetLong(mixer, stream->sndcard, stream->subdev->numid, &value) && !value) {
+            AFB_ApiNotice(mixer->api, "%s: mixer=%s stream=%s waits for loop subdev activity", __func__, mixer->uid, stream->uid);
+            continue;
+        }
+        batch.streams[batch.count++] = stream;
+    }
+    atomic_init(&batch.next, 0);
+
+    int nthreads = 0;
+    if (mixer->startup.parallel && batch.count > 1) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = (mixer->startup.workers > 0) ? mixer->startup.workers : (int) cpus;
+        if (nthreads > batch.count) nthreads = batch.count;
+        nthreads--;
+
+        // shared copy engine is created once, before any concurrent attach
+        if (mixer->engine.mode == COPY_ENGINE_SHARED && AlsaCopyEnginePrepare(mixer)) return -1;
+    }
+
+    pthread_t *threads = alloca((nthreads > 0 ? nthreads : 1) * sizeof (pthread_t));
+    int started;
+    for (started = 0; started < nthreads; started++) {
+        if (pthread_create(&threads[started], NULL, StartBatchThread, &batch)) break;
+    }
+
+    (void) StartBatchThread(&batch);
+    for (int idx = 0; idx < started; idx++)
+        pthread_join(threads[idx], NULL);
+
+    for (int idx = 0; idx < batch.count; idx++) {
+        AlsaStreamAudioT *stream = batch.streams[idx];
+        if (stream->start.error) {
+            AFB_ApiError(mixer->api, "%s: mixer=%s stream=%s fail to start, removed", __func__, mixer->uid, stream->uid);
+            (void) ApiStreamRemove(mixer, stream);
+            error = -1;
+            continue;
+        }
+        SyncOneStream(mixer, stream);
+    }
+
+    return error;
+}
+
+/*
+ * Capture zone stream: the zone source channels are written to the stream loop subdev playback
+ * side, applications record them from its capture side. Hardware sources are opened once and
+ * shared by every capture stream (see alsa-core-capture.c), stream pause and volume controls
+ * only act on this consumer.
+ */
+STATIC int CreateCaptureStream(SoftMixerT *mixer, AlsaStreamAudioT *stream, AlsaSndZoneT *zone) {
+    AlsaDevInfoT *loopDev = alloca(sizeof (AlsaDevInfoT));
+    AlsaSndLoopT *loop = NULL;
+    AlsaLoopSubdevT *subdev;
+    AlsaSndPcmT *source = NULL;
+    AlsaPcmCtlT *loopPcm;
+    char *runName = NULL, *volName = NULL;
+    int channels = 0, pauseNumid, volNumid, error;
+
+    // zone port -> source channel, every zone channel should sit on the same source
+    for (int idx = 0; zone->sources[idx]; idx++) {
+        if (zone->sources[idx]->port >= channels) channels = zone->sources[idx]->port + 1;
+    }
+    int *map = alloca(channels * sizeof (int));
+    for (int idx = 0; idx < channels; idx++) map[idx] = -1;
+
+    for (int idx = 0; zone->sources[idx]; idx++) {
+        AlsaPcmChannelT *channel = zone->sources[idx];
+
+        for (int sdx = 0; mixer->sources[sdx]; sdx++) {
+            for (int cdx = 0; mixer->sources[sdx]->channels && cdx < mixer->sources[sdx]->ccount; cdx++) {
+                if (strcasecmp(mixer->sources[sdx]->channels[cdx]->uid, channel->uid)) continue;
+
+                if (source && source != mixer->sources[sdx]) {
+                    AFB_ApiError(mixer->api, "%s: stream=%s zone=%s cannot span over multiple sources %s != %s",
+                                 __func__, stream->uid, zone->uid, source->uid, mixer->sources[sdx]->uid);
+                    goto OnErrorExit;
+                }
+                source = mixer->sources[sdx];
+                if (channel->port >= 0) map[channel->port] = mixer->sources[sdx]->channels[cdx]->port;
+            }
+        }
+    }
+
+    if (!source) {
+        AFB_ApiError(mixer->api, "%s: stream=%s fail to find source for zone=%s", __func__, stream->uid, zone->uid);
+        goto OnErrorExit;
+    }
+
+    subdev = ApiLoopFindSubdev(mixer, stream->uid, stream->source, &loop);
+    if (!subdev) {
+        AFB_ApiError(mixer->api, "%s: mixer=%s stream=%s no free loop subdev", __func__, mixer->uid, stream->uid);
+        goto OnErrorExit;
+    }
+    stream->subdev = subdev;
+    stream->sndcard = loop->sndcard;
+
+    loopDev->devpath = NULL;
+    loopDev->cardid = NULL;
+    loopDev->cardidx = loop->sndcard->cid.cardidx;
+    loopDev->device = loop->playback;
+    loopDev->subdev = subdev->index;
+    loopDev->pcmplug_params = NULL;
+
+    loopPcm = AlsaByPathOpenPcm(mixer, loopDev, SND_PCM_STREAM_PLAYBACK);
+    if (!loopPcm) goto OnErrorExit;
+    loopPcm->mute = stream->mute;
+    loopPcm->mixer = mixer;
+    stream->start.playback = loopPcm;
+
+    // frames keep source rate and format, volume is applied by the consumer
+    AlsaPcmHwInfoT gainParams = *source->sndcard->params;
+    gainParams.channels = (unsigned int) channels;
+    loopPcm->gain = AlsaGainCreate(mixer, &gainParams, stream->volume);
+    if (!loopPcm->gain) {
+        AFB_ApiWarning(mixer->api, "%s: stream=%s no volume for source format=%s", __func__, stream->uid, gainParams.formatS);
+    }
+
+    stream->capture = AlsaCaptureAttach(mixer, source, map, (unsigned int) channels, loopPcm);
+    if (!stream->capture) goto OnErrorExit;
+    stream->start.started = true;
+
+    stream->params->rate = loopPcm->params->rate;
+    stream->params->format = loopPcm->params->format;
+    stream->params->formatS = loopPcm->params->formatS;
+    stream->params->channels = loopPcm->params->channels;
+    zone->ccount = channels;
+
+    if (asprintf(&runName, "pause-%s", stream->uid) == -1 || asprintf(&volName, "vol-%s", stream->uid) == -1)
+        goto OnErrorExit;
+
+    pauseNumid = AlsaCtlCreateControl(mixer, loop->sndcard, runName, 1, 0, 1, 1, stream->mute);
+    if (pauseNumid <= 0 || AlsaCtlRegister(mixer, loop->sndcard, loopPcm, FONTEND_NUMID_PAUSE, pauseNumid)) {
+        AFB_ApiError(mixer->api, "%s: stream=%s fail to create pause control", __func__, stream->uid);
+        goto OnErrorExit;
+    }
+    stream->mute = pauseNumid;
+
+    volNumid = AlsaCtlCreateControl(mixer, loop->sndcard, volName, channels, VOL_CONTROL_MIN, VOL_CONTROL_MAX, VOL_CONTROL_STEP, stream->volume);
+    if (volNumid <= 0 || AlsaCtlRegister(mixer, loop->sndcard, loopPcm, FONTEND_NUMID_VOLUME, volNumid)) {
+        AFB_ApiError(mixer->api, "%s: stream=%s fail to create volume control", __func__, stream->uid);
+        goto OnErrorExit;
+    }
+    stream->volume = volNumid;
+
+    // applications record from the loop capture side
+    free((char*) stream->source);
+    if (asprintf((char**) &stream->source, "hw:%d,%d,%d", loop->sndcard->cid.cardidx, loop->capture, subdev->index) == -1)
+        goto OnErrorExit;
+
+    apiHandleT *apiHandle = calloc(1, sizeof (apiHandleT));
+    apiHandle->mixer = mixer;
+    apiHandle->stream = stream;
+    apiHandle->sndcard = loop->sndcard;
+    apiHandle->pcm = loopPcm->handle;
+
+    error = afb_api_add_verb(mixer->api, stream->verb, stream->info, StreamApiVerbCB, apiHandle, NULL, 0, 0);
+    if (error) {
+        AFB_ApiError(mixer->api, "%s mixer=%s fail to Register API verb stream=%s", __func__, mixer->uid, stream->uid);
+        goto OnErrorExit;
+    }
+
+    AFB_ApiNotice(mixer->api, "%s: mixer=%s stream=%s source=%s record from %s", __func__, mixer->uid, stream->uid, source->uid, stream->source);
+    free(runName);
+    free(volName);
+    return 0;
+
+OnErrorExit:
+    free(runName);
+    free(volName);
+    return -1;
+}
+
+STATIC int CreateOneStream(SoftMixerT *mixer, const char * uid, AlsaStreamAudioT * stream) {
+    int error;
     AlsaSndLoopT *loop = NULL;
     AlsaPcmCtlT *streamPcm;
     AlsaSndCtlT *captureCard;
     AlsaDevInfoT *captureDev = alloca(sizeof (AlsaDevInfoT));
     AlsaLoopSubdevT *loopDev;
     AlsaSndZoneT *zone;
+    AlsaSndPcmT *playback = NULL;
     char *volSlaveId = NULL;
-    char *playbackName = NULL;
     char *runName = NULL;
     char *volName = NULL;
     int pauseNumid = 0;
@@ -204,7 +587,17 @@ STATIC int CreateOneStream(SoftMixerT *mixer, const char * uid, AlsaStreamAudioT
                 "%s, stream %s %s, source %s, sink %s, mute %d",
                 __func__,uid, stream->uid, stream->source, stream->sink, stream->mute);
 
+    // stream->volume becomes a ctl numid below, keep initial volume for the copy gain
+    stream->start.volume = stream->volume;
+
+    // a zone without sink channels is a capture zone
+    if (mixer->zones[0] && stream->sink) {
+        zone = ApiZoneGetByUid(mixer, stream->sink);
+        if (zone && zone->sources && !zone->sinks) return CreateCaptureStream(mixer, stream, zone);
+    }
+
     loopDev = ApiLoopFindSubdev(mixer, stream->uid, stream->source, &loop);
+    stream->subdev = loopDev;
     if (loopDev) {
         // create a valid PCM reference and try to open it.
         captureDev->devpath = NULL;
@@ -219,6 +612,10 @@ STATIC int CreateOneStream(SoftMixerT *mixer, const char * uid, AlsaStreamAudioT
                     "%s: found loopdev %d,%d",
                     __func__, loop->capture, loopDev->index);
 
+        // a running loop playback imposes its params, fail before building any plugin
+        error = ApiLoopCheckSubdev(mixer, loop, loopDev, stream->params);
+        if (error) goto OnErrorExit;
+
     } else {
         // if capture UID is not present in loop search on sources
         AFB_ApiInfo(mixer->api,"%s: %s not found in loop, look in sources", __func__, uid);
@@ -246,6 +643,10 @@ STATIC int CreateOneStream(SoftMixerT *mixer, const char * uid, AlsaStreamAudioT
     if (!capturePcm) goto OnErrorExit;
 
     capturePcm->mute = stream->mute;
+    stream->sndcard = captureCard;
+    stream->start.capture = capturePcm;
+    capturePcm->stream = stream;
+    capturePcm->mixer = mixer;
 
     AFB_ApiInfo(mixer->api,"%s: PCM opened !", __func__);
 
@@ -270,7 +671,7 @@ STATIC int CreateOneStream(SoftMixerT *mixer, const char * uid, AlsaStreamAudioT
             goto OnErrorExit;
 
     } else {
-        AlsaSndPcmT *playback = ApiSinkGetByUid(mixer, stream->sink);
+        playback = ApiSinkGetByUid(mixer, stream->sink);
         if (!playback) {
             AFB_ApiError(mixer->api,
                          "%s: mixer=%s stream=%s fail to find sink playback='%s'",
@@ -317,6 +718,33 @@ STATIC int CreateOneStream(SoftMixerT *mixer, const char * uid, AlsaStreamAudioT
     if (asprintf(&volName, "vol-%s", stream->uid) == -1)
         goto OnErrorExit;
 
+    if (mixer->volume == VOLUME_NATIVE) {
+        // volume is applied by the copy thread, the ctl only carries the requested value
+        volNumid = AlsaCtlCreateControl(mixer, captureCard, volName, stream->params->channels,
+                                        VOL_CONTROL_MIN, VOL_CONTROL_MAX, VOL_CONTROL_STEP, stream->volume);
+        if (volNumid <= 0) {
+            AFB_ApiError(mixer->api, "%s failed add volume control on capture card", __func__);
+            goto OnErrorExit;
+        }
+    }
+
+    if (mixer->mixing == MIXING_NATIVE) {
+        error = RouteNativeStream(mixer, stream, mixer->zones[0] ? zone : NULL, playback);
+        if (error) {
+            AFB_ApiError(mixer->api, "%s: Failed to attach native stream", __func__);
+            goto OnErrorExit;
+        }
+        goto OnStartReady;
+    }
+
+    if (mixer->volume == VOLUME_NATIVE) {
+        // no softvol, stream pcm directly targets the zone route (or sink dmix)
+        streamPcm = calloc(1, sizeof (AlsaPcmCtlT));
+        streamPcm->cid.cardid = (const char*) volSlaveId;
+        volSlaveId = NULL;
+        goto OnVolumeReady;
+    }
+
     AFB_ApiInfo(mixer->api,"%s: create softvol", __func__);
 
     // create stream and delay pcm opening until vol control is created
@@ -326,6 +754,8 @@ STATIC int CreateOneStream(SoftMixerT *mixer, const char * uid, AlsaStreamAudioT
         goto OnErrorExit;
     }
 
+    stream->plugs[0] = strdup(streamPcm->cid.cardid);
+
     AFB_ApiInfo(mixer->api,"%s: create softvol control", __func__);
 
     // create volume control before softvol pcm is opened
@@ -342,6 +772,7 @@ STATIC int CreateOneStream(SoftMixerT *mixer, const char * uid, AlsaStreamAudioT
         goto OnErrorExit;
     }
 
+OnVolumeReady:
     if ((zone->params->rate   != stream->params->rate) ||
         (zone->params->format != stream->params->format)) {
         AFB_ApiNotice(mixer->api,
@@ -358,52 +789,26 @@ STATIC int CreateOneStream(SoftMixerT *mixer, const char * uid, AlsaStreamAudioT
         if (asprintf(&rateName, "rate-%s", stream->uid) == -1)
             goto OnErrorExit;
         streamPcm = AlsaCreateRate(mixer, rateName, streamPcm, zone->params, 0);
+        stream->plugs[1] = strdup(rateName);
         if (!streamPcm) {
             AFB_ApiError(mixer->api, "%s: fail to create rate converter", __func__);
             goto OnErrorExit;
         }
-        playbackName = rateName;
     } else {
         AFB_ApiNotice(mixer->api, "%s: no need for a converter", __func__);
-        playbackName = (char*) streamPcm->cid.cardid;
     }
 
-    AFB_ApiInfo(mixer->api, "%s: Opening PCM PLAYBACK name %s", __func__, playbackName);
+    // playback is opened and copy started later by StartOneStream
+    stream->start.playback = streamPcm;
 
-    // everything is now ready to open playback pcm in BLOCKING mode this time
-    error = snd_pcm_open(&streamPcm->handle, playbackName, SND_PCM_STREAM_PLAYBACK, 0 /* will block*/ );
-    if (error) {
-        AFB_ApiError(mixer->api,
-                     "%s: mixer=%s stream=%s fail to open playback PCM=%s; error=%s",
-                     __func__, mixer->uid, stream->uid, streamPcm->cid.cardid, snd_strerror(error));
-        goto OnErrorExit;
-    }
-
-    // start stream pcm copy (at this both capturePcm & sink pcm should be open, we use output params to configure both in+outPCM)
-    error = AlsaPcmCopy(mixer, stream, capturePcm, streamPcm, stream->params);
-    if (error) {
-        AFB_ApiError(mixer->api, "%s: Failed to launch copy", __func__);
-        goto OnErrorExit;
-    }
-
-    error = AlsaCtlRegister(mixer, captureCard, capturePcm, FONTEND_NUMID_IGNORE, volNumid);
+OnStartReady:
+    // volume changes are pushed to subscribers, with native volume they also drive the copy gain stage
+    error = AlsaCtlRegister(mixer, captureCard, capturePcm, FONTEND_NUMID_VOLUME, volNumid);
     if (error) {
         AFB_ApiError(mixer->api, "%s: register control on capture", __func__);
         goto OnErrorExit;
     }
 
-    // when using loopdev check if subdev is active or not to prevent thread from reading empty packet
-    if (loopDev && loopDev->numid) {
-        // retrieve active/pause control and set PCM status accordingly 
-        error = AlsaCtlNumidGetLong(mixer, captureCard, loopDev->numid, &value);
-        if (error) goto OnErrorExit;
-
-        // toggle pause/resume (should be done after pcm_start)
-        if ((error = snd_pcm_pause(capturePcm->handle, !value)) < 0) {
-            AFB_ApiWarning(mixer->api, "CreateOneStream: mixer=%s [capturePcm=%s] fail to pause error=%s", mixer->uid, captureDev->cardid, snd_strerror(error));
-        }
-    }
-
     if (loop) {
         if (asprintf((char**) &stream->source, "hw:%d,%d,%d", captureDev->cardidx, loop->playback, capturePcm->cid.subdev) == -1)
             goto OnErrorExit;
@@ -449,6 +854,95 @@ OnErrorExit:
     return -1;
 }
 
+/*
+ * Stream teardown: the reverse of CreateOneStream. The verb goes first so that
+ * no request may reach the stream anymore, then its ctl registrations, copy
+ * (threads park back in the pool), controls and alsa-lib plugin configs. A loop
+ * subdev allocated to the stream is given back for the next one.
+ */
+PUBLIC int ApiStreamRemove(SoftMixerT *mixer, AlsaStreamAudioT *stream) {
+    AlsaPcmCopyHandleT *copy = stream->copy;
+    void *vcbdata = NULL;
+    int index;
+
+    for (index = 0; mixer->streams[index]; index++) {
+        if (mixer->streams[index] == stream) break;
+    }
+    if (!mixer->streams[index]) {
+        AFB_ApiError(mixer->api, "%s: mixer=%s stream=%s not found", __func__, mixer->uid, stream->uid);
+        goto OnErrorExit;
+    }
+
+    AFB_ApiNotice(mixer->api, "%s: mixer=%s stream=%s closing", __func__, mixer->uid, stream->uid);
+
+    int error = afb_api_del_verb(mixer->api, stream->verb, &vcbdata);
+    if (error) {
+        AFB_ApiWarning(mixer->api, "%s: mixer=%s fail to remove verb=%s", __func__, mixer->uid, stream->verb);
+    }
+    free(vcbdata);
+
+    if (stream->idle) sd_event_source_unref(stream->idle);
+
+    // a lazy or idle stream has no running copy
+    AlsaPcmCtlT *pcmIn = stream->start.capture, *pcmOut = stream->start.playback;
+    if (pcmIn && stream->sndcard) AlsaCtlUnregister(mixer, stream->sndcard, pcmIn);
+
+    // capture zone stream: consumer first, then its loop playback pcm
+    if (stream->capture) {
+        AlsaCtlUnregister(mixer, stream->sndcard, pcmOut);
+        AlsaCaptureDetach(mixer, stream->capture);
+        stream->capture = NULL;
+        snd_pcm_close(pcmOut->handle);
+        AlsaGainFree(pcmOut->gain);
+    }
+    if (copy) {
+        AlsaPcmCopyStop(mixer, copy, false);
+        stream->copy = NULL;
+    } else if (pcmIn) {
+        snd_pcm_close(pcmIn->handle);
+    }
+
+    if (pcmIn) {
+        free(pcmIn->params);
+        free(pcmIn);
+    }
+    if (pcmOut) {
+        free(pcmOut->params);
+        free((char*) pcmOut->cid.cardid);
+        free(pcmOut);
+    }
+    free(stream->start.route);
+
+    // once pcm are closed, stream controls and plugin configs may go
+    if (stream->sndcard) {
+        if (stream->mute > 0) AlsaCtlRemoveControl(mixer, stream->sndcard, stream->mute);
+        if (stream->volume > 0) AlsaCtlRemoveControl(mixer, stream->sndcard, stream->volume);
+    }
+
+    for (int idx = 0; idx < 2; idx++) {
+        AlsaPcmConfigRemove(mixer, stream->plugs[idx]);
+        free((char*) stream->plugs[idx]);
+    }
+
+    if (stream->subdev && stream->subdev->uid == stream->uid)
+        stream->subdev->uid = NULL;
+
+    // keep mixer streams packed, ApiStreamAttach allocates the first free entry
+    for (; mixer->streams[index]; index++)
+        mixer->streams[index] = mixer->streams[index + 1];
+
+    free((char*) stream->uid);
+    free((char*) stream->verb);
+    free((char*) stream->sink);
+    free((char*) stream->source);
+    free(stream->params);
+    free(stream);
+    return 0;
+
+OnErrorExit:
+    return -1;
+}
+
 STATIC AlsaStreamAudioT * AttachOneStream(SoftMixerT *mixer, const char *uid, const char *prefix, json_object * streamJ) {
     AlsaStreamAudioT *stream = calloc(1, sizeof (AlsaStreamAudioT));
     int error;
@@ -459,7 +953,7 @@ STATIC AlsaStreamAudioT * AttachOneStream(SoftMixerT *mixer, const char *uid, co
     stream->mute = 0;
     stream->info = NULL;
 
-    error = wrap_json_unpack(streamJ, "{ss,s?s,s?s,ss,s?s,s?i,s?b,s?o,s?s !}"
+    error = wrap_json_unpack(streamJ, "{ss,s?s,s?s,ss,s?s,s?i,s?b,s?o,s?s,s?b !}"
             , "uid", &stream->uid
             , "verb", &stream->verb
             , "info", &stream->info
@@ -469,11 +963,12 @@ STATIC AlsaStreamAudioT * AttachOneStream(SoftMixerT *mixer, const char *uid, co
             , "mute", &stream->mute
             , "params", &paramsJ
             , "ramp", &stream->ramp
+            , "drift", &stream->drift
             );
 
     if (error) {
         AFB_ApiNotice(mixer->api,
-                       "%s: hal=%s missing 'uid|[info]|zone|source||[volume]|[mute]|[params]' error=%s stream=%s",
+                       "%s: hal=%s missing 'uid|[info]|zone|source||[volume]|[mute]|[params]|[ramp]|[drift]' error=%s stream=%s",
                        __func__, uid, wrap_json_get_error_string(error), json_object_get_string(streamJ));
         goto OnErrorExit;
     }
@@ -540,8 +1035,8 @@ PUBLIC int ApiStreamAttach(SoftMixerT *mixer, AFB_ReqT request, const char *uid,
         goto OnErrorExit;
     }
 
+    long count = 1;
     switch (json_object_get_type(argsJ)) {
-        long count;
 
         case json_type_object:
             mixer->streams[index] = AttachOneStream(mixer, uid, prefix, argsJ);
@@ -569,6 +1064,10 @@ PUBLIC int ApiStreamAttach(SoftMixerT *mixer, AFB_ReqT request, const char *uid,
                                  "bad-stream",
                                  "%s: mixer=%s invalid stream= %s",
                                  __func__, mixer->uid, json_object_get_string(streamJ));
+
+                    // all or nothing: streams of this array created so far would never be started
+                    for (int rdx = 0; rdx < idx; rdx++)
+                        (void) ApiStreamRemove(mixer, mixer->streams[index]);
                     goto OnErrorExit;
                 }
             }
@@ -580,6 +1079,13 @@ PUBLIC int ApiStreamAttach(SoftMixerT *mixer, AFB_ReqT request, const char *uid,
             goto OnErrorExit;
     }
 
+    // streams are set up, now open their playback and start copies
+    int error = StartStreams(mixer, &mixer->streams[index], (int) count);
+    if (error) {
+        AFB_ReqFailF(request, "start-fail", "mixer=%s fail to start streams (failing ones removed)", mixer->uid);
+        goto OnErrorExit;
+    }
+
     return 0;
 
 OnErrorExit:
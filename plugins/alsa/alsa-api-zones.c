@@ -57,16 +57,17 @@ OnErrorExit:
 
 STATIC AlsaSndZoneT *AttacheOneZone(SoftMixerT *mixer, const char *uid, json_object *zoneJ) {
     AlsaSndZoneT *zone = calloc(1, sizeof (AlsaSndZoneT));
-    json_object *sinkJ = NULL, *sourceJ = NULL;
+    json_object *sinkJ = NULL, *sourceJ = NULL, *duckJ = NULL;
     size_t count;
     int error;
 
-    error = wrap_json_unpack(zoneJ, "{ss,s?o,s?o !}"
+    error = wrap_json_unpack(zoneJ, "{ss,s?o,s?o,s?o !}"
             , "uid", &zone->uid
             , "sink", &sinkJ
             , "source", &sourceJ
+            , "ducking", &duckJ
             );
-    if (error || (!sinkJ && sourceJ)) {
+    if (error || (!sinkJ && !sourceJ)) {
         AFB_ApiNotice(mixer->api, "AttacheOneZone missing 'uid|sink|source' error=%s zone=%s", wrap_json_get_error_string(error), json_object_get_string(zoneJ));
         goto OnErrorExit;
     }
@@ -121,12 +122,114 @@ STATIC AlsaSndZoneT *AttacheOneZone(SoftMixerT *mixer, const char *uid, json_obj
         }
     }
 
+    // ducking rules are evaluated by sink mix threads, the dmix path has no place to run them
+    if (duckJ) {
+        if (mixer->mixing != MIXING_NATIVE) {
+            AFB_ApiWarning(mixer->api, "AttacheOneZone: Mixer=%s zone=%s ducking ignored, requires native mixing", mixer->uid, zone->uid);
+        } else {
+            zone->duck = AlsaDuckCreate(mixer, zone->uid, duckJ);
+            if (!zone->duck) goto OnErrorExit;
+        }
+    }
+
     return zone;
 
 OnErrorExit:
     return NULL;
 }
 
+// route config, plus in native mode the shared mix of a zone spanning several sound cards.
+// Capture only zones have no route, their streams read sources through the capture fan-out.
+STATIC int CreateZoneRoute(SoftMixerT *mixer, const char *uid, AlsaSndZoneT *zone) {
+    if (!zone->sinks) return 0;
+
+    AlsaPcmCtlT *routeConfig = AlsaCreateRoute(mixer, zone, 0);
+    if (!routeConfig) {
+        AFB_ApiError(mixer->api,
+                     "%s: Mixer=%s Hal=%s zone=%s Fail to attach PCM Route",
+                     __func__, mixer->uid, uid, zone->uid);
+        goto OnErrorExit;
+    }
+
+    if (mixer->mixing == MIXING_NATIVE && zone->cards && zone->cards[1]) {
+        int error = AlsaMixLink(mixer, zone->cards);
+        if (error) {
+            AFB_ApiError(mixer->api, "%s: Mixer=%s Hal=%s zone=%s Fail to link sound cards", __func__, mixer->uid, uid, zone->uid);
+            goto OnErrorExit;
+        }
+    }
+
+    return 0;
+
+OnErrorExit:
+    return -1;
+}
+
+// native mixing: zone matrix, built when first needed from the zone channels (zone port -> mix channel
+// of its card, at unity gain). Its outputs are the channels of the mix shared by every card of the zone,
+// known without creating the mix: reading the matrix should not start a sink mix thread.
+PUBLIC AlsaMatrixT *ApiZoneNativeMatrix(SoftMixerT *mixer, AlsaSndZoneT *zone) {
+    AlsaSndPcmT *sink = zone->cards ? zone->cards[0] : NULL;
+    float *gains = NULL;
+
+    if (zone->matrix) return zone->matrix;
+
+    if (!sink) {
+        AFB_ApiError(mixer->api, "%s: mixer=%s zone=%s has no native sink", __func__, mixer->uid, zone->uid);
+        goto OnErrorExit;
+    }
+
+    // linked sinks share a mix created at zone attach, a single sink mix has the sink channels
+    unsigned int inputs = (unsigned int) zone->ccount, outputs = sink->mix ? AlsaMixChannels(sink) : (unsigned int) sink->ccount;
+    gains = AlsaMatrixGains(NULL, inputs, outputs);
+
+    for (int idx = 0; zone->sinks[idx]; idx++) {
+        AlsaPcmChannelT *channel = zone->sinks[idx];
+        if (channel->port < 0 || channel->port >= (int) inputs) continue;
+
+        for (int sdx = 0; mixer->sinks[sdx]; sdx++) {
+            for (int cdx = 0; cdx < mixer->sinks[sdx]->ccount; cdx++) {
+                if (strcasecmp(mixer->sinks[sdx]->channels[cdx]->uid, channel->uid)) continue;
+
+                if (mixer->sinks[sdx] != sink && (!sink->mix || mixer->sinks[sdx]->mix != sink->mix)) {
+                    AFB_ApiError(mixer->api, "%s: zone=%s cannot span over multiple sinks %s != %s",
+                                 __func__, zone->uid, sink->uid, mixer->sinks[sdx]->uid);
+                    goto OnErrorExit;
+                }
+                int out = AlsaMixSinkOffset(mixer->sinks[sdx]) + mixer->sinks[sdx]->channels[cdx]->port;
+                if (out >= 0 && out < (int) outputs) gains[channel->port * outputs + out] = 1.0f;
+            }
+        }
+    }
+
+    zone->matrix = AlsaMatrixCreate(inputs, outputs, gains);
+    free(gains);
+
+    AFB_ApiNotice(mixer->api, "%s: zone=%s matrix=%dx%d kernel=%s", __func__, zone->uid, inputs, outputs, AlsaMatrixKernel(zone->matrix));
+    return zone->matrix;
+
+OnErrorExit:
+    free(gains);
+    return NULL;
+}
+
+// replace the zone matrix: streams of the zone switch to the new one on the next period
+PUBLIC int ApiZoneSetMatrix(SoftMixerT *mixer, AlsaSndZoneT *zone, const float *gains) {
+    AlsaMatrixT *previous = ApiZoneNativeMatrix(mixer, zone);
+    if (!previous) goto OnErrorExit;
+
+    AlsaMatrixT *matrix = AlsaMatrixCreate(AlsaMatrixInputs(previous), AlsaMatrixOutputs(previous), gains);
+    AlsaMixSetMatrix(zone->cards[0], previous, matrix);
+    zone->matrix = matrix;
+    AlsaMatrixFree(previous);
+
+    AFB_ApiNotice(mixer->api, "%s: zone=%s kernel=%s", __func__, zone->uid, AlsaMatrixKernel(matrix));
+    return 0;
+
+OnErrorExit:
+    return -1;
+}
+
 PUBLIC int ApiZoneAttach(SoftMixerT *mixer, AFB_ReqT request, const char *uid, json_object * argsJ) {
 
     int index;
@@ -152,13 +255,7 @@ PUBLIC int ApiZoneAttach(SoftMixerT *mixer, AFB_ReqT request, const char *uid, j
 
             // must be set now; AlsaCreateRoute needs it !
             mixer->zones[index] = zone;
-            AlsaPcmCtlT *routeConfig = AlsaCreateRoute(mixer, zone, 0);
-            if (!routeConfig) {
-                AFB_ApiError(mixer->api,
-                             "%s: Mixer=%s Hal=%s zone=%s Fail to attach PCM Route",
-                             __func__, mixer->uid, uid, zone->uid);
-                goto OnErrorExit;
-            }
+            if (CreateZoneRoute(mixer, uid, zone)) goto OnErrorExit;
             break;
         }
         case json_type_array:
@@ -177,13 +274,7 @@ PUBLIC int ApiZoneAttach(SoftMixerT *mixer, AFB_ReqT request, const char *uid, j
                 }
                 
                 mixer->zones[index + idx] = zone;
-                AlsaPcmCtlT *routeConfig = AlsaCreateRoute(mixer, zone, 0);
-                if (!routeConfig) {
-                    AFB_ApiError(mixer->api,
-                                 "%s: Mixer=%s Hal=%s zone=%s Fail to attach PCM Route",
-                                 __func__, mixer->uid, uid, zone->uid);
-                    goto OnErrorExit;
-                }
+                if (CreateZoneRoute(mixer, uid, zone)) goto OnErrorExit;
 
             }
             break;
@@ -192,6 +283,8 @@ PUBLIC int ApiZoneAttach(SoftMixerT *mixer, AFB_ReqT request, const char *uid, j
             goto OnErrorExit;
     }
 
+    // ducking rules may name zones attached by this call
+    AlsaDuckResolve(mixer);
     return 0;
 
 OnErrorExit:
@@ -0,0 +1,454 @@
+/*
+ * Copyright(C) 2018 "IoT.bzh"
+ * Author Fulup Ar Foll <fulup@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http : //www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Zone capture fan-out: each hardware source is read by one real time thread,
+ * whatever its number of consumers. Captured periods land in a small pool of
+ * shared, refcounted buffers and a reference is queued to every consumer
+ * (lock-free single producer/single consumer queues). Consumers read their
+ * zone channel subset straight from the shared buffer and release it once
+ * done. A consumer may write to a pcm (loop playback subdev of a capture
+ * stream) from its own thread, or pull periods itself.
+ */
+
+#define _GNU_SOURCE  // needed for vasprintf
+
+#include "alsa-softmixer.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+
+#define CAPTURE_QUEUE_SIZE   8                       // periods queued per consumer, power of 2
+#define CAPTURE_PERIODS      (2*CAPTURE_QUEUE_SIZE)  // shared buffers per source
+#define CAPTURE_TIMEOUT_MSEC 1000
+
+struct AlsaCapturePeriodS {
+    atomic_int refs;            // 0 when free, capture thread holds one while publishing
+    snd_pcm_uframes_t frames;
+    void *data;                 // source interleaved frames
+};
+
+struct AlsaCaptureConsumerS {
+    AlsaCaptureT *capture;
+    unsigned int channels;
+    int *map;                   // consumer channel -> source channel, -1 for silence
+    bool identity;              // consumer takes every source channel in order
+
+    AlsaCapturePeriodT *queue[CAPTURE_QUEUE_SIZE];
+    atomic_uint head;           // consumer side
+    atomic_uint tail;           // capture thread side
+    atomic_uint overruns;
+    int wakeFd;
+
+    // pcm writer consumer only
+    AlsaPcmCtlT *pcm;
+    void *out;                  // one period of consumer frames, when it cannot write the shared buffer
+    atomic_bool stop;
+    pthread_t thread;
+};
+
+struct AlsaCaptureS {
+    AlsaSndPcmT *source;
+    AlsaPcmCtlT *pcm;
+    AFB_ApiT api;
+    size_t sampleSize;
+    size_t frameSize;
+    snd_pcm_uframes_t period;
+
+    AlsaCapturePeriodT periods[CAPTURE_PERIODS];
+    void *discard;              // read target when every shared buffer is still in use
+
+    pthread_mutex_t lock;       // held by capture thread while publishing, priority inheritance
+    int max;
+    int count;
+    AlsaCaptureConsumerT **consumers;
+
+    atomic_bool stop;
+    pthread_t thread;
+};
+
+STATIC AlsaCapturePeriodT *CaptureGetFree(AlsaCaptureT *capture) {
+    for (int idx = 0; idx < CAPTURE_PERIODS; idx++) {
+        if (atomic_load_explicit(&capture->periods[idx].refs, memory_order_acquire) == 0)
+            return &capture->periods[idx];
+    }
+    return NULL;
+}
+
+STATIC void CapturePublish(AlsaCaptureT *capture, AlsaCapturePeriodT *period) {
+
+    pthread_mutex_lock(&capture->lock);
+    for (int idx = 0; idx < capture->count; idx++) {
+        AlsaCaptureConsumerT *consumer = capture->consumers[idx];
+        unsigned int tail = atomic_load_explicit(&consumer->tail, memory_order_relaxed);
+        unsigned int head = atomic_load_explicit(&consumer->head, memory_order_acquire);
+
+        // slow consumer loses this period, others are not delayed
+        if (tail - head >= CAPTURE_QUEUE_SIZE) {
+            atomic_fetch_add_explicit(&consumer->overruns, 1, memory_order_relaxed);
+            continue;
+        }
+
+        atomic_fetch_add_explicit(&period->refs, 1, memory_order_relaxed);
+        consumer->queue[tail & (CAPTURE_QUEUE_SIZE - 1)] = period;
+        atomic_store_explicit(&consumer->tail, tail + 1, memory_order_release);
+        if (consumer->wakeFd > 0) eventfd_write(consumer->wakeFd, 1);
+    }
+    pthread_mutex_unlock(&capture->lock);
+}
+
+STATIC void *CaptureThreadEntry(void *handle) {
+    AlsaCaptureT *capture = (AlsaCaptureT*) handle;
+    snd_pcm_t *pcm = capture->pcm->handle;
+
+    AFB_ApiNotice(capture->api, "%s: source=%s started period=%lu", __func__, capture->source->uid, capture->period);
+
+    while (!atomic_load_explicit(&capture->stop, memory_order_relaxed)) {
+        int err = snd_pcm_wait(pcm, CAPTURE_TIMEOUT_MSEC);
+        if (err == 0) continue;
+
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm);
+        if (avail < 0) {
+            ALSA_RT_LOG(capture->api, ALSA_LOG_DEBUG, "CaptureThreadEntry: source=%s recover error=%ld", capture->source->uid, avail, 0, 0);
+            if (snd_pcm_recover(pcm, (int) avail, 1) < 0)
+                usleep(10*1000); // source is gone, do not spin
+            else
+                snd_pcm_start(pcm);
+            continue;
+        }
+
+        while (avail >= (snd_pcm_sframes_t) capture->period) {
+            ALSA_TRACE_BEGIN(trace);
+            AlsaCapturePeriodT *period = CaptureGetFree(capture);
+            void *data = period ? period->data : capture->discard;
+
+            snd_pcm_sframes_t frames = snd_pcm_readi(pcm, data, capture->period);
+            if (frames < 0) {
+                snd_pcm_recover(pcm, (int) frames, 1);
+                snd_pcm_start(pcm);
+                break;
+            }
+            avail -= frames;
+
+            // every buffer is held by consumers: the period is lost for all of them
+            if (!period) {
+                ALSA_RT_LOG(capture->api, ALSA_LOG_WARNING, "CaptureThreadEntry: source=%s no free period, dropped frames=%ld", capture->source->uid, frames, 0, 0);
+                continue;
+            }
+
+            // hold one reference while publishing, so that early consumers cannot free it under us
+            period->frames = (snd_pcm_uframes_t) frames;
+            atomic_store_explicit(&period->refs, 1, memory_order_relaxed);
+            CapturePublish(capture, period);
+            atomic_fetch_sub_explicit(&period->refs, 1, memory_order_release);
+            ALSA_TRACE_END(trace, "CapturePeriod");
+        }
+    }
+
+    pthread_exit(0);
+    return NULL;
+}
+
+// capture thread is not running, also releases a partially created capture
+STATIC void CaptureRelease(AlsaCaptureT *capture) {
+    AlsaPcmCloseHw(capture->pcm);
+
+    for (int idx = 0; idx < CAPTURE_PERIODS; idx++)
+        free(capture->periods[idx].data);
+    free(capture->discard);
+    free(capture->consumers);
+    pthread_mutex_destroy(&capture->lock);
+    free(capture);
+}
+
+STATIC AlsaCaptureT *CaptureCreate(SoftMixerT *mixer, AlsaSndPcmT *source) {
+    AlsaCaptureT *capture = calloc(1, sizeof (AlsaCaptureT));
+    int error;
+
+    capture->source = source;
+    capture->api = mixer->api;
+    capture->max = mixer->max.streams;
+    capture->consumers = calloc(capture->max, sizeof (AlsaCaptureConsumerT*));
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(&capture->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    capture->pcm = AlsaPcmOpenHw(mixer, source->uid, source->sndcard, source->ccount, SND_PCM_STREAM_CAPTURE);
+    if (!capture->pcm) goto OnErrorExit;
+
+    capture->sampleSize = snd_pcm_format_physical_width(capture->pcm->params->format) / 8;
+    capture->frameSize = capture->sampleSize * capture->pcm->params->channels;
+    capture->period = capture->pcm->params->period_frames;
+
+    for (int idx = 0; idx < CAPTURE_PERIODS; idx++) {
+        atomic_init(&capture->periods[idx].refs, 0);
+        capture->periods[idx].data = malloc(capture->period * capture->frameSize);
+    }
+    capture->discard = malloc(capture->period * capture->frameSize);
+
+    if ((error = snd_pcm_start(capture->pcm->handle)) < 0) {
+        AFB_ApiError(mixer->api, "%s: source=%s fail to start pcm=%s error=%s", __func__, source->uid, capture->pcm->cid.cardid, snd_strerror(error));
+        goto OnErrorExit;
+    }
+
+    atomic_init(&capture->stop, false);
+    if ((error = pthread_create(&capture->thread, NULL, &CaptureThreadEntry, capture)) != 0) {
+        AFB_ApiError(mixer->api, "%s: source=%s fail to create capture thread err=%d", __func__, source->uid, error);
+        goto OnErrorExit;
+    }
+
+    AlsaPcmThreadPriority(mixer, capture->thread, source->uid);
+
+    return capture;
+
+OnErrorExit:
+    CaptureRelease(capture);
+    return NULL;
+}
+
+// last consumer is gone: stop the thread and release the source pcm
+STATIC void CaptureFree(SoftMixerT *mixer, AlsaCaptureT *capture) {
+    atomic_store(&capture->stop, true);
+    pthread_join(capture->thread, NULL);
+    CaptureRelease(capture);
+
+    AFB_ApiNotice(mixer->api, "%s: source capture stopped", __func__);
+}
+
+// consumer side: next queued period, NULL when none. Data stays valid until AlsaCaptureRelease
+PUBLIC AlsaCapturePeriodT *AlsaCapturePull(AlsaCaptureConsumerT *consumer, const void **data, snd_pcm_uframes_t *frames) {
+    unsigned int head = atomic_load_explicit(&consumer->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&consumer->tail, memory_order_acquire);
+    if (head == tail) return NULL;
+
+    AlsaCapturePeriodT *period = consumer->queue[head & (CAPTURE_QUEUE_SIZE - 1)];
+    atomic_store_explicit(&consumer->head, head + 1, memory_order_release);
+
+    *data = period->data;
+    *frames = period->frames;
+    return period;
+}
+
+PUBLIC void AlsaCaptureRelease(AlsaCapturePeriodT *period) {
+    atomic_fetch_sub_explicit(&period->refs, 1, memory_order_release);
+}
+
+// consumer channel subset of a source period, only needed when the consumer is not identity
+PUBLIC void AlsaCaptureGather(AlsaCaptureConsumerT *consumer, const void *data, snd_pcm_uframes_t frames, void *out) {
+    AlsaCaptureT *capture = consumer->capture;
+    size_t sampleSize = capture->sampleSize;
+    const char *src = (const char*) data;
+    char *dst = (char*) out;
+
+    for (snd_pcm_uframes_t fdx = 0; fdx < frames; fdx++) {
+        for (unsigned int cdx = 0; cdx < consumer->channels; cdx++) {
+            if (consumer->map[cdx] < 0) memset(dst, 0, sampleSize);
+            else memcpy(dst, src + consumer->map[cdx] * sampleSize, sampleSize);
+            dst += sampleSize;
+        }
+        src += capture->frameSize;
+    }
+}
+
+PUBLIC AlsaPcmHwInfoT *AlsaCaptureParams(AlsaCaptureConsumerT *consumer) {
+    return consumer->capture->pcm->params;
+}
+
+// pcm writer consumer: the shared buffer goes straight to the pcm unless channels are remapped or gain applies
+STATIC void *ConsumerThreadEntry(void *handle) {
+    AlsaCaptureConsumerT *consumer = (AlsaCaptureConsumerT*) handle;
+    AlsaCaptureT *capture = consumer->capture;
+    AlsaPcmCtlT *pcmOut = consumer->pcm;
+    eventfd_t ticks;
+
+    while (!atomic_load_explicit(&consumer->stop, memory_order_relaxed)) {
+        eventfd_read(consumer->wakeFd, &ticks);
+
+        const void *data;
+        snd_pcm_uframes_t frames;
+        AlsaCapturePeriodT *period;
+        while ((period = AlsaCapturePull(consumer, &data, &frames)) != NULL) {
+
+            // paused consumer drops periods, the source keeps running for others
+            if (pcmOut->mute) {
+                AlsaCaptureRelease(period);
+                continue;
+            }
+
+            ALSA_TRACE_BEGIN(trace);
+            const void *buf = data;
+            bool unity = !pcmOut->gain || AlsaGainIsUnity(pcmOut->gain);
+            if (!consumer->identity || !unity) {
+                if (consumer->identity) memcpy(consumer->out, data, frames * capture->frameSize);
+                else AlsaCaptureGather(consumer, data, frames, consumer->out);
+                AlsaCaptureRelease(period);
+                period = NULL;
+                if (pcmOut->gain) AlsaGainApply(pcmOut->gain, consumer->out, frames);
+                buf = consumer->out;
+            }
+
+            snd_pcm_sframes_t written = snd_pcm_writei(pcmOut->handle, buf, frames);
+            if (period) AlsaCaptureRelease(period);
+            ALSA_TRACE_END(trace, "CaptureConsumer");
+
+            if (written == -EAGAIN) {
+                atomic_fetch_add_explicit(&consumer->overruns, 1, memory_order_relaxed);
+            } else if (written < 0) {
+                ALSA_RT_LOG(capture->api, ALSA_LOG_DEBUG, "ConsumerThreadEntry: source=%s recover error=%ld", capture->source->uid, written, 0, 0);
+                snd_pcm_recover(pcmOut->handle, (int) written, 1);
+            }
+        }
+    }
+
+    pthread_exit(0);
+    return NULL;
+}
+
+/*
+ * Subscribe to a hardware source, its capture starts with the first consumer. 'map' gives for
+ * each of the 'channels' consumer channels the source channel it takes (-1 for silence). With
+ * 'pcmOut', a thread writes consumer frames to it (pcm is configured here with source rate and
+ * format), otherwise the caller pulls periods with AlsaCapturePull.
+ */
+PUBLIC AlsaCaptureConsumerT *AlsaCaptureAttach(SoftMixerT *mixer, AlsaSndPcmT *source, const int *map, unsigned int channels, AlsaPcmCtlT *pcmOut) {
+    AlsaCaptureConsumerT *consumer = calloc(1, sizeof (AlsaCaptureConsumerT));
+    AlsaCaptureT *capture = source->capture;
+    int error;
+
+    if (!capture) {
+        capture = CaptureCreate(mixer, source);
+        if (!capture) goto OnErrorExit;
+        source->capture = capture;
+    }
+
+    if (capture->count >= capture->max) {
+        AFB_ApiError(mixer->api, "%s: source=%s too many consumers max=%d", __func__, source->uid, capture->max);
+        goto OnErrorExit;
+    }
+
+    consumer->capture = capture;
+    consumer->channels = channels;
+    consumer->map = calloc(channels, sizeof (int));
+    consumer->identity = (channels == capture->pcm->params->channels);
+    for (unsigned int idx = 0; idx < channels; idx++) {
+        consumer->map[idx] = (map[idx] < (int) capture->pcm->params->channels) ? map[idx] : -1;
+        if (consumer->map[idx] != (int) idx) consumer->identity = false;
+    }
+    atomic_init(&consumer->head, 0);
+    atomic_init(&consumer->tail, 0);
+    atomic_init(&consumer->overruns, 0);
+    atomic_init(&consumer->stop, false);
+
+    if (pcmOut) {
+        consumer->pcm = pcmOut;
+        pcmOut->params = malloc(sizeof (AlsaPcmHwInfoT));
+        memcpy(pcmOut->params, capture->pcm->params, sizeof (AlsaPcmHwInfoT));
+        pcmOut->params->channels = channels;
+
+        error = AlsaPcmConf(mixer, pcmOut, SND_PCM_STREAM_PLAYBACK);
+        if (error) {
+            AFB_ApiError(mixer->api, "%s: source=%s fail to configure consumer pcm=%s", __func__, source->uid, pcmOut->cid.cardid);
+            goto OnErrorExit;
+        }
+        if ((error = snd_pcm_prepare(pcmOut->handle)) < 0) {
+            AFB_ApiError(mixer->api, "%s: source=%s fail to prepare consumer pcm=%s error=%s", __func__, source->uid, pcmOut->cid.cardid, snd_strerror(error));
+            goto OnErrorExit;
+        }
+
+        consumer->out = malloc(capture->period * capture->sampleSize * channels);
+        consumer->wakeFd = eventfd(0, EFD_CLOEXEC);
+        if (consumer->wakeFd < 0) goto OnErrorExit;
+
+        if ((error = pthread_create(&consumer->thread, NULL, &ConsumerThreadEntry, consumer)) != 0) {
+            AFB_ApiError(mixer->api, "%s: source=%s fail to create consumer thread err=%d", __func__, source->uid, error);
+            goto OnErrorExit;
+        }
+    }
+
+    pthread_mutex_lock(&capture->lock);
+    capture->consumers[capture->count++] = consumer;
+    pthread_mutex_unlock(&capture->lock);
+
+    AFB_ApiNotice(mixer->api, "%s: source=%s consumer=%d channels=%d%s", __func__, source->uid, capture->count,
+                  channels, consumer->identity ? " (identity)" : "");
+    return consumer;
+
+OnErrorExit:
+    if (consumer->wakeFd > 0) close(consumer->wakeFd);
+    if (consumer->pcm) {
+        free(pcmOut->params);
+        pcmOut->params = NULL;
+    }
+    free(consumer->out);
+    free(consumer->map);
+    free(consumer);
+
+    // a capture created for this consumer has no other one
+    if (capture && capture->count == 0) {
+        source->capture = NULL;
+        CaptureFree(mixer, capture);
+    }
+    return NULL;
+}
+
+// once returned, the consumer holds no period anymore and its pcm may be closed
+PUBLIC int AlsaCaptureDetach(SoftMixerT *mixer, AlsaCaptureConsumerT *consumer) {
+    AlsaCaptureT *capture = consumer->capture;
+    AlsaSndPcmT *source = capture->source;
+    int idx;
+
+    pthread_mutex_lock(&capture->lock);
+    for (idx = 0; idx < capture->count; idx++) {
+        if (capture->consumers[idx] == consumer) break;
+    }
+    if (idx == capture->count) {
+        pthread_mutex_unlock(&capture->lock);
+        AFB_ApiError(mixer->api, "%s: source=%s consumer not attached", __func__, source->uid);
+        return -1;
+    }
+
+    // keep consumers packed, last one takes the free place
+    capture->consumers[idx] = capture->consumers[--capture->count];
+    pthread_mutex_unlock(&capture->lock);
+
+    if (consumer->pcm) {
+        atomic_store(&consumer->stop, true);
+        eventfd_write(consumer->wakeFd, 1);
+        pthread_join(consumer->thread, NULL);
+        close(consumer->wakeFd);
+    }
+
+    // give back periods still queued
+    const void *data;
+    snd_pcm_uframes_t frames;
+    AlsaCapturePeriodT *period;
+    while ((period = AlsaCapturePull(consumer, &data, &frames)) != NULL)
+        AlsaCaptureRelease(period);
+
+    AFB_ApiNotice(mixer->api, "%s: source=%s consumer detached overruns=%u", __func__, source->uid, atomic_load(&consumer->overruns));
+
+    free(consumer->out);
+    free(consumer->map);
+    free(consumer);
+
+    if (capture->count == 0) {
+        source->capture = NULL;
+        CaptureFree(mixer, capture);
+    }
+    return 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright(C) 2018 "IoT.bzh"
+ * Author Fulup Ar Foll <fulup@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http : //www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Internal sample format: native gain, native mixing and drift resampling all
+ * run on float32 samples normalized to [-1.0, 1.0[. Stream and sink formats are
+ * only converted at the edges of the processing, by the kernels below.
+ */
+
+#define _GNU_SOURCE  // needed for vasprintf
+
+#include "alsa-softmixer.h"
+
+#define CONVERT_S16_SCALE  32768.0f
+#define CONVERT_S24_SCALE  8388608.0f
+#define CONVERT_S32_SCALE  2147483648.0f
+
+// the following kernels are flat loops over samples with restrict pointers and branchless
+// saturation, so that the compiler emits SIMD code (SSE/AVX on x86, NEON on arm)
+
+STATIC void ConvertS16ToFloat(float *restrict dst, const int16_t *restrict src, size_t count) {
+    for (size_t idx = 0; idx < count; idx++)
+        dst[idx] = (float) src[idx] * (1.0f / CONVERT_S16_SCALE);
+}
+
+// S24_LE is 24 significant bits in a 32 bits container
+STATIC void ConvertS24ToFloat(float *restrict dst, const int32_t *restrict src, size_t count) {
+    for (size_t idx = 0; idx < count; idx++)
+        dst[idx] = (float) ((int32_t) ((uint32_t) src[idx] << 8) >> 8) * (1.0f / CONVERT_S24_SCALE);
+}
+
+// S24_3LE is packed, 3 bytes per sample
+STATIC void ConvertS24_3ToFloat(float *restrict dst, const uint8_t *restrict src, size_t count) {
+    for (size_t idx = 0; idx < count; idx++) {
+        uint32_t value = (uint32_t) src[3 * idx] << 8 | (uint32_t) src[3 * idx + 1] << 16 | (uint32_t) src[3 * idx + 2] << 24;
+        dst[idx] = (float) ((int32_t) value >> 8) * (1.0f / CONVERT_S24_SCALE);
+    }
+}
+
+STATIC void ConvertS32ToFloat(float *restrict dst, const int32_t *restrict src, size_t count) {
+    for (size_t idx = 0; idx < count; idx++)
+        dst[idx] = (float) src[idx] * (1.0f / CONVERT_S32_SCALE);
+}
+
+STATIC void ConvertFloatToS16(int16_t *restrict dst, const float *restrict src, size_t count) {
+    for (size_t idx = 0; idx < count; idx++) {
+        float value = src[idx] * CONVERT_S16_SCALE;
+        value = value > (float) INT16_MAX ? (float) INT16_MAX : value;
+        value = value < (float) INT16_MIN ? (float) INT16_MIN : value;
+        dst[idx] = (int16_t) value;
+    }
+}
+
+STATIC void ConvertFloatToS24(int32_t *restrict dst, const float *restrict src, size_t count) {
+    for (size_t idx = 0; idx < count; idx++) {
+        float value = src[idx] * CONVERT_S24_SCALE;
+        value = value > 8388607.0f ? 8388607.0f : value;
+        value = value < -8388608.0f ? -8388608.0f : value;
+        dst[idx] = (int32_t) value;
+    }
+}
+
+STATIC void ConvertFloatToS24_3(uint8_t *restrict dst, const float *restrict src, size_t count) {
+    for (size_t idx = 0; idx < count; idx++) {
+        float value = src[idx] * CONVERT_S24_SCALE;
+        value = value > 8388607.0f ? 8388607.0f : value;
+        value = value < -8388608.0f ? -8388608.0f : value;
+        uint32_t sample = (uint32_t) (int32_t) value;
+        dst[3 * idx] = (uint8_t) sample;
+        dst[3 * idx + 1] = (uint8_t) (sample >> 8);
+        dst[3 * idx + 2] = (uint8_t) (sample >> 16);
+    }
+}
+
+// float cannot hold INT32_MAX, the largest float below 2^31 is INT32_MAX - 127
+STATIC void ConvertFloatToS32(int32_t *restrict dst, const float *restrict src, size_t count) {
+    for (size_t idx = 0; idx < count; idx++) {
+        float value = src[idx] * CONVERT_S32_SCALE;
+        value = value > 2147483520.0f ? 2147483520.0f : value;
+        value = value < -CONVERT_S32_SCALE ? -CONVERT_S32_SCALE : value;
+        dst[idx] = (int32_t) value;
+    }
+}
+
+STATIC void ConvertFloatToFloat(float *restrict dst, const float *restrict src, size_t count) {
+    for (size_t idx = 0; idx < count; idx++) {
+        float value = src[idx];
+        value = value > 1.0f ? 1.0f : value;
+        value = value < -1.0f ? -1.0f : value;
+        dst[idx] = value;
+    }
+}
+
+PUBLIC bool AlsaConvertSupported(snd_pcm_format_t format) {
+    switch (format) {
+        case SND_PCM_FORMAT_S16_LE:
+        case SND_PCM_FORMAT_S24_LE:
+        case SND_PCM_FORMAT_S24_3LE:
+        case SND_PCM_FORMAT_S32_LE:
+        case SND_PCM_FORMAT_FLOAT_LE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// 'count' is a number of samples (frames * channels), 'src' and 'dst' never overlap
+PUBLIC void AlsaConvertToFloat(snd_pcm_format_t format, const void *src, float *dst, size_t count) {
+    switch (format) {
+        case SND_PCM_FORMAT_S16_LE: ConvertS16ToFloat(dst, src, count); break;
+        case SND_PCM_FORMAT_S24_LE: ConvertS24ToFloat(dst, src, count); break;
+        case SND_PCM_FORMAT_S24_3LE: ConvertS24_3ToFloat(dst, src, count); break;
+        case SND_PCM_FORMAT_S32_LE: ConvertS32ToFloat(dst, src, count); break;
+        default: memcpy(dst, src, count * sizeof (float)); break;
+    }
+}
+
+// saturates to the target format range, float output is clipped to [-1.0, 1.0]
+PUBLIC void AlsaConvertFromFloat(snd_pcm_format_t format, const float *src, void *dst, size_t count) {
+    switch (format) {
+        case SND_PCM_FORMAT_S16_LE: ConvertFloatToS16(dst, src, count); break;
+        case SND_PCM_FORMAT_S24_LE: ConvertFloatToS24(dst, src, count); break;
+        case SND_PCM_FORMAT_S24_3LE: ConvertFloatToS24_3(dst, src, count); break;
+        case SND_PCM_FORMAT_S32_LE: ConvertFloatToS32(dst, src, count); break;
+        default: ConvertFloatToFloat(dst, src, count); break;
+    }
+}
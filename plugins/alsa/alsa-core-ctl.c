@@ -27,6 +27,7 @@ for the specific language governing permissions and
 #include "alsa-softmixer.h"
 #include "alsa-bluez.h"
 
+#include <ctype.h>
 #include <pthread.h>
 #include <sys/syscall.h>
 
@@ -38,14 +39,51 @@ typedef struct {
     sd_event *sdLoop;
 } SubscribeHandleT;
 
-PUBLIC snd_ctl_elem_id_t *AlsaCtlGetNumidElemId(SoftMixerT *mixer, AlsaSndCtlT *sndcard, int numid) {
+/*
+ * Control elements directory: the card controls are listed once, with their info,
+ * then looked up by numid (direct table) or by name (hash) without any ioctl.
+ * Control ADD/REMOVE events, or a local control creation, invalidate it.
+ */
+struct AlsaCtlCacheS {
+    bool valid;
+    int count;
+    AlsaCtlElemT *elems;
+    AlsaCtlElemT **byNumid;
+    int nsize;
+    AlsaCtlElemT **byName;  // open addressing, size is a power of 2
+    int hsize;
+};
+
+STATIC unsigned int CtlCacheHash(const char *name) {
+    unsigned int hash = 2166136261u;
+    for (; *name; name++) {
+        hash ^= (unsigned char) tolower(*name);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+STATIC void CtlCacheClear(AlsaCtlCacheT *cache) {
+    for (int idx = 0; idx < cache->count; idx++) {
+        free((char*) cache->elems[idx].name);
+        snd_ctl_elem_id_free(cache->elems[idx].id);
+    }
+    free(cache->elems);
+    free(cache->byNumid);
+    free(cache->byName);
+    memset(cache, 0, sizeof (AlsaCtlCacheT));
+}
+
+STATIC int CtlCacheLoad(SoftMixerT *mixer, AlsaSndCtlT *sndcard) {
+    AlsaCtlCacheT *cache = sndcard->cache;
+    snd_ctl_elem_list_t *ctlList = NULL;
+    snd_ctl_elem_info_t *elemInfo;
     char string[32];
     int error;
-    int index;
-    snd_ctl_elem_list_t *ctlList = NULL;
-    snd_ctl_elem_id_t *elemId;
 
+    CtlCacheClear(cache);
     snd_ctl_elem_list_alloca(&ctlList);
+    snd_ctl_elem_info_alloca(&elemInfo);
 
     if ((error = snd_ctl_elem_list(sndcard->ctl, ctlList)) < 0) {
         AFB_ApiError(mixer->api,
@@ -61,7 +99,7 @@ PUBLIC snd_ctl_elem_id_t *AlsaCtlGetNumidElemId(SoftMixerT *mixer, AlsaSndCtlT *
         goto OnErrorExit;
     }
 
-    // Fulup: do not understand why snd_ctl_elem_list should be call twice to get a valid ctlCount
+    // 1st call only returns the count, 2nd one fills the allocated space
     if ((error = snd_ctl_elem_list(sndcard->ctl, ctlList)) < 0) {
         AFB_ApiError(mixer->api,
         		     "%s [%s] fail retrieve controls",
@@ -69,88 +107,155 @@ PUBLIC snd_ctl_elem_id_t *AlsaCtlGetNumidElemId(SoftMixerT *mixer, AlsaSndCtlT *
         goto OnErrorExit;
     }
 
-    // loop on control to find the right one
     int ctlCount = snd_ctl_elem_list_get_used(ctlList);
-    for (index = 0; index < ctlCount; index++) {
-
-        if (numid == snd_ctl_elem_list_get_numid(ctlList, index)) {
-            snd_ctl_elem_id_malloc(&elemId);
-            snd_ctl_elem_list_get_id(ctlList, index, elemId);
+    cache->elems = calloc(ctlCount + 1, sizeof (AlsaCtlElemT));
+    for (int hsize = 16; ; hsize *= 2) {
+        if (hsize >= 2 * ctlCount) {
+            cache->hsize = hsize;
             break;
         }
     }
+    cache->byName = calloc(cache->hsize, sizeof (AlsaCtlElemT*));
+
+    for (int index = 0; index < ctlCount; index++) {
+        AlsaCtlElemT *elem = &cache->elems[cache->count];
+
+        snd_ctl_elem_id_malloc(&elem->id);
+        snd_ctl_elem_list_get_id(ctlList, index, elem->id);
+        elem->numid = snd_ctl_elem_list_get_numid(ctlList, index);
+        elem->name = strdup(snd_ctl_elem_list_get_name(ctlList, index));
+
+        snd_ctl_elem_info_set_id(elemInfo, elem->id);
+        if (snd_ctl_elem_info(sndcard->ctl, elemInfo) >= 0) {
+            elem->type = snd_ctl_elem_info_get_type(elemInfo);
+            elem->count = snd_ctl_elem_info_get_count(elemInfo);
+            elem->readable = snd_ctl_elem_info_is_readable(elemInfo);
+            elem->writable = snd_ctl_elem_info_is_writable(elemInfo);
+            if (elem->type == SND_CTL_ELEM_TYPE_INTEGER) {
+                elem->min = snd_ctl_elem_info_get_min(elemInfo);
+                elem->max = snd_ctl_elem_info_get_max(elemInfo);
+            } else if (elem->type == SND_CTL_ELEM_TYPE_BOOLEAN) {
+                elem->max = 1;
+            }
+        }
+        cache->count++;
+    }
 
-    if (index == ctlCount) {
-        AFB_ApiNotice(mixer->api,
-        		      "%s [%s] fail get numid=%i count",
-					  __func__, ALSA_CTL_UID(sndcard->ctl, string), numid);
-        goto OnErrorExit;
+    // index by numid
+    for (int idx = 0; idx < cache->count; idx++) {
+        if (cache->elems[idx].numid >= cache->nsize) cache->nsize = cache->elems[idx].numid + 1;
+    }
+    cache->byNumid = calloc(cache->nsize + 1, sizeof (AlsaCtlElemT*));
+    for (int idx = 0; idx < cache->count; idx++) {
+        cache->byNumid[cache->elems[idx].numid] = &cache->elems[idx];
+    }
+
+    // index by name, first element in list order wins
+    for (int idx = 0; idx < cache->count; idx++) {
+        unsigned int slot = CtlCacheHash(cache->elems[idx].name) & (cache->hsize - 1);
+        while (cache->byName[slot]) {
+            if (!strcasecmp(cache->byName[slot]->name, cache->elems[idx].name)) break;
+            slot = (slot + 1) & (cache->hsize - 1);
+        }
+        if (!cache->byName[slot]) cache->byName[slot] = &cache->elems[idx];
     }
 
-    // clear ctl list and return elemid
-    snd_ctl_elem_list_clear(ctlList);
-    return elemId;
+    snd_ctl_elem_list_free_space(ctlList);
+    cache->valid = true;
+    return 0;
 
 OnErrorExit:
     if (ctlList) snd_ctl_elem_list_clear(ctlList);
-    return NULL;
+    return -1;
 }
 
-PUBLIC snd_ctl_elem_id_t *AlsaCtlGetNameElemId(SoftMixerT *mixer, AlsaSndCtlT *sndcard, const char *ctlName) {
-    int error;
-    int index;
-    snd_ctl_elem_list_t *ctlList = NULL;
-    snd_ctl_elem_id_t *elemId;
+STATIC AlsaCtlElemT *CtlCacheFindNumid(AlsaCtlCacheT *cache, int numid) {
+    if (!cache || !cache->valid || numid <= 0 || numid >= cache->nsize) return NULL;
+    return cache->byNumid[numid];
+}
 
-    snd_ctl_elem_list_alloca(&ctlList);
+STATIC AlsaCtlElemT *CtlCacheFindName(AlsaCtlCacheT *cache, const char *ctlName) {
+    if (!cache || !cache->valid) return NULL;
 
-    if ((error = snd_ctl_elem_list(sndcard->ctl, ctlList)) < 0) {
-        AFB_ApiError(mixer->api,
-        		     "%s cardid='%s' cardname='%s' fail retrieve controls",
-					 __func__, sndcard->cid.cardid, sndcard->cid.name);
-        goto OnErrorExit;
+    unsigned int slot = CtlCacheHash(ctlName) & (cache->hsize - 1);
+    while (cache->byName[slot]) {
+        if (!strcasecmp(cache->byName[slot]->name, ctlName)) return cache->byName[slot];
+        slot = (slot + 1) & (cache->hsize - 1);
     }
 
-    if ((error = snd_ctl_elem_list_alloc_space(ctlList, snd_ctl_elem_list_get_count(ctlList))) < 0) {
-        AFB_ApiError(mixer->api,
-        		     "%s cardid='%s' cardname='%s' fail retrieve count",
-					 __func__, sndcard->cid.cardid, sndcard->cid.name);
-        goto OnErrorExit;
+    // historical lookup also accepted a partial name
+    for (int idx = 0; idx < cache->count; idx++) {
+        if (strcasestr(cache->elems[idx].name, ctlName)) return &cache->elems[idx];
     }
+    return NULL;
+}
 
-    // Fulup: do not understand why snd_ctl_elem_list should be call twice to get a valid ctlCount
-    if ((error = snd_ctl_elem_list(sndcard->ctl, ctlList)) < 0) {
-        AFB_ApiError(mixer->api,
-        		     "%s cardid='%s' cardname='%s' fail retrieve controls",
-					 __func__, sndcard->cid.cardid, sndcard->cid.name);
+// (re)load the directory when needed, a miss on a valid cache reloads once for controls created by others
+STATIC int CtlCacheReady(SoftMixerT *mixer, AlsaSndCtlT *sndcard, bool miss) {
+    if (!sndcard->cache) sndcard->cache = calloc(1, sizeof (AlsaCtlCacheT));
+    if (sndcard->cache->valid && !miss) return 0;
+    return CtlCacheLoad(mixer, sndcard);
+}
+
+PUBLIC void AlsaCtlCacheInvalidate(AlsaSndCtlT *sndcard) {
+    if (sndcard->cache) sndcard->cache->valid = false;
+}
+
+PUBLIC AlsaCtlElemT *AlsaCtlGetNumidElem(SoftMixerT *mixer, AlsaSndCtlT *sndcard, int numid) {
+    char string[32];
+    AlsaCtlElemT *elem;
+
+    if (CtlCacheReady(mixer, sndcard, false) < 0) goto OnErrorExit;
+    elem = CtlCacheFindNumid(sndcard->cache, numid);
+    if (!elem) {
+        if (CtlCacheReady(mixer, sndcard, true) < 0) goto OnErrorExit;
+        elem = CtlCacheFindNumid(sndcard->cache, numid);
+    }
+
+    if (!elem) {
+        AFB_ApiNotice(mixer->api,
+        		      "%s [%s] fail get numid=%i count",
+					  __func__, ALSA_CTL_UID(sndcard->ctl, string), numid);
         goto OnErrorExit;
     }
+    return elem;
 
-    // loop on control to find the right one
-    int ctlCount = snd_ctl_elem_list_get_used(ctlList);
-    for (index = 0; index < ctlCount; index++) {
+OnErrorExit:
+    return NULL;
+}
 
-        if (strcasestr(snd_ctl_elem_list_get_name(ctlList, index), ctlName)) {
-            snd_ctl_elem_id_malloc(&elemId);
-            snd_ctl_elem_list_get_id(ctlList, index, elemId);
-            break;
-        }
+PUBLIC AlsaCtlElemT *AlsaCtlGetNameElem(SoftMixerT *mixer, AlsaSndCtlT *sndcard, const char *ctlName) {
+    AlsaCtlElemT *elem;
+
+    if (CtlCacheReady(mixer, sndcard, false) < 0) goto OnErrorExit;
+    elem = CtlCacheFindName(sndcard->cache, ctlName);
+    if (!elem) {
+        if (CtlCacheReady(mixer, sndcard, true) < 0) goto OnErrorExit;
+        elem = CtlCacheFindName(sndcard->cache, ctlName);
     }
 
-    if (index == ctlCount) {
+    if (!elem) {
         AFB_ApiNotice(mixer->api, "AlsaCtlGetNameElemId cardid='%s' cardname='%s' ctl not found name=%s", sndcard->cid.cardid, sndcard->cid.name, ctlName);
         goto OnErrorExit;
     }
-
-    // clear ctl list and return elemid
-    snd_ctl_elem_list_clear(ctlList);
-    return elemId;
+    return elem;
 
 OnErrorExit:
-    if (ctlList) snd_ctl_elem_list_clear(ctlList);
     return NULL;
 }
 
+// returned elem/elemId belong to the card cache, only valid until the next lookup on this card:
+// a miss, or a lookup after a control add/remove, reloads the directory and frees every elem
+PUBLIC snd_ctl_elem_id_t *AlsaCtlGetNumidElemId(SoftMixerT *mixer, AlsaSndCtlT *sndcard, int numid) {
+    AlsaCtlElemT *elem = AlsaCtlGetNumidElem(mixer, sndcard, numid);
+    return elem ? elem->id : NULL;
+}
+
+PUBLIC snd_ctl_elem_id_t *AlsaCtlGetNameElemId(SoftMixerT *mixer, AlsaSndCtlT *sndcard, const char *ctlName) {
+    AlsaCtlElemT *elem = AlsaCtlGetNameElem(mixer, sndcard, ctlName);
+    return elem ? elem->id : NULL;
+}
+
 PUBLIC snd_ctl_t *AlsaCtlOpenCtl(SoftMixerT *mixer, const char *cardid) {
     int error;
     snd_ctl_t *ctl;
@@ -215,13 +320,18 @@ STATIC void CtlElemIdDisplay(SoftMixerT *mixer, snd_ctl_elem_info_t *elemInfo, s
 
 PUBLIC int CtlElemIdGetLong(SoftMixerT *mixer, AlsaSndCtlT *sndcard, snd_ctl_elem_id_t *elemId, long *value) {
     int error;
-    snd_ctl_elem_value_t *elemData;
+    snd_ctl_elem_value_t *elemData = NULL;
     snd_ctl_elem_info_t *elemInfo;
 
+    // cached element info saves one ioctl per access
+    AlsaCtlElemT *elem = CtlCacheFindNumid(sndcard->cache, snd_ctl_elem_id_get_numid(elemId));
+
     snd_ctl_elem_info_alloca(&elemInfo);
     snd_ctl_elem_info_set_id(elemInfo, elemId);
-    if (snd_ctl_elem_info(sndcard->ctl, elemInfo) < 0) goto OnErrorExit;
-    if (!snd_ctl_elem_info_is_readable(elemInfo)) goto OnErrorExit;
+    if (!elem) {
+        if (snd_ctl_elem_info(sndcard->ctl, elemInfo) < 0) goto OnErrorExit;
+        if (!snd_ctl_elem_info_is_readable(elemInfo)) goto OnErrorExit;
+    } else if (!elem->readable) goto OnErrorExit;
 
     // as we have static rate/channel we should have only one boolean as value
 
@@ -239,6 +349,7 @@ PUBLIC int CtlElemIdGetLong(SoftMixerT *mixer, AlsaSndCtlT *sndcard, snd_ctl_ele
     return 0;
 
 OnErrorExit:
+    if (elem) snd_ctl_elem_info(sndcard->ctl, elemInfo);
     CtlElemIdDisplay(mixer, elemInfo, elemData);
     return -1;
 }
@@ -247,21 +358,26 @@ PUBLIC int CtlElemIdSetLong(SoftMixerT *mixer, AlsaSndCtlT *sndcard, snd_ctl_ele
     snd_ctl_elem_value_t *elemData;
     snd_ctl_elem_info_t *elemInfo;
     const char* name;
-    int error, numid;
+    int error, numid, count;
+
+    // cached element info saves one ioctl per access
+    AlsaCtlElemT *elem = CtlCacheFindNumid(sndcard->cache, snd_ctl_elem_id_get_numid(elemId));
 
     snd_ctl_elem_info_alloca(&elemInfo);
     snd_ctl_elem_info_set_id(elemInfo, elemId);
-    if (snd_ctl_elem_info(sndcard->ctl, elemInfo) < 0) goto OnErrorExit;
-
-    if (!snd_ctl_elem_info_is_writable(elemInfo)) goto OnErrorExit;
-
-    int count = snd_ctl_elem_info_get_count(elemInfo);
+    if (!elem) {
+        if (snd_ctl_elem_info(sndcard->ctl, elemInfo) < 0) goto OnErrorExit;
+        if (!snd_ctl_elem_info_is_writable(elemInfo)) goto OnErrorExit;
+        count = snd_ctl_elem_info_get_count(elemInfo);
+    } else {
+        if (!elem->writable) goto OnErrorExit;
+        count = elem->count;
+    }
     if (count == 0) goto OnErrorExit;
 
+    // every value is overwritten, no need to read them first
     snd_ctl_elem_value_alloca(&elemData);
     snd_ctl_elem_value_set_id(elemData, elemId);
-    error = snd_ctl_elem_read(sndcard->ctl, elemData);
-    if (error) goto OnErrorExit;
 
     for (int index = 0; index < count; index++) {
         snd_ctl_elem_value_set_integer(elemData, index, value);
@@ -273,6 +389,7 @@ PUBLIC int CtlElemIdSetLong(SoftMixerT *mixer, AlsaSndCtlT *sndcard, snd_ctl_ele
     return 0;
 
 OnErrorExit:
+    if (elem) snd_ctl_elem_info(sndcard->ctl, elemInfo);
     numid = snd_ctl_elem_info_get_numid(elemInfo);
     name = snd_ctl_elem_info_get_name(elemInfo);
     AFB_ApiError(mixer->api, "CtlElemIdSetInt: numid=%d name=%s not writable", numid, name);
@@ -443,6 +560,9 @@ STATIC int AlsaCtlMakeControl(SoftMixerT *mixer, AlsaSndCtlT *sndcard, const cha
             goto OnErrorExit;
     }
 
+    // directory changed, without relying on ADD event (card may not be subscribed yet)
+    AlsaCtlCacheInvalidate(sndcard);
+
     // retrieve newly created control numid
     int numid = snd_ctl_elem_info_get_numid(elemInfo);
     return numid;
@@ -487,15 +607,79 @@ OnErrorExit:
     return -1;
 }
 
+// one registry entry per numid, looked up without any ioctl
+STATIC RegistryEntryPcmT *CtlRegistryLookup(AlsaSndCtlT *sndcard, int numid) {
+    if (numid <= 0 || numid >= sndcard->nsize) return NULL;
+    return sndcard->numids[numid];
+}
+
+// only the value is needed: a single elem_read ioctl addressed by numid
+STATIC int CtlNumidReadLong(AlsaSndCtlT *sndcard, int numid, long *value) {
+    snd_ctl_elem_value_t *elemData;
+
+    snd_ctl_elem_value_alloca(&elemData);
+    snd_ctl_elem_value_set_numid(elemData, numid);
+    if (snd_ctl_elem_read(sndcard->ctl, elemData) < 0) return -1;
+
+    *value = (int) snd_ctl_elem_value_get_integer(elemData, 0);
+    return 0;
+}
+
+STATIC void CtlRegistryDispatch(SubscribeHandleT *sHandle, RegistryEntryPcmT *reg, long value) {
+    SoftMixerT *mixer = sHandle->mixer;
+    snd_pcm_t * pcm = reg->pcm->handle;
+    int numid = reg->numid;
+    int ret;
+
+    switch (reg->type) {
+        case FONTEND_NUMID_RUN:
+            // owning stream copy starts on activity (lazy startup, idle resume), idle timer is armed otherwise
+            if (reg->pcm->stream && ApiStreamActivity(mixer, reg->pcm->stream, value)) break;
+            AlsaPcmCopyMuteSignal(mixer, reg->pcm, !value);
+            ret = snd_pcm_pause(pcm, (int) (!value));
+            AFB_ApiNotice(mixer->api, "%s:%s numid=%d active=%ld ret %d",
+            		      __func__, sHandle->uid, numid, value, ret);
+            if (ret < 0) {
+            	AFB_ApiNotice(mixer->api, "%s error: %s", __func__, snd_strerror(ret));
+            }
+            break;
+        case FONTEND_NUMID_PAUSE:
+            AlsaPcmCopyMuteSignal(mixer, reg->pcm, value);
+            ret = snd_pcm_pause(pcm, (int) value);
+            AFB_ApiNotice(mixer->api, "%s:%s numid=%d pause=%ld ret %d",
+            		      __func__, sHandle->uid, numid, value, ret);
+            if (ret < 0) {
+            	AFB_ApiNotice(mixer->api, "%s error %s", __func__, snd_strerror(ret));
+            }
+            break;
+        case FONTEND_NUMID_VOLUME:
+            // softvol applies the control itself, only a native gain stage needs the new volume
+            if (reg->pcm->gain) AlsaPcmCopyVolumeSignal(mixer, reg->pcm, value, 0);
+            AFB_ApiInfo(mixer->api, "%s:%s numid=%d volume=%ld",
+            		      __func__, sHandle->uid, numid, value);
+            break;
+        case FONTEND_NUMID_IGNORE:
+        default:
+            AFB_ApiInfo(mixer->api,
+            			"%s:%s numid=%d ignored=%ld",
+						__func__, sHandle->uid, numid, value);
+    }
+
+    // subscribed clients get the change instead of polling stream info
+    if (reg->pcm->stream) AlsaEventsStream(mixer, reg->pcm->stream, reg->type, value);
+}
+
+#define CTL_EVENT_BURST_MAX 64
+
 STATIC int CtlSubscribeEventCB(sd_event_source* src, int fd, uint32_t revents, void* userData) {
-    int error;
     SubscribeHandleT *sHandle = (SubscribeHandleT*) userData;
     AlsaSndCtlT *sndcard = sHandle->sndcard;
     SoftMixerT *mixer = sHandle->mixer;
+    RegistryEntryPcmT *pending[CTL_EVENT_BURST_MAX];
     snd_ctl_event_t *eventId;
-    snd_ctl_elem_id_t *elemId;
+    int npending = 0;
     long value;
-    int index;
+    ALSA_TRACE_BEGIN(trace);
 
     if ((revents & EPOLLHUP) != 0) {
         AFB_ApiNotice(mixer->api, "%s hanghup [card:%s disconnected]", __func__, sHandle->uid);
@@ -506,74 +690,51 @@ STATIC int CtlSubscribeEventCB(sd_event_source* src, int fd, uint32_t revents, v
 
     // initialise event structure on stack
     snd_ctl_event_alloca(&eventId);
-    snd_ctl_elem_id_alloca(&elemId);
 
-    error = snd_ctl_read(sndcard->ctl, eventId);
-    if (error < 0) goto OnErrorExit;
+    // drain the whole burst (ctl is non blocking), only remember registered numids once each
+    for (int count = 0; count < CTL_EVENT_BURST_MAX; count++) {
+        if (snd_ctl_read(sndcard->ctl, eventId) <= 0) break;
 
-    // we only process sndctrl element
-    if (snd_ctl_event_get_type(eventId) != SND_CTL_EVENT_ELEM) goto OnSuccessExit;
+        // we only process sndctrl element events
+        if (snd_ctl_event_get_type(eventId) != SND_CTL_EVENT_ELEM) continue;
+        unsigned int eventMask = snd_ctl_event_elem_get_mask(eventId);
 
-    // we only process value changed events
-    unsigned int eventMask = snd_ctl_event_elem_get_mask(eventId);
-    if (!(eventMask & SND_CTL_EVENT_MASK_VALUE)) goto OnSuccessExit;
+        // control added or removed, elements directory is reloaded on next access
+        if (eventMask == SND_CTL_EVENT_MASK_REMOVE || (eventMask & SND_CTL_EVENT_MASK_ADD)) {
+            AlsaCtlCacheInvalidate(sndcard);
+            if (eventMask == SND_CTL_EVENT_MASK_REMOVE) continue;
+        }
 
-    // extract element from event and get value    
-    snd_ctl_event_elem_get_id(eventId, elemId);
-    error = CtlElemIdGetLong(mixer, sHandle->sndcard, elemId, &value);
-    if (error) goto OnErrorExit;
-    
-    // get numdid and name from elemId
-    snd_ctl_elem_info_t *elemInfo;
-    snd_ctl_elem_info_alloca(&elemInfo);
-    snd_ctl_elem_info_set_id(elemInfo, elemId);
-    if (snd_ctl_elem_info(sndcard->ctl, elemInfo) < 0) goto OnErrorExit;
-    int numid = snd_ctl_elem_info_get_numid(elemInfo);
-    const char *name= snd_ctl_elem_info_get_name(elemInfo);
-
-    for (index = 0; sndcard->registry[index]; index++) {
-    	RegistryEntryPcmT * reg = sndcard->registry[index];
-    	snd_pcm_t * pcm = reg->pcm->handle;
-        if (reg->numid == numid) {
-        	int ret;
-            switch (reg->type) {
-                case FONTEND_NUMID_RUN:
-                    AlsaPcmCopyMuteSignal(mixer, reg->pcm, !value);
-                    ret = snd_pcm_pause(pcm, (int) (!value));
-                    AFB_ApiNotice(mixer->api, "%s:%s numid=%d name=%s active=%ld ret %d",
-                    		      __func__, sHandle->uid, numid, name, value, ret);
-                    if (ret < 0) {
-                    	AFB_ApiNotice(mixer->api, "%s error: %s", __func__, snd_strerror(ret));
-                    }
+        if (!(eventMask & SND_CTL_EVENT_MASK_VALUE)) continue;
 
-                    break;
-                case FONTEND_NUMID_PAUSE:
-                    AlsaPcmCopyMuteSignal(mixer, reg->pcm, value);
-                    ret = snd_pcm_pause(reg->pcm->handle, (int) value);
-                    AFB_ApiNotice(mixer->api, "%s:%s numid=%d name=%s pause=%ld ret %d",
-                    		      __func__, sHandle->uid, numid, name, value, ret);
-                    if (ret < 0) {
-                    	AFB_ApiNotice(mixer->api, "%s error %s", __func__, snd_strerror(ret));
-                    }
-                    break;
-                case FONTEND_NUMID_IGNORE:
-                default:
-                    AFB_ApiInfo(mixer->api,
-                    			"%s:%s numid=%d name=%s ignored=%ld",
-								__func__, sHandle->uid, numid, name, value);
-            }
-            break;
+        // numid comes with the event, unregistered controls cost no ioctl
+        int numid = snd_ctl_event_elem_get_numid(eventId);
+        RegistryEntryPcmT *reg = CtlRegistryLookup(sndcard, numid);
+        if (!reg) {
+            AFB_ApiDebug(mixer->api, "%s:%s numid=%d (unknown)", __func__, sHandle->uid, numid);
+            continue;
+        }
+
+        if (!reg->pending) {
+            reg->pending = true;
+            pending[npending++] = reg;
         }
     }
-    if (index == sndcard->rcount) {
-        AFB_ApiNotice(mixer->api, "%s:%s numid=%d (unknown)", __func__, sHandle->uid, numid);
+
+    // coalesced: each control is read once and dispatched with its latest value
+    for (int idx = 0; idx < npending; idx++) {
+        RegistryEntryPcmT *reg = pending[idx];
+        reg->pending = false;
+
+        if (CtlNumidReadLong(sndcard, reg->numid, &value) < 0) {
+            AFB_ApiInfo(mixer->api, "%s:%s numid=%d fail to read value", __func__, sHandle->uid, reg->numid);
+            continue;
+        }
+        CtlRegistryDispatch(sHandle, reg, value);
     }
 
 OnSuccessExit:
-    return 0;
-
-OnErrorExit:
-    AFB_ApiInfo(mixer->api, "%s: ignored unsupported event", __func__);
+    ALSA_TRACE_END(trace, "CtlSubscribeEventCB");
     return 0;
 }
 
@@ -614,6 +775,9 @@ PUBLIC int AlsaCtlSubscribe(SoftMixerT *mixer, const char *uid, AlsaSndCtlT *snd
         goto OnErrorExit;
     }
 
+    // event callback drains bursts until the queue is empty
+    snd_ctl_nonblock(handle->sndcard->ctl, 1);
+
     // get pollfd attach to this sound board
     int count = snd_ctl_poll_descriptors(handle->sndcard->ctl, &pfds, 1);
     if (count != 1) {
@@ -653,8 +817,8 @@ PUBLIC int AlsaCtlRegister(SoftMixerT *mixer, AlsaSndCtlT *sndcard, AlsaPcmCtlT
     }
 
     // If 1st registration then register to card event
-    if (index == 0) {
-        AlsaCtlSubscribe(mixer, sndcard->cid.cardid, sndcard);
+    if (!sndcard->subscribed) {
+        sndcard->subscribed = (AlsaCtlSubscribe(mixer, sndcard->cid.cardid, sndcard) == 0);
     }
 
     // store PCM in order to pause/resume depending on event
@@ -664,6 +828,70 @@ PUBLIC int AlsaCtlRegister(SoftMixerT *mixer, AlsaSndCtlT *sndcard, AlsaPcmCtlT
     entry->numid = numid;
     entry->type = type;
 
+    // numids are small and dense, index them directly
+    if (numid >= sndcard->nsize) {
+        int nsize = (numid + 1) * 2;
+        RegistryEntryPcmT **numids = realloc(sndcard->numids, nsize * sizeof (RegistryEntryPcmT*));
+        if (!numids) goto OnErrorExit;
+        memset(&numids[sndcard->nsize], 0, (nsize - sndcard->nsize) * sizeof (RegistryEntryPcmT*));
+        sndcard->numids = numids;
+        sndcard->nsize = nsize;
+    }
+
+    // first registration wins, as the former linear scan did
+    if (numid > 0 && !sndcard->numids[numid])
+        sndcard->numids[numid] = entry;
+
+    return 0;
+
+OnErrorExit:
+    return -1;
+}
+
+// forget every registration of a closing pcm, events for its numids are then ignored
+PUBLIC void AlsaCtlUnregister(SoftMixerT *mixer, AlsaSndCtlT *sndcard, AlsaPcmCtlT *pcmdev) {
+
+    for (int index = 0; index < sndcard->rcount; index++) {
+        RegistryEntryPcmT *entry = sndcard->registry[index];
+        if (!entry || entry->pcm != pcmdev) continue;
+
+        if (entry->numid > 0 && entry->numid < sndcard->nsize && sndcard->numids[entry->numid] == entry)
+            sndcard->numids[entry->numid] = NULL;
+
+        AFB_ApiInfo(mixer->api, "%s: unregistered ID %d.", __func__, entry->numid);
+        sndcard->registry[index] = NULL;
+        free(entry);
+    }
+
+    // keep registry packed, AlsaCtlRegister allocates the first free entry
+    int last = 0;
+    for (int index = 0; index < sndcard->rcount; index++) {
+        RegistryEntryPcmT *entry = sndcard->registry[index];
+        if (!entry) continue;
+        sndcard->registry[last++] = entry;
+
+        // a numid shared with the removed pcm goes to the next registration
+        if (entry->numid > 0 && entry->numid < sndcard->nsize && !sndcard->numids[entry->numid])
+            sndcard->numids[entry->numid] = entry;
+    }
+    for (int index = last; index < sndcard->rcount; index++) sndcard->registry[index] = NULL;
+}
+
+PUBLIC int AlsaCtlRemoveControl(SoftMixerT *mixer, AlsaSndCtlT *sndcard, int numid) {
+    int error;
+
+    snd_ctl_elem_id_t *elemId = AlsaCtlGetNumidElemId(mixer, sndcard, numid);
+    if (!elemId) {
+        AFB_ApiError(mixer->api, "%s: cardid=%s fail to find numid=%d", __func__, sndcard->cid.cardid, numid);
+        goto OnErrorExit;
+    }
+
+    if ((error = snd_ctl_elem_remove(sndcard->ctl, elemId)) < 0) {
+        AFB_ApiError(mixer->api, "%s: cardid=%s fail to remove numid=%d error=%s", __func__, sndcard->cid.cardid, numid, snd_strerror(error));
+        goto OnErrorExit;
+    }
+
+    AlsaCtlCacheInvalidate(sndcard);
     return 0;
 
 OnErrorExit:
@@ -0,0 +1,225 @@
+/*
+ * Copyright(C) 2018 "IoT.bzh"
+ * Author Fulup Ar Foll <fulup@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http : //www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Adaptive drift compensation: snd-aloop capture clock and sink clock never
+ * match exactly. A PI controller watches the stream latency (copy ring + playback
+ * delay) and slightly speeds up or slows down a fractional cubic resampler, so
+ * that latency stays at the level locked when the stream started.
+ */
+
+#define _GNU_SOURCE  // needed for vasprintf
+
+#include "alsa-softmixer.h"
+#include <math.h>
+
+#define DRIFT_SETTLE_UPDATES 32        // updates averaged to lock target latency
+#define DRIFT_FILTER_ALPHA   0.05      // latency low pass filter (removes period sawtooth)
+#define DRIFT_MAX_PPM        2000.0    // max correction, crystals are usually within +-100ppm
+#define DRIFT_KP             0.5e-6    // ratio per frame of error
+#define DRIFT_KI             0.005e-6  // ratio per frame of error per update
+
+struct AlsaDriftS {
+    snd_pcm_format_t format;
+    unsigned int channels;
+    size_t frameSize;
+
+    // PI controller
+    double ratio;      // input frames consumed per output frame
+    double level;      // filtered latency in frames
+    double target;     // locked latency in frames
+    double integral;
+    int updates;
+
+    // cubic interpolator state, 4 frames history in float32 internal format
+    double phase;
+    float *hist;
+
+    // one chunk of resampled output, float32 then stream format
+    float *fout;
+    void *out;
+    snd_pcm_uframes_t outMax;
+
+    // part of the last chunk the sink did not take yet, [done, produced[
+    snd_pcm_uframes_t produced;
+    snd_pcm_uframes_t done;
+};
+
+PUBLIC AlsaDriftT *AlsaDriftCreate(SoftMixerT *mixer, AlsaPcmHwInfoT *params, size_t frameSize, snd_pcm_uframes_t maxFrames) {
+    AlsaDriftT *drift = NULL;
+
+    if (!AlsaConvertSupported(params->format)) {
+        AFB_ApiWarning(mixer->api, "%s: drift compensation unsupported for format=%d, disabled", __func__, params->format);
+        goto OnErrorExit;
+    }
+
+    drift = calloc(1, sizeof (AlsaDriftT));
+    drift->format = params->format;
+    drift->channels = params->channels;
+    drift->frameSize = frameSize;
+    drift->outMax = maxFrames;
+    drift->hist = calloc(4 * drift->channels, sizeof (float));
+    drift->fout = malloc(maxFrames * drift->channels * sizeof (float));
+    drift->out = malloc(maxFrames * frameSize);
+    if (!drift->hist || !drift->fout || !drift->out) {
+        AFB_ApiError(mixer->api, "%s: fail to allocate resampler buffers frames=%lu", __func__, maxFrames);
+        goto OnErrorExit;
+    }
+
+    drift->ratio = 1.0;
+    drift->phase = 2.0; // fill history with two frames before first output
+    return drift;
+
+OnErrorExit:
+    AlsaDriftFree(drift);
+    return NULL;
+}
+
+PUBLIC void AlsaDriftFree(AlsaDriftT *drift) {
+    if (!drift) return;
+    free(drift->hist);
+    free(drift->fout);
+    free(drift->out);
+    free(drift);
+}
+
+// start over as a new stream: the next updates lock a new target latency
+PUBLIC void AlsaDriftReset(AlsaDriftT *drift) {
+    memset(drift->hist, 0, 4 * drift->channels * sizeof (float));
+    drift->ratio = 1.0;
+    drift->phase = 2.0;
+    drift->integral = 0.0;
+    drift->updates = 0;
+    drift->produced = drift->done = 0;
+}
+
+// feed controller with current stream latency (ring + playback delay), called once per write cycle
+PUBLIC double AlsaDriftUpdate(AlsaDriftT *drift, snd_pcm_sframes_t latency) {
+    const double maxCorrection = DRIFT_MAX_PPM * 1e-6;
+
+    if (drift->updates == 0)
+        drift->level = (double) latency;
+    else
+        drift->level += DRIFT_FILTER_ALPHA * ((double) latency - drift->level);
+
+    // lock target on the settled startup latency
+    if (drift->updates < DRIFT_SETTLE_UPDATES) {
+        drift->updates++;
+        drift->target = drift->level;
+        return drift->ratio;
+    }
+
+    double error = drift->level - drift->target;
+
+    // anti windup: integral term alone never exceeds max correction
+    drift->integral += error;
+    if (drift->integral * DRIFT_KI > maxCorrection) drift->integral = maxCorrection / DRIFT_KI;
+    else if (drift->integral * DRIFT_KI < -maxCorrection) drift->integral = -maxCorrection / DRIFT_KI;
+
+    double correction = DRIFT_KP * error + DRIFT_KI * drift->integral;
+    if (correction > maxCorrection) correction = maxCorrection;
+    else if (correction < -maxCorrection) correction = -maxCorrection;
+
+    drift->ratio = 1.0 + correction;
+    return drift->ratio;
+}
+
+/*
+ * Resample 'inFrames' frames from 'in' into the drift output buffer at current ratio.
+ * Returns the number of produced frames (at most 'outFrames' and buffer size) and sets
+ * '*inUsed' to the number of consumed input frames. Input is consumed for good, so the
+ * output stays pending until AlsaDriftRelease: sinks read it through AlsaDriftPull.
+ */
+PUBLIC snd_pcm_uframes_t AlsaDriftProcess(AlsaDriftT *drift, const void *in, snd_pcm_uframes_t inFrames,
+                                          snd_pcm_uframes_t *inUsed, snd_pcm_uframes_t outFrames, const void **out) {
+    const unsigned int channels = drift->channels;
+    float *h0 = &drift->hist[0], *h1 = &drift->hist[channels], *h2 = &drift->hist[2 * channels], *h3 = &drift->hist[3 * channels];
+    snd_pcm_uframes_t consumed = 0, produced = 0;
+
+    if (outFrames > drift->outMax)
+        outFrames = drift->outMax;
+
+    while (produced < outFrames) {
+
+        // slide history until output position sits between h1 and h2
+        while (drift->phase >= 1.0) {
+            if (consumed >= inFrames)
+                goto Done;
+
+            const char *frame = (const char*) in + consumed * drift->frameSize;
+            memmove(h0, h1, 3 * channels * sizeof (float));
+            AlsaConvertToFloat(drift->format, frame, h3, channels);
+
+            consumed++;
+            drift->phase -= 1.0;
+        }
+
+        // Catmull-Rom cubic interpolation
+        float mu = (float) drift->phase;
+        float *frame = drift->fout + produced * channels;
+        for (unsigned int chan = 0; chan < channels; chan++) {
+            float p0 = h0[chan], p1 = h1[chan], p2 = h2[chan], p3 = h3[chan];
+            frame[chan] = p1 + 0.5f * mu * (p2 - p0 + mu * (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3 + mu * (3.0f * (p1 - p2) + p3 - p0)));
+        }
+
+        produced++;
+        drift->phase += drift->ratio;
+    }
+
+Done:
+    AlsaConvertFromFloat(drift->format, drift->fout, drift->out, produced * channels);
+    drift->produced = produced;
+    drift->done = 0;
+    *inUsed = consumed;
+    *out = drift->out;
+    return produced;
+}
+
+// resampled frames left from last AlsaDriftProcess, written first after a short write or an xrun
+STATIC snd_pcm_uframes_t DriftPending(AlsaDriftT *drift, const void **out) {
+    *out = (const char*) drift->out + drift->done * drift->frameSize;
+    return drift->produced - drift->done;
+}
+
+/*
+ * Next chunk of at most 'maxFrames' resampled frames for a sink reading 'rbuf': pending
+ * output first, else fresh input popped from the ring (consumed for good). Returns 0 once
+ * the ring is empty. Whatever the sink takes is then given back with AlsaDriftRelease.
+ */
+PUBLIC snd_pcm_uframes_t AlsaDriftPull(AlsaDriftT *drift, alsa_ringbuf_t *rbuf, snd_pcm_uframes_t maxFrames, const void **out) {
+    snd_pcm_uframes_t frames;
+
+    if (!maxFrames) return 0;
+
+    while (!(frames = DriftPending(drift, out))) {
+        const void *in;
+        snd_pcm_uframes_t consumed = 0;
+        snd_pcm_uframes_t avail = alsa_ringbuf_frames_pop_region(rbuf, &in);
+        if (!avail) return 0;
+
+        // may produce nothing while the interpolator history fills up, the whole region is then consumed
+        (void) AlsaDriftProcess(drift, in, avail, &consumed, maxFrames, out);
+        alsa_ringbuf_frames_pop_commit(rbuf, consumed);
+    }
+
+    return (frames > maxFrames) ? maxFrames : frames;
+}
+
+// 'frames' of pending output were accepted by the sink
+PUBLIC void AlsaDriftRelease(AlsaDriftT *drift, snd_pcm_uframes_t frames) {
+    drift->done += frames;
+    if (drift->done >= drift->produced)
+        drift->produced = drift->done = 0;
+}
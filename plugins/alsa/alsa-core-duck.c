@@ -0,0 +1,178 @@
+/*
+ * Copyright(C) 2018 "IoT.bzh"
+ * Author Fulup Ar Foll <fulup@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http : //www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Ducking: a zone may duck other zones while one of its streams plays. Rules
+ * are declared with the zone and evaluated by the native mix thread: every
+ * period it gates each stream on its RMS level, then fades the streams of
+ * ducked zones towards the rule gain, one gain step per sample. There is no
+ * API round trip, timer or control write on the way.
+ */
+
+#define _GNU_SOURCE  // needed for vasprintf
+
+#include "alsa-softmixer.h"
+#include <math.h>
+
+#define DUCK_DEFAULT_THRESHOLD_DB  -50.0
+#define DUCK_DEFAULT_HOLD_MS       200
+#define DUCK_DEFAULT_ATTACK_MS     30
+#define DUCK_DEFAULT_RELEASE_MS    500
+
+typedef struct {
+    const char *uid;        // ducked zone
+    AlsaSndZoneT *target;   // resolved once every zone is attached
+    float gain;
+    unsigned int attackMs;
+    unsigned int releaseMs;
+} AlsaDuckRuleT;
+
+struct AlsaDuckS {
+    float threshold;        // gate on mean square level
+    unsigned int holdMs;    // gate stays open that long after the level dropped
+    int count;
+    AlsaDuckRuleT *rules;
+};
+
+// "ducking": {"threshold_db": -50, "hold_ms": 200, "rules": [{"zone": "multimedia", "db": -20, "attack_ms": 30, "release_ms": 500}]}
+PUBLIC AlsaDuckT *AlsaDuckCreate(SoftMixerT *mixer, const char *uid, json_object *duckJ) {
+    AlsaDuckT *duck = calloc(1, sizeof (AlsaDuckT));
+    json_object *rulesJ = NULL;
+    double threshold = DUCK_DEFAULT_THRESHOLD_DB;
+    int hold = DUCK_DEFAULT_HOLD_MS;
+
+    int error = wrap_json_unpack(duckJ, "{s?F,s?i,so !}"
+            , "threshold_db", &threshold
+            , "hold_ms", &hold
+            , "rules", &rulesJ
+            );
+    if (error || hold < 0) {
+        AFB_ApiError(mixer->api, "%s: zone=%s ducking expect {'threshold_db','hold_ms','rules'} json=%s", __func__, uid, json_object_get_string(duckJ));
+        goto OnErrorExit;
+    }
+
+    duck->threshold = (float) pow(10.0, threshold / 10.0);
+    duck->holdMs = (unsigned int) hold;
+    duck->count = json_object_is_type(rulesJ, json_type_array) ? (int) json_object_array_length(rulesJ) : 1;
+    duck->rules = calloc(duck->count, sizeof (AlsaDuckRuleT));
+
+    for (int idx = 0; idx < duck->count; idx++) {
+        json_object *ruleJ = json_object_is_type(rulesJ, json_type_array) ? json_object_array_get_idx(rulesJ, idx) : rulesJ;
+        AlsaDuckRuleT *rule = &duck->rules[idx];
+        int attack = DUCK_DEFAULT_ATTACK_MS, release = DUCK_DEFAULT_RELEASE_MS;
+        double db;
+
+        error = wrap_json_unpack(ruleJ, "{ss,sF,s?i,s?i !}"
+                , "zone", &rule->uid
+                , "db", &db
+                , "attack_ms", &attack
+                , "release_ms", &release
+                );
+        if (error || db > 0.0 || attack < 0 || release < 0) {
+            AFB_ApiError(mixer->api, "%s: zone=%s rule expect {'zone','db'<=0,'attack_ms','release_ms'} json=%s", __func__, uid, json_object_get_string(ruleJ));
+            goto OnErrorExit;
+        }
+
+        rule->uid = strdup(rule->uid);
+        rule->gain = (float) pow(10.0, db / 20.0);
+        rule->attackMs = (unsigned int) attack;
+        rule->releaseMs = (unsigned int) release;
+
+        AFB_ApiNotice(mixer->api, "%s: zone=%s ducks zone=%s by %.1fdB attack=%dms release=%dms", __func__, uid, rule->uid, db, attack, release);
+    }
+
+    return duck;
+
+OnErrorExit:
+    AlsaDuckFree(duck);
+    return NULL;
+}
+
+PUBLIC void AlsaDuckFree(AlsaDuckT *duck) {
+    if (!duck) return;
+    for (int idx = 0; idx < duck->count; idx++)
+        free((char*) duck->rules[idx].uid);
+    free(duck->rules);
+    free(duck);
+}
+
+// zones may be attached in any order, rules are bound to their target zone after each zone attach
+PUBLIC void AlsaDuckResolve(SoftMixerT *mixer) {
+    for (int zdx = 0; mixer->zones[zdx]; zdx++) {
+        AlsaDuckT *duck = mixer->zones[zdx]->duck;
+
+        for (int idx = 0; duck && idx < duck->count; idx++) {
+            AlsaDuckRuleT *rule = &duck->rules[idx];
+
+            for (int tdx = 0; !rule->target && mixer->zones[tdx]; tdx++) {
+                if (!strcasecmp(mixer->zones[tdx]->uid, rule->uid)) rule->target = mixer->zones[tdx];
+            }
+        }
+    }
+}
+
+// audio side: stream activity from one period (float32 samples), *hold counts down the frames left before the gate closes
+PUBLIC bool AlsaDuckGate(const AlsaDuckT *duck, const float *samples, size_t count, snd_pcm_uframes_t frames,
+                         unsigned int rate, snd_pcm_uframes_t *hold) {
+    float sum = 0.0f;
+
+    for (size_t idx = 0; idx < count; idx++)
+        sum += samples[idx] * samples[idx];
+
+    if (count && sum >= duck->threshold * (float) count) {
+        *hold = (snd_pcm_uframes_t) duck->holdMs * rate / 1000;
+        return true;
+    }
+
+    *hold = (*hold > frames) ? *hold - frames : 0;
+    return (*hold > 0);
+}
+
+// audio side: strongest rule of an active zone 'duck' over zone 'target', false when it does not duck it
+PUBLIC bool AlsaDuckRule(const AlsaDuckT *duck, const AlsaSndZoneT *target, float *gain, unsigned int *attackMs, unsigned int *releaseMs) {
+    bool found = false;
+
+    for (int idx = 0; idx < duck->count; idx++) {
+        const AlsaDuckRuleT *rule = &duck->rules[idx];
+        if (rule->target != target || rule->gain >= *gain) continue;
+
+        *gain = rule->gain;
+        *attackMs = rule->attackMs;
+        *releaseMs = rule->releaseMs;
+        found = true;
+    }
+    return found;
+}
+
+// one pole smoothing coefficient reaching ~63% of a gain step after 'ms'
+PUBLIC float AlsaDuckCoef(unsigned int ms, unsigned int rate) {
+    if (!ms || !rate) return 0.0f;
+    return expf(-1000.0f / ((float) ms * (float) rate));
+}
+
+// audio side: fade 'buf' (float32, interleaved) from *gain towards 'target', one gain step per frame
+PUBLIC void AlsaDuckApply(float *restrict buf, unsigned int channels, snd_pcm_uframes_t frames, float *gain, float target, float coef) {
+    float value = *gain;
+
+    for (snd_pcm_uframes_t fdx = 0; fdx < frames; fdx++) {
+        value = target + (value - target) * coef;
+        for (unsigned int cdx = 0; cdx < channels; cdx++)
+            buf[fdx * channels + cdx] *= value;
+    }
+
+    // settle on the target instead of approaching it forever
+    if (fabsf(value - target) < 1e-5f) value = target;
+    *gain = value;
+}
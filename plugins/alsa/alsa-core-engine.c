@@ -0,0 +1,368 @@
+/*
+ * Copyright(C) 2018 "IoT.bzh"
+ * Author Fulup Ar Foll <fulup@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http : //www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Shared copy engine: instead of two threads per stream, streams are spread
+ * over a small pool of workers (one per CPU by default). Each worker waits on a
+ * single epoll set holding the capture and mute fds of all its streams, then
+ * services capture and playback of ready streams in attach order.
+ *
+ * Streams may be detached at runtime: the worker holds its lock while it
+ * services a batch of events, a detached slot becomes a hole reused by the next
+ * attach. Epoll keys carry the slot generation so that an event fetched before
+ * a detach is never applied to the next stream of the same slot.
+ */
+
+#define _GNU_SOURCE  // needed for vasprintf & CPU_SET
+
+#include "alsa-softmixer.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+
+#define ENGINE_EVENTS_MAX   32
+#define ENGINE_TIMEOUT_MSEC 10*1000
+
+// epoll user data: slot generation, slot index and fd kind
+#define ENGINE_KEY(gen, slot, isMute) (((uint64_t)(gen) << 32) | ((uint64_t)(slot) << 1) | (isMute))
+#define ENGINE_KEY_GEN(key) ((uint32_t)((key) >> 32))
+#define ENGINE_KEY_SLOT(key) ((int)(((key) & 0xFFFFFFFF) >> 1))
+#define ENGINE_KEY_MUTE(key) ((int)((key) & 1))
+#define ENGINE_KEY_STOP UINT64_MAX  // worker stop eventfd, never a slot key
+
+typedef struct {
+    AlsaPcmCopyHandleT *copy;   // NULL when slot is free
+    uint32_t gen;
+    bool muted;
+    bool ready;
+} AlsaCopyEngineSlotT;
+
+typedef struct {
+    int index;
+    int epfd;
+    int stopFd;
+    int tid;
+    bool started;
+    atomic_bool stop;
+    pthread_t thread;
+    AFB_ApiT api;
+    atomic_int count;   // slots in use, holes included
+    atomic_int active;  // attached streams
+    int max;
+    AlsaCopyEngineSlotT *slots;
+    pthread_mutex_t lock;  // held by worker while servicing, priority inheritance
+} AlsaCopyWorkerT;
+
+struct AlsaCopyEngineS {
+    int count;
+    AlsaCopyWorkerT *workers;
+};
+
+STATIC void EngineMute(AlsaCopyWorkerT *worker, AlsaCopyEngineSlotT *slot, bool mute) {
+    AlsaPcmCopyHandleT *copy = slot->copy;
+    struct epoll_event event = {.events = 0, .data.u64 = ENGINE_KEY(slot->gen, slot - worker->slots, 0)};
+
+    slot->muted = mute;
+
+    // a muted stream is deaf, its capture fd stays in the set without any events
+    if (!mute) {
+        event.events = EPOLLIN;
+        snd_pcm_prepare(copy->pcmIn->handle);
+        snd_pcm_start(copy->pcmIn->handle);
+    }
+    epoll_ctl(worker->epfd, EPOLL_CTL_MOD, copy->pollFds[1].fd, &event);
+
+    ALSA_RT_LOG(worker->api, ALSA_LOG_NOTICE, "EngineMute: stream=%s capture mute=%ld", copy->info, mute, 0, 0);
+}
+
+STATIC void *EngineWorkerEntry(void *handle) {
+    AlsaCopyWorkerT *worker = (AlsaCopyWorkerT*) handle;
+    struct epoll_event events[ENGINE_EVENTS_MAX];
+
+    worker->tid = (int) syscall(SYS_gettid);
+    AFB_ApiNotice(worker->api, "%s: worker=%d/%d started", __func__, worker->index, worker->tid);
+
+    while (!atomic_load(&worker->stop)) {
+        int count = epoll_wait(worker->epfd, events, ENGINE_EVENTS_MAX, ENGINE_TIMEOUT_MSEC);
+        if (count < 0) {
+            if (errno != EINTR)
+                ALSA_RT_LOG(worker->api, ALSA_LOG_ERROR, "EngineWorkerEntry:%s worker=%ld epoll errno=%ld", "", worker->index, errno, 0);
+            continue;
+        }
+
+        if (count == 0) {
+            ALSA_RT_LOG(worker->api, ALSA_LOG_DEBUG, "EngineWorkerEntry:%s worker=%ld alive, streams=%ld", "", worker->index, atomic_load(&worker->active), 0);
+            continue;
+        }
+
+        // detach waits for the current batch to complete
+        pthread_mutex_lock(&worker->lock);
+
+        // 1st pass: flag ready streams and process un/mute orders
+        for (int idx = 0; idx < count; idx++) {
+            if (events[idx].data.u64 == ENGINE_KEY_STOP)
+                continue;
+
+            AlsaCopyEngineSlotT *slot = &worker->slots[ENGINE_KEY_SLOT(events[idx].data.u64)];
+
+            // stale event of a detached stream
+            if (!slot->copy || slot->gen != ENGINE_KEY_GEN(events[idx].data.u64))
+                continue;
+
+            if (ENGINE_KEY_MUTE(events[idx].data.u64)) {
+                bool mute;
+                ssize_t ret = read(slot->copy->pollFds[0].fd, &mute, sizeof (mute));
+                if (ret > 0 && mute != slot->muted)
+                    EngineMute(worker, slot, mute);
+                continue;
+            }
+
+            if (slot->muted)
+                continue;
+
+            unsigned short revents;
+            struct pollfd *framePfd = &slot->copy->pollFds[1];
+            framePfd->revents = (short) events[idx].events;
+            if (snd_pcm_poll_descriptors_revents(slot->copy->pcmIn->handle, framePfd, 1, &revents) == -ENODEV)
+                continue;
+
+            if (framePfd->revents & POLLHUP) {
+                ALSA_RT_LOG(worker->api, ALSA_LOG_NOTICE, "EngineWorkerEntry: stream=%s frame POLLHUP", slot->copy->info, 0, 0, 0);
+                continue;
+            }
+            slot->ready = true;
+        }
+
+        // 2nd pass: service streams in attach order to keep a deterministic processing order
+        int scount = atomic_load_explicit(&worker->count, memory_order_acquire);
+        for (int idx = 0; idx < scount; idx++) {
+            AlsaCopyEngineSlotT *slot = &worker->slots[idx];
+            if (!slot->ready)
+                continue;
+
+            slot->ready = false;
+            AlsaPcmReadCB(&slot->copy->pollFds[1], slot->copy);
+            if (slot->copy->pcmOut)
+                AlsaPcmWriteCB(slot->copy);
+        }
+
+        pthread_mutex_unlock(&worker->lock);
+    }
+
+    pthread_exit(0);
+    return NULL;
+}
+
+// failed creation: started workers are stopped, everything else released
+STATIC void EngineFree(AlsaCopyEngineT *engine) {
+    for (int idx = 0; idx < engine->count; idx++) {
+        AlsaCopyWorkerT *worker = &engine->workers[idx];
+
+        if (worker->started) {
+            atomic_store(&worker->stop, true);
+            eventfd_write(worker->stopFd, 1);
+            pthread_join(worker->thread, NULL);
+        }
+        if (worker->epfd >= 0) close(worker->epfd);
+        if (worker->stopFd >= 0) close(worker->stopFd);
+        free(worker->slots);
+        pthread_mutex_destroy(&worker->lock);
+    }
+    free(engine->workers);
+    free(engine);
+}
+
+STATIC AlsaCopyEngineT *EngineCreate(SoftMixerT *mixer) {
+    AlsaCopyEngineT *engine = calloc(1, sizeof (AlsaCopyEngineT));
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int error;
+
+    if (cpus < 1)
+        cpus = 1;
+
+    engine->count = (mixer->engine.workers > 0) ? mixer->engine.workers : (int) cpus;
+    engine->workers = calloc(engine->count, sizeof (AlsaCopyWorkerT));
+
+    // every worker lock and fd is set first, so that EngineFree only releases what was opened
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    for (int idx = 0; idx < engine->count; idx++) {
+        engine->workers[idx].epfd = -1;
+        engine->workers[idx].stopFd = -1;
+        pthread_mutex_init(&engine->workers[idx].lock, &attr);
+    }
+    pthread_mutexattr_destroy(&attr);
+
+    for (int idx = 0; idx < engine->count; idx++) {
+        AlsaCopyWorkerT *worker = &engine->workers[idx];
+
+        worker->index = idx;
+        worker->api = mixer->api;
+        worker->max = mixer->max.streams;
+        worker->slots = calloc(worker->max, sizeof (AlsaCopyEngineSlotT));
+        atomic_init(&worker->count, 0);
+        atomic_init(&worker->active, 0);
+        atomic_init(&worker->stop, false);
+
+        worker->epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (worker->epfd < 0) {
+            AFB_ApiError(mixer->api, "%s: worker=%d fail to create epoll err=%s", __func__, idx, strerror(errno));
+            goto OnErrorExit;
+        }
+
+        struct epoll_event stopEvent = {.events = EPOLLIN, .data.u64 = ENGINE_KEY_STOP};
+        worker->stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (worker->stopFd < 0 || epoll_ctl(worker->epfd, EPOLL_CTL_ADD, worker->stopFd, &stopEvent) < 0) {
+            AFB_ApiError(mixer->api, "%s: worker=%d fail to create stop eventfd err=%s", __func__, idx, strerror(errno));
+            goto OnErrorExit;
+        }
+
+        if ((error = pthread_create(&worker->thread, NULL, &EngineWorkerEntry, worker)) != 0) {
+            AFB_ApiError(mixer->api, "%s: worker=%d fail to create thread err=%d", __func__, idx, error);
+            goto OnErrorExit;
+        }
+        worker->started = true;
+
+        // pin each worker on its own CPU and give it audio priority
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(idx % cpus, &cpuset);
+        error = pthread_setaffinity_np(worker->thread, sizeof (cpuset), &cpuset);
+        if (error) {
+            AFB_ApiWarning(mixer->api, "%s: worker=%d fail to set cpu affinity err=%s", __func__, idx, strerror(error));
+        }
+
+        AlsaPcmThreadPriority(mixer, worker->thread, "copy engine");
+    }
+
+    AFB_ApiNotice(mixer->api, "%s: mixer=%s copy engine started with %d worker(s)", __func__, mixer->uid, engine->count);
+    return engine;
+
+OnErrorExit:
+    EngineFree(engine);
+    return NULL;
+}
+
+// Scheduler: least loaded worker, first one on equality
+STATIC AlsaCopyWorkerT *EngineSelectWorker(AlsaCopyEngineT *engine) {
+    AlsaCopyWorkerT *selected = &engine->workers[0];
+
+    for (int idx = 1; idx < engine->count; idx++) {
+        if (atomic_load(&engine->workers[idx].active) < atomic_load(&selected->active))
+            selected = &engine->workers[idx];
+    }
+    return selected;
+}
+
+// engine is created on first use, parallel stream startup creates it before starting any copy
+PUBLIC int AlsaCopyEnginePrepare(SoftMixerT *mixer) {
+    if (!mixer->engine.handle) mixer->engine.handle = EngineCreate(mixer);
+    return mixer->engine.handle ? 0 : -1;
+}
+
+PUBLIC int AlsaCopyEngineAttach(SoftMixerT *mixer, AlsaPcmCopyHandleT *pcmCopyHandle) {
+    struct epoll_event event;
+    AlsaCopyWorkerT *worker;
+    AlsaCopyEngineSlotT *slot;
+
+    if (AlsaCopyEnginePrepare(mixer)) goto OnErrorExit;
+
+    worker = EngineSelectWorker(mixer->engine.handle);
+    pthread_mutex_lock(&worker->lock);
+
+    // reuse the first hole left by a detached stream, else append
+    int slotIdx, count = atomic_load(&worker->count);
+    for (slotIdx = 0; slotIdx < count; slotIdx++) {
+        if (!worker->slots[slotIdx].copy) break;
+    }
+    if (slotIdx >= worker->max) {
+        pthread_mutex_unlock(&worker->lock);
+        AFB_ApiError(mixer->api, "%s: worker=%d too many streams max=%d", __func__, worker->index, worker->max);
+        goto OnErrorExit;
+    }
+
+    slot = &worker->slots[slotIdx];
+    slot->copy = pcmCopyHandle;
+    slot->muted = pcmCopyHandle->pcmIn->mute;
+    slot->ready = false;
+    slot->gen++;
+
+    // publish the slot before any of its fds may wake up the worker
+    if (slotIdx == count) atomic_store_explicit(&worker->count, slotIdx + 1, memory_order_release);
+    atomic_fetch_add(&worker->active, 1);
+    pthread_mutex_unlock(&worker->lock);
+
+    event.events = EPOLLIN;
+    event.data.u64 = ENGINE_KEY(slot->gen, slotIdx, 1);
+    if (epoll_ctl(worker->epfd, EPOLL_CTL_ADD, pcmCopyHandle->pollFds[0].fd, &event) < 0) {
+        AFB_ApiError(mixer->api, "%s: worker=%d fail to add mute fd err=%s", __func__, worker->index, strerror(errno));
+        goto OnSlotError;
+    }
+
+    event.events = slot->muted ? 0 : EPOLLIN;
+    event.data.u64 = ENGINE_KEY(slot->gen, slotIdx, 0);
+    if (epoll_ctl(worker->epfd, EPOLL_CTL_ADD, pcmCopyHandle->pollFds[1].fd, &event) < 0) {
+        AFB_ApiError(mixer->api, "%s: worker=%d fail to add capture fd err=%s", __func__, worker->index, strerror(errno));
+        epoll_ctl(worker->epfd, EPOLL_CTL_DEL, pcmCopyHandle->pollFds[0].fd, NULL);
+        goto OnSlotError;
+    }
+
+    AFB_ApiNotice(mixer->api, "%s: stream attached to worker=%d slot=%d", __func__, worker->index, slotIdx);
+    return 0;
+
+OnSlotError:
+    // the handle goes back to the pool, the slot must not point to it anymore
+    pthread_mutex_lock(&worker->lock);
+    slot->copy = NULL;
+    slot->ready = false;
+    atomic_fetch_sub(&worker->active, 1);
+    pthread_mutex_unlock(&worker->lock);
+OnErrorExit:
+    return -1;
+}
+
+// once returned, no worker touches the copy handle anymore
+PUBLIC int AlsaCopyEngineDetach(SoftMixerT *mixer, AlsaPcmCopyHandleT *pcmCopyHandle) {
+    AlsaCopyEngineT *engine = mixer->engine.handle;
+
+    for (int wdx = 0; engine && wdx < engine->count; wdx++) {
+        AlsaCopyWorkerT *worker = &engine->workers[wdx];
+        int count = atomic_load(&worker->count);
+
+        for (int idx = 0; idx < count; idx++) {
+            AlsaCopyEngineSlotT *slot = &worker->slots[idx];
+            if (slot->copy != pcmCopyHandle) continue;
+
+            epoll_ctl(worker->epfd, EPOLL_CTL_DEL, pcmCopyHandle->pollFds[0].fd, NULL);
+            epoll_ctl(worker->epfd, EPOLL_CTL_DEL, pcmCopyHandle->pollFds[1].fd, NULL);
+
+            pthread_mutex_lock(&worker->lock);
+            slot->copy = NULL;
+            slot->ready = false;
+            atomic_fetch_sub(&worker->active, 1);
+            pthread_mutex_unlock(&worker->lock);
+
+            AFB_ApiNotice(mixer->api, "%s: stream=%s detached from worker=%d slot=%d", __func__, pcmCopyHandle->info, worker->index, idx);
+            return 0;
+        }
+    }
+
+    AFB_ApiError(mixer->api, "%s: stream=%s not attached to copy engine", __func__, pcmCopyHandle->info);
+    return -1;
+}
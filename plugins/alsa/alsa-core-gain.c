@@ -0,0 +1,175 @@
+/*
+ * Copyright(C) 2018 "IoT.bzh"
+ * Author Fulup Ar Foll <fulup@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http : //www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * In process stream gain: replaces the softvol plugin when mixer 'volume' is
+ * "native". Frames are scaled in place by the capture thread right after they
+ * land in the copy ring. Gain changes are interpolated per sample, so neither
+ * volume changes nor ramps produce zipper noise.
+ */
+
+#define _GNU_SOURCE  // needed for vasprintf
+
+#include "alsa-softmixer.h"
+#include <math.h>
+#include <stdatomic.h>
+
+#define GAIN_MIN_DB       -51.0   // same range as alsa softvol default
+#define GAIN_SMOOTH_USEC  10000   // default transition when volume ctl changes
+#define GAIN_CHUNK_FRAMES 256     // float conversion chunk, stays in L1
+
+struct AlsaGainS {
+    snd_pcm_format_t format;
+    unsigned int channels;
+    unsigned int rate;
+
+    // control side: target gain (float bits, high word) + ramp frames (low word)
+    atomic_ullong order;
+    unsigned long long applied;
+
+    // audio side
+    float current;
+    float step;
+    snd_pcm_uframes_t remain;
+    float *fbuf;    // GAIN_CHUNK_FRAMES frames in float32
+};
+
+// volume in % (0-100) to linear gain, on softvol dB scale with 0% as mute
+STATIC float GainFromVolume(long volume) {
+    if (volume <= 0) return 0.0f;
+    if (volume >= 100) return 1.0f;
+    return (float) pow(10.0, (GAIN_MIN_DB * (1.0 - (double) volume / 100.0)) / 20.0);
+}
+
+STATIC unsigned long long GainPackOrder(float target, uint32_t frames) {
+    uint32_t bits;
+    memcpy(&bits, &target, sizeof (bits));
+    return ((unsigned long long) bits << 32) | frames;
+}
+
+// flat loop without carried dependency, so that the compiler emits SIMD code
+STATIC void GainFloat(float *buf, size_t frames, unsigned int channels, float gain, float step) {
+    for (size_t fdx = 0; fdx < frames; fdx++) {
+        float g = gain + step * (float) fdx;
+        for (unsigned int cdx = 0; cdx < channels; cdx++)
+            buf[fdx * channels + cdx] *= g;
+    }
+}
+
+// integer formats go through the float32 internal format, one chunk at a time
+STATIC void GainKernel(AlsaGainT *gain, void *buf, snd_pcm_uframes_t frames, float start, float step) {
+
+    if (gain->format == SND_PCM_FORMAT_FLOAT_LE) {
+        GainFloat(buf, frames, gain->channels, start, step);
+        return;
+    }
+
+    size_t frameSize = (snd_pcm_format_physical_width(gain->format) / 8) * gain->channels;
+    while (frames > 0) {
+        snd_pcm_uframes_t count = frames < GAIN_CHUNK_FRAMES ? frames : GAIN_CHUNK_FRAMES;
+        size_t samples = count * gain->channels;
+
+        AlsaConvertToFloat(gain->format, buf, gain->fbuf, samples);
+        GainFloat(gain->fbuf, count, gain->channels, start, step);
+        AlsaConvertFromFloat(gain->format, gain->fbuf, buf, samples);
+
+        buf = (char*) buf + count * frameSize;
+        start += step * (float) count;
+        frames -= count;
+    }
+}
+
+PUBLIC AlsaGainT *AlsaGainCreate(SoftMixerT *mixer, AlsaPcmHwInfoT *params, long volume) {
+
+    if (!AlsaConvertSupported(params->format)) {
+        AFB_ApiError(mixer->api, "%s: native volume supports S16_LE|S24_LE|S24_3LE|S32_LE|FLOAT_LE only format=%d", __func__, params->format);
+        return NULL;
+    }
+
+    AlsaGainT *gain = calloc(1, sizeof (AlsaGainT));
+    gain->fbuf = malloc(GAIN_CHUNK_FRAMES * params->channels * sizeof (float));
+    gain->format = params->format;
+    gain->channels = params->channels;
+    gain->rate = params->rate;
+    gain->current = GainFromVolume(volume);
+    gain->applied = GainPackOrder(gain->current, 0);
+    atomic_init(&gain->order, gain->applied);
+    return gain;
+}
+
+PUBLIC void AlsaGainFree(AlsaGainT *gain) {
+    if (!gain) return;
+    free(gain->fbuf);
+    free(gain);
+}
+
+// control side, any thread: move to volume (%) within 'rampUsec' (0 for default smoothing)
+PUBLIC void AlsaGainSetVolume(AlsaGainT *gain, long volume, unsigned int rampUsec) {
+    unsigned long long order = atomic_load_explicit(&gain->order, memory_order_relaxed);
+    float target = GainFromVolume(volume);
+
+    // ctl echo of a ramp already in progress
+    if (rampUsec == 0 && GainPackOrder(target, 0) >> 32 == order >> 32)
+        return;
+
+    if (rampUsec == 0) rampUsec = GAIN_SMOOTH_USEC;
+    uint32_t frames = (uint32_t) ((unsigned long long) rampUsec * gain->rate / 1000000);
+    if (frames == 0) frames = 1;
+
+    atomic_store_explicit(&gain->order, GainPackOrder(target, frames), memory_order_release);
+}
+
+// audio side, capture thread only: scale frames in place
+PUBLIC void AlsaGainApply(AlsaGainT *gain, void *buf, snd_pcm_uframes_t frames) {
+    unsigned long long order = atomic_load_explicit(&gain->order, memory_order_acquire);
+
+    // new order: start a linear transition from current gain
+    if (order != gain->applied) {
+        uint32_t bits = (uint32_t) (order >> 32);
+        float target;
+        memcpy(&target, &bits, sizeof (target));
+
+        gain->applied = order;
+        gain->remain = (snd_pcm_uframes_t) (order & 0xFFFFFFFF);
+        gain->step = (target - gain->current) / (float) gain->remain;
+    }
+
+    // transition part
+    if (gain->remain > 0) {
+        snd_pcm_uframes_t count = frames < gain->remain ? frames : gain->remain;
+        GainKernel(gain, buf, count, gain->current, gain->step);
+        gain->remain -= count;
+        gain->current += gain->step * (float) count;
+
+        // land exactly on target
+        if (gain->remain == 0) {
+            uint32_t bits = (uint32_t) (gain->applied >> 32);
+            memcpy(&gain->current, &bits, sizeof (gain->current));
+        }
+
+        buf = (char*) buf + count * (snd_pcm_format_physical_width(gain->format) / 8) * gain->channels;
+        frames -= count;
+    }
+
+    // steady part, unity gain leaves samples untouched
+    if (frames > 0 && gain->current != 1.0f)
+        GainKernel(gain, buf, frames, gain->current, 0.0f);
+}
+
+// audio side: true when AlsaGainApply would leave frames untouched (no pending order, no transition)
+PUBLIC bool AlsaGainIsUnity(AlsaGainT *gain) {
+    unsigned long long order = atomic_load_explicit(&gain->order, memory_order_acquire);
+    return order == gain->applied && gain->remain == 0 && gain->current == 1.0f;
+}
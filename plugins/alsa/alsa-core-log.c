@@ -0,0 +1,170 @@
+/*
+ * Copyright(C) 2018 "IoT.bzh"
+ * Author Fulup Ar Foll <fulup@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http : //www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Real time safe logging: audio threads never format nor write a log line.
+ * ALSA_RT_LOG copies a fixed size record (call site, tag, 3 integers) into a
+ * bounded lock-free queue, a timer on the mixer main loop formats and emits
+ * them. Each call site emits at most once per ALSA_LOG_SITE_INTERVAL_MS,
+ * skipped messages are counted and reported with the next one.
+ */
+
+#define _GNU_SOURCE  // needed for vasprintf
+
+#include "alsa-softmixer.h"
+#include <stdatomic.h>
+
+#define LOG_QUEUE_SIZE      256      // power of 2
+#define LOG_DRAIN_USEC      100000   // main loop poll period
+#define LOG_LINE_MAX        256
+
+typedef struct {
+    atomic_size_t seq;
+    AlsaLogSiteT *site;
+    AFB_ApiT api;
+    unsigned int suppressed;
+    char tag[ALSA_LOG_TAG_MAX];
+    long args[3];
+} AlsaLogRecordT;
+
+// bounded multi-producer queue, slots carry a sequence number (D. Vyukov)
+STATIC struct {
+    AlsaLogRecordT records[LOG_QUEUE_SIZE];
+    atomic_size_t tail;
+    size_t head;          // main loop only
+    atomic_uint dropped;  // queue full
+    atomic_bool ready;
+    AFB_ApiT api;
+    sd_event_source *evtsrc;
+} logQueue;
+
+STATIC void LogQueueInit(void) {
+    for (size_t idx = 0; idx < LOG_QUEUE_SIZE; idx++)
+        atomic_init(&logQueue.records[idx].seq, idx);
+}
+
+// audio side, any thread: no lock, no allocation, no syscall (vdso clock only)
+PUBLIC void AlsaLogPush(AlsaLogSiteT *site, AFB_ApiT api, const char *tag, long arg0, long arg1, long arg2) {
+
+    // records pushed before the queue exists have no slot to go to
+    if (!atomic_load_explicit(&logQueue.ready, memory_order_acquire)) return;
+
+    // rate limit per call site, concurrent threads on the same site race for one slot
+    unsigned long long now = AlsaStatsNow();
+    unsigned long long last = atomic_load_explicit(&site->lastNs, memory_order_relaxed);
+    if ((last && now - last < (unsigned long long) ALSA_LOG_SITE_INTERVAL_MS * 1000000)
+            || !atomic_compare_exchange_strong_explicit(&site->lastNs, &last, now, memory_order_relaxed, memory_order_relaxed)) {
+        atomic_fetch_add_explicit(&site->suppressed, 1, memory_order_relaxed);
+        return;
+    }
+
+    AlsaLogRecordT *record;
+    size_t pos = atomic_load_explicit(&logQueue.tail, memory_order_relaxed);
+    for (;;) {
+        record = &logQueue.records[pos & (LOG_QUEUE_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&record->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&logQueue.tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            atomic_fetch_add_explicit(&logQueue.dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&logQueue.tail, memory_order_relaxed);
+        }
+    }
+
+    record->site = site;
+    record->api = api;
+    record->suppressed = atomic_exchange_explicit(&site->suppressed, 0, memory_order_relaxed);
+    record->args[0] = arg0;
+    record->args[1] = arg1;
+    record->args[2] = arg2;
+
+    // tag may not outlive the caller, copy it
+    size_t len = 0;
+    if (tag) for (; len < sizeof (record->tag) - 1 && tag[len]; len++) record->tag[len] = tag[len];
+    record->tag[len] = '\0';
+
+    atomic_store_explicit(&record->seq, pos + 1, memory_order_release);
+}
+
+STATIC void LogEmit(AFB_ApiT api, AlsaLogLevelT level, const char *line) {
+    switch (level) {
+        case ALSA_LOG_ERROR: AFB_ApiError(api, "%s", line); break;
+        case ALSA_LOG_WARNING: AFB_ApiWarning(api, "%s", line); break;
+        case ALSA_LOG_NOTICE: AFB_ApiNotice(api, "%s", line); break;
+        case ALSA_LOG_INFO: AFB_ApiInfo(api, "%s", line); break;
+        default: AFB_ApiDebug(api, "%s", line); break;
+    }
+}
+
+// main loop side: format and emit every published record
+PUBLIC int AlsaLogDrain(void) {
+    int count = 0;
+
+    for (;;) {
+        AlsaLogRecordT *record = &logQueue.records[logQueue.head & (LOG_QUEUE_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&record->seq, memory_order_acquire);
+        if (seq != logQueue.head + 1) break;
+
+        char line[LOG_LINE_MAX];
+        int len = snprintf(line, sizeof (line), record->site->fmt, record->tag, record->args[0], record->args[1], record->args[2]);
+        if (record->suppressed && len >= 0 && (size_t) len < sizeof (line))
+            snprintf(line + len, sizeof (line) - len, " (%u similar suppressed)", record->suppressed);
+        LogEmit(record->api, record->site->level, line);
+
+        // hand the slot back to producers for next lap
+        atomic_store_explicit(&record->seq, logQueue.head + LOG_QUEUE_SIZE, memory_order_release);
+        logQueue.head++;
+        count++;
+    }
+
+    unsigned int dropped = atomic_exchange_explicit(&logQueue.dropped, 0, memory_order_relaxed);
+    if (dropped && logQueue.api)
+        AFB_ApiWarning(logQueue.api, "%s: log queue full, %u realtime records dropped", __func__, dropped);
+
+    return count;
+}
+
+STATIC int LogDrainTimerCB(sd_event_source* source, uint64_t timer, void* handle) {
+    (void) AlsaLogDrain();
+    sd_event_source_set_time(source, timer + LOG_DRAIN_USEC);
+    sd_event_source_set_enabled(source, SD_EVENT_ON);
+    return 0;
+}
+
+// queue is process wide, the first mixer drains it from its main loop
+PUBLIC int AlsaLogStart(SoftMixerT *mixer) {
+    uint64_t usec;
+    int error;
+
+    if (logQueue.evtsrc) return 0;
+
+    LogQueueInit();
+    logQueue.api = mixer->api;
+
+    sd_event_now(mixer->sdLoop, CLOCK_MONOTONIC, &usec);
+    error = sd_event_add_time(mixer->sdLoop, &logQueue.evtsrc, CLOCK_MONOTONIC, usec + LOG_DRAIN_USEC, LOG_DRAIN_USEC / 2, LogDrainTimerCB, NULL);
+    if (error < 0) {
+        AFB_ApiError(mixer->api, "%s: fail to add log drain timer error=%s", __func__, strerror(-error));
+        return -1;
+    }
+
+    atomic_store_explicit(&logQueue.ready, true, memory_order_release);
+    return 0;
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright(C) 2018 "IoT.bzh"
+ * Author Fulup Ar Foll <fulup@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http : //www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Channel matrix: native mixing replacement of the route plugin ttable. Each
+ * cell holds the gain from one stream (zone) channel to one mix channel.
+ * Matrices are immutable once built, a change builds a new one that the mix
+ * thread picks up between two periods. At build time the matrix selects a
+ * kernel specialised for its shape: identity, stereo to N, N to stereo,
+ * sparse (few non zero cells, e.g. channel subsets and swaps) or dense.
+ */
+
+#define _GNU_SOURCE  // needed for vasprintf
+
+#include "alsa-softmixer.h"
+
+typedef enum {
+    MATRIX_IDENTITY,
+    MATRIX_SPARSE,
+    MATRIX_2TON,
+    MATRIX_NTO2,
+    MATRIX_DENSE,
+} AlsaMatrixKernelT;
+
+STATIC const char *MatrixKernelNames[] = {"identity", "sparse", "2xN", "Nx2", "dense"};
+
+typedef struct {
+    unsigned int in;
+    unsigned int out;
+    float gain;
+} AlsaMatrixCellT;
+
+struct AlsaMatrixS {
+    unsigned int inputs;
+    unsigned int outputs;
+    AlsaMatrixKernelT kernel;
+    float *gains;           // [in * outputs + out]
+    float *columns;         // [out * inputs + in], N to stereo kernel
+    int ncells;
+    AlsaMatrixCellT *cells; // non zero cells, sparse kernel
+};
+
+// the following kernels accumulate 'frames' frames of 'in' into 'acc' (matrix outputs interleaved),
+// written as flat loops over constant strides so that the compiler emits SIMD code
+
+STATIC void MatrixIdentity(const AlsaMatrixT *matrix, float *restrict acc, const float *restrict in, snd_pcm_uframes_t frames) {
+    size_t count = frames * matrix->outputs;
+    for (size_t idx = 0; idx < count; idx++)
+        acc[idx] += in[idx];
+}
+
+STATIC void MatrixSparse(const AlsaMatrixT *matrix, float *restrict acc, const float *restrict in, snd_pcm_uframes_t frames) {
+    const unsigned int inputs = matrix->inputs, outputs = matrix->outputs;
+
+    for (int cdx = 0; cdx < matrix->ncells; cdx++) {
+        const AlsaMatrixCellT cell = matrix->cells[cdx];
+        for (snd_pcm_uframes_t fdx = 0; fdx < frames; fdx++)
+            acc[fdx * outputs + cell.out] += in[fdx * inputs + cell.in] * cell.gain;
+    }
+}
+
+STATIC void Matrix2toN(const AlsaMatrixT *matrix, float *restrict acc, const float *restrict in, snd_pcm_uframes_t frames) {
+    const unsigned int outputs = matrix->outputs;
+    const float *left = &matrix->gains[0], *right = &matrix->gains[outputs];
+
+    for (snd_pcm_uframes_t fdx = 0; fdx < frames; fdx++) {
+        float l = in[2 * fdx], r = in[2 * fdx + 1];
+        for (unsigned int odx = 0; odx < outputs; odx++)
+            acc[fdx * outputs + odx] += l * left[odx] + r * right[odx];
+    }
+}
+
+STATIC void MatrixNto2(const AlsaMatrixT *matrix, float *restrict acc, const float *restrict in, snd_pcm_uframes_t frames) {
+    const unsigned int inputs = matrix->inputs;
+    const float *left = &matrix->columns[0], *right = &matrix->columns[inputs];
+
+    for (snd_pcm_uframes_t fdx = 0; fdx < frames; fdx++) {
+        float l = 0.0f, r = 0.0f;
+        for (unsigned int idx = 0; idx < inputs; idx++) {
+            l += in[fdx * inputs + idx] * left[idx];
+            r += in[fdx * inputs + idx] * right[idx];
+        }
+        acc[2 * fdx] += l;
+        acc[2 * fdx + 1] += r;
+    }
+}
+
+STATIC void MatrixDense(const AlsaMatrixT *matrix, float *restrict acc, const float *restrict in, snd_pcm_uframes_t frames) {
+    const unsigned int inputs = matrix->inputs, outputs = matrix->outputs;
+
+    for (snd_pcm_uframes_t fdx = 0; fdx < frames; fdx++) {
+        for (unsigned int idx = 0; idx < inputs; idx++) {
+            float sample = in[fdx * inputs + idx];
+            const float *row = &matrix->gains[idx * outputs];
+            for (unsigned int odx = 0; odx < outputs; odx++)
+                acc[fdx * outputs + odx] += sample * row[odx];
+        }
+    }
+}
+
+// audio side: accumulate stream frames (float32, matrix inputs interleaved) into the mix accumulator
+PUBLIC void AlsaMatrixApply(const AlsaMatrixT *matrix, float *acc, const float *in, snd_pcm_uframes_t frames) {
+    switch (matrix->kernel) {
+        case MATRIX_IDENTITY: MatrixIdentity(matrix, acc, in, frames); break;
+        case MATRIX_SPARSE: MatrixSparse(matrix, acc, in, frames); break;
+        case MATRIX_2TON: Matrix2toN(matrix, acc, in, frames); break;
+        case MATRIX_NTO2: MatrixNto2(matrix, acc, in, frames); break;
+        default: MatrixDense(matrix, acc, in, frames); break;
+    }
+}
+
+// 'gains' holds inputs x outputs cells (row per input), NULL for a silent matrix
+PUBLIC AlsaMatrixT *AlsaMatrixCreate(unsigned int inputs, unsigned int outputs, const float *gains) {
+    AlsaMatrixT *matrix = calloc(1, sizeof (AlsaMatrixT));
+    size_t count = (size_t) inputs * outputs;
+    bool identity = (inputs == outputs);
+
+    matrix->inputs = inputs;
+    matrix->outputs = outputs;
+    matrix->gains = calloc(count ? count : 1, sizeof (float));
+    matrix->columns = calloc(count ? count : 1, sizeof (float));
+    matrix->cells = calloc(count ? count : 1, sizeof (AlsaMatrixCellT));
+    if (gains) memcpy(matrix->gains, gains, count * sizeof (float));
+
+    for (unsigned int idx = 0; idx < inputs; idx++) {
+        for (unsigned int odx = 0; odx < outputs; odx++) {
+            float gain = matrix->gains[idx * outputs + odx];
+
+            matrix->columns[odx * inputs + idx] = gain;
+            if (gain != ((idx == odx) ? 1.0f : 0.0f)) identity = false;
+            if (gain == 0.0f) continue;
+
+            matrix->cells[matrix->ncells].in = idx;
+            matrix->cells[matrix->ncells].out = odx;
+            matrix->cells[matrix->ncells].gain = gain;
+            matrix->ncells++;
+        }
+    }
+
+    // sparse when each input feeds about one output (subset, swap, mono to one side)
+    if (identity) matrix->kernel = MATRIX_IDENTITY;
+    else if (matrix->ncells <= (int) (inputs > outputs ? inputs : outputs)) matrix->kernel = MATRIX_SPARSE;
+    else if (inputs == 2) matrix->kernel = MATRIX_2TON;
+    else if (outputs == 2) matrix->kernel = MATRIX_NTO2;
+    else matrix->kernel = MATRIX_DENSE;
+
+    return matrix;
+}
+
+// a copy of 'matrix' (or a silent one) with its gains, callers then update cells and build
+PUBLIC float *AlsaMatrixGains(const AlsaMatrixT *matrix, unsigned int inputs, unsigned int outputs) {
+    float *gains = calloc((size_t) inputs * outputs + 1, sizeof (float));
+
+    if (matrix && matrix->inputs == inputs && matrix->outputs == outputs)
+        memcpy(gains, matrix->gains, (size_t) inputs * outputs * sizeof (float));
+    return gains;
+}
+
+PUBLIC unsigned int AlsaMatrixInputs(const AlsaMatrixT *matrix) {
+    return matrix->inputs;
+}
+
+PUBLIC unsigned int AlsaMatrixOutputs(const AlsaMatrixT *matrix) {
+    return matrix->outputs;
+}
+
+PUBLIC const char *AlsaMatrixKernel(const AlsaMatrixT *matrix) {
+    return MatrixKernelNames[matrix->kernel];
+}
+
+PUBLIC void AlsaMatrixFree(AlsaMatrixT *matrix) {
+    if (!matrix) return;
+    free(matrix->gains);
+    free(matrix->columns);
+    free(matrix->cells);
+    free(matrix);
+}
+
+PUBLIC json_object *AlsaMatrixJson(const AlsaMatrixT *matrix) {
+    json_object *responseJ, *gainsJ = json_object_new_array();
+
+    for (unsigned int idx = 0; idx < matrix->inputs; idx++) {
+        json_object *rowJ = json_object_new_array();
+        for (unsigned int odx = 0; odx < matrix->outputs; odx++)
+            json_object_array_add(rowJ, json_object_new_double(matrix->gains[idx * matrix->outputs + odx]));
+        json_object_array_add(gainsJ, rowJ);
+    }
+
+    wrap_json_pack(&responseJ, "{si,si,ss,so}"
+            , "inputs", matrix->inputs
+            , "outputs", matrix->outputs
+            , "kernel", MatrixKernelNames[matrix->kernel]
+            , "gains", gainsJ
+            );
+    return responseJ;
+}
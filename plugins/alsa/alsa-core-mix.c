@@ -0,0 +1,657 @@
+/*
+ * Copyright(C) 2018 "IoT.bzh"
+ * Author Fulup Ar Foll <fulup@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http : //www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Native mixing: when mixer 'mixing' is "native", streams are no longer written
+ * through softvol/rate/route/dmix plugins. Each sink owns one real time thread
+ * that pops one period from every attached stream copy ring, converts it to the
+ * float32 internal format, applies zone ducking (alsa-core-duck.c), sums it into
+ * a float accumulator through the stream channel matrix, then saturates the
+ * result to the sink format and writes it to the hardware PCM. Streams may use
+ * any format known to alsa-core-convert.c, independently of their sink.
+ *
+ * Sinks linked by a multi-card zone share one mix: its channel space is the
+ * concatenation of every card channels. The first card is written by the mix
+ * thread, each other card gets its slice of the same period through a ring and
+ * is written by its own thread, drift compensation keeping it aligned.
+ *
+ * Streams asking for 'drift' compensation are read through their own resampler,
+ * which keeps their copy ring level, so the loop clock may differ from the sink
+ * one. A mix without streams stops its PCM and sleeps until one is attached.
+ */
+
+#define _GNU_SOURCE  // needed for vasprintf
+
+#include "alsa-softmixer.h"
+#include <pthread.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+
+#define MIX_TIMEOUT_MSEC 10*1000
+
+typedef struct {
+    AlsaSinkMixT *mix;
+    AlsaSndPcmT *sink;
+    AlsaPcmCtlT *pcm;
+    unsigned int offset;    // first card channel within mix channels
+    unsigned int channels;
+    size_t frameSize;
+    void *out;              // one period of this card frames
+
+    // following cards only
+    alsa_ringbuf_t *rbuf;   // mix thread -> card thread
+    AlsaDriftT *drift;
+    int wakeFd;             // mix thread -> card thread, one tick per pushed period
+    atomic_bool resync;     // ring overflowed, card thread restarts from an empty ring
+    atomic_ulong overruns;
+    bool started;
+    pthread_t thread;
+} AlsaMixCardT;
+
+typedef struct {
+    AlsaPcmCopyHandleT *copy;
+    unsigned int channels;
+    snd_pcm_format_t format;
+    AlsaMatrixT *matrix;  // stream channels x sink channels gains, zone matrix or own one
+    bool ownMatrix;
+    AlsaSndZoneT *zone;   // zone streams only, ducking rules
+    bool primed;     // ring held a full period at least once since last underflow
+    snd_pcm_uframes_t frames;  // popped this period
+    bool active;     // ducking gate open
+    snd_pcm_uframes_t hold;
+    float duck;      // current ducking gain, 1.0 when not ducked
+    unsigned int releaseMs;
+    void *scratch;   // one period of stream frames
+    float *fscratch; // same period in float32
+} AlsaMixInputT;
+
+struct AlsaSinkMixS {
+    AlsaSndPcmT *sink;
+    AlsaPcmCtlT *pcm;
+    AFB_ApiT api;
+    snd_pcm_format_t format;
+    unsigned int channels;
+    size_t frameSize;
+    snd_pcm_uframes_t period;
+    unsigned int rate;
+    float *acc;
+    void *out;
+
+    int max;
+    atomic_int count;
+    AlsaMixInputT *inputs;
+    pthread_mutex_t lock;  // held by mix thread for one period, priority inheritance
+    pthread_cond_t wake;   // signaled when a stream attaches to an idle mix
+    atomic_bool stop;      // card threads exit, failed mix creation only
+
+    int ncards;            // 1 unless sinks are linked by a multi-card zone
+    AlsaMixCardT *cards;   // cards[0] is written by the mix thread
+
+    pthread_t thread;
+    int tid;
+};
+
+// one period of a drift compensated stream: its resampler keeps the copy ring level where it settled
+STATIC snd_pcm_uframes_t MixDriftPop(AlsaSinkMixT *mix, AlsaMixInputT *input) {
+    AlsaDriftT *drift = input->copy->drift;
+    alsa_ringbuf_t *rbuf = input->copy->rbuf;
+    size_t frameSize = input->copy->frame_size;
+    snd_pcm_uframes_t done = 0;
+
+    AlsaDriftUpdate(drift, (snd_pcm_sframes_t) alsa_ringbuf_frames_used(rbuf));
+
+    while (done < mix->period) {
+        const void *buf;
+        snd_pcm_uframes_t frames = AlsaDriftPull(drift, rbuf, mix->period - done, &buf);
+        if (!frames) break;
+
+        memcpy((char*) input->scratch + done * frameSize, buf, frames * frameSize);
+        AlsaDriftRelease(drift, frames);
+        done += frames;
+    }
+    return done;
+}
+
+// ducking gain of one input from the gates of every other input this period, faded per sample
+STATIC void MixDuck(AlsaSinkMixT *mix, AlsaMixInputT *input, int count) {
+    float target = 1.0f;
+    unsigned int attackMs = 0, releaseMs = 0;
+    bool ducked = false;
+
+    for (int idx = 0; input->zone && idx < count; idx++) {
+        AlsaMixInputT *trigger = &mix->inputs[idx];
+        if (trigger == input || !trigger->active) continue;
+        if (AlsaDuckRule(trigger->zone->duck, input->zone, &target, &attackMs, &releaseMs)) ducked = true;
+    }
+    if (ducked) input->releaseMs = releaseMs;
+    if (!ducked && input->duck == 1.0f) return;
+
+    float coef = AlsaDuckCoef(target < input->duck ? attackMs : input->releaseMs, mix->rate);
+    AlsaDuckApply(input->fscratch, input->channels, input->frames, &input->duck, target, coef);
+}
+
+STATIC void MixOnePeriod(AlsaSinkMixT *mix) {
+    int count = atomic_load_explicit(&mix->count, memory_order_acquire);
+    size_t samples = mix->period * mix->channels;
+
+    memset(mix->acc, 0, samples * sizeof (float));
+
+    // pop and convert every stream first, so that ducking acts on the very period that opened a gate
+    for (int idx = 0; idx < count; idx++) {
+        AlsaMixInputT *input = &mix->inputs[idx];
+        alsa_ringbuf_t *rbuf = input->copy->rbuf;
+
+        input->frames = 0;
+
+        // wait for a full period before (re)starting a stream, else it would underflow on every cycle
+        if (!input->primed && alsa_ringbuf_frames_used(rbuf) >= mix->period)
+            input->primed = true;
+
+        if (input->primed) {
+            if (input->copy->drift) input->frames = MixDriftPop(mix, input);
+            else input->frames = alsa_ringbuf_frames_pop(rbuf, input->scratch, mix->period);
+            if (input->frames < mix->period) {
+                input->primed = false;
+                ALSA_STATS_ADD(input->copy->stats.playback.xruns, 1);
+            }
+            ALSA_STATS_ADD(input->copy->stats.playback.frames, input->frames);
+
+            // stream format -> float32 internal format
+            AlsaConvertToFloat(input->format, input->scratch, input->fscratch, input->frames * input->channels);
+        }
+
+        if (input->zone && input->zone->duck) {
+            input->active = AlsaDuckGate(input->zone->duck, input->fscratch, input->frames * input->channels,
+                                         mix->period, mix->rate, &input->hold);
+        }
+    }
+
+    for (int idx = 0; idx < count; idx++) {
+        AlsaMixInputT *input = &mix->inputs[idx];
+        if (!input->frames) continue;
+
+        MixDuck(mix, input, count);
+        AlsaMatrixApply(input->matrix, mix->acc, input->fscratch, input->frames);
+    }
+
+    // float32 -> sink format, saturated
+    AlsaConvertFromFloat(mix->format, mix->acc, mix->out, samples);
+}
+
+// linked sinks: each card takes its own channel slice of the mixed period, following cards through their ring
+STATIC void MixSplitPeriod(AlsaSinkMixT *mix) {
+    size_t sampleSize = mix->frameSize / mix->channels;
+
+    for (int cdx = 0; cdx < mix->ncards; cdx++) {
+        AlsaMixCardT *card = &mix->cards[cdx];
+        const char *src = (const char*) mix->out + card->offset * sampleSize;
+        char *dst = (char*) card->out;
+
+        for (snd_pcm_uframes_t fdx = 0; fdx < mix->period; fdx++) {
+            memcpy(dst, src, card->frameSize);
+            src += mix->frameSize;
+            dst += card->frameSize;
+        }
+
+        if (cdx == 0) continue;
+
+        // a full ring means the card stalled: its delay against the first card is lost, restart it
+        if (alsa_ringbuf_frames_push(card->rbuf, card->out, mix->period) < mix->period && !atomic_exchange(&card->resync, true)) {
+            unsigned long overruns = atomic_fetch_add(&card->overruns, 1) + 1;
+            ALSA_RT_LOG(mix->api, ALSA_LOG_WARNING, "MixSplitPeriod: sink=%s ring overrun, resync overruns=%ld", card->sink->uid, overruns, 0, 0);
+        }
+        eventfd_write(card->wakeFd, 1);
+    }
+}
+
+// following card of linked sinks: drift compensation keeps its ring level, and so its delay
+// against the first card, where it settled when the card started
+STATIC void *MixCardThreadEntry(void *handle) {
+    AlsaMixCardT *card = (AlsaMixCardT*) handle;
+    AlsaSinkMixT *mix = card->mix;
+    snd_pcm_t *pcm = card->pcm->handle;
+    struct pollfd wakePfd = {.fd = card->wakeFd, .events = POLLIN};
+    bool primed = false;
+
+    AFB_ApiNotice(mix->api, "%s: sink=%s follows sink=%s offset=%d", __func__, card->sink->uid, mix->sink->uid, card->offset);
+
+    while (!atomic_load(&mix->stop)) {
+        eventfd_t ticks;
+
+        // ring overflowed: drop what the card queued and settle a new delay from an empty ring
+        if (atomic_load(&card->resync)) {
+            snd_pcm_drop(pcm);
+            alsa_ringbuf_frames_pop_commit(card->rbuf, alsa_ringbuf_frames_used(card->rbuf));
+            if (card->drift) AlsaDriftReset(card->drift);
+            snd_pcm_prepare(pcm);
+            atomic_store(&card->resync, false);
+            primed = false;
+        }
+
+        // let the mix thread queue two periods before (re)starting the card, ticks are drained first so none is lost
+        if (!primed) {
+            eventfd_read(card->wakeFd, &ticks);
+            if (alsa_ringbuf_frames_used(card->rbuf) < 2 * mix->period) {
+                (void) poll(&wakePfd, 1, MIX_TIMEOUT_MSEC);
+                continue;
+            }
+            primed = true;
+        }
+
+        int err = snd_pcm_wait(pcm, MIX_TIMEOUT_MSEC);
+        if (err == 0) continue;
+
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm);
+        if (avail < 0) {
+            ALSA_RT_LOG(mix->api, ALSA_LOG_DEBUG, "MixCardThreadEntry: sink=%s recover error=%ld", card->sink->uid, avail, 0, 0);
+            if (snd_pcm_recover(pcm, (int) avail, 1) < 0)
+                usleep(10*1000); // sink is gone, do not spin
+            primed = false;
+            continue;
+        }
+
+        snd_pcm_sframes_t delay;
+        if (card->drift && snd_pcm_delay(pcm, &delay) == 0)
+            AlsaDriftUpdate(card->drift, (snd_pcm_sframes_t) alsa_ringbuf_frames_used(card->rbuf) + delay);
+
+        while (avail > 0) {
+            const void *buf;
+            snd_pcm_uframes_t frames;
+
+            if (card->drift) frames = AlsaDriftPull(card->drift, card->rbuf, (snd_pcm_uframes_t) avail, &buf);
+            else frames = alsa_ringbuf_frames_pop_region(card->rbuf, &buf);
+            if (!frames) break;
+            if (frames > (snd_pcm_uframes_t) avail) frames = (snd_pcm_uframes_t) avail;
+
+            ALSA_TRACE_BEGIN(trace);
+            snd_pcm_sframes_t written = snd_pcm_writei(pcm, buf, frames);
+            ALSA_TRACE_END(trace, "MixCardWrite");
+            if (written < 0) {
+                snd_pcm_recover(pcm, (int) written, 1);
+                primed = false;
+                break;
+            }
+            if (card->drift) AlsaDriftRelease(card->drift, (snd_pcm_uframes_t) written);
+            else alsa_ringbuf_frames_pop_commit(card->rbuf, (snd_pcm_uframes_t) written);
+            avail -= written;
+        }
+    }
+
+    pthread_exit(0);
+    return NULL;
+}
+
+STATIC void *MixThreadEntry(void *handle) {
+    AlsaSinkMixT *mix = (AlsaSinkMixT*) handle;
+    snd_pcm_t *pcm = mix->pcm->handle;
+    void *out = (mix->ncards > 1) ? mix->cards[0].out : mix->out;
+
+    mix->tid = (int) syscall(SYS_gettid);
+    AFB_ApiNotice(mix->api, "%s: sink=%s/%d started period=%lu", __func__, mix->sink->uid, mix->tid, mix->period);
+
+    for (;;) {
+        // no stream: stop clocking silence to the sink until one attaches
+        if (!atomic_load(&mix->count)) {
+            snd_pcm_drop(pcm);
+            ALSA_RT_LOG(mix->api, ALSA_LOG_DEBUG, "MixThreadEntry: sink=%s idle", mix->sink->uid, 0, 0, 0);
+
+            pthread_mutex_lock(&mix->lock);
+            while (!atomic_load(&mix->count))
+                pthread_cond_wait(&mix->wake, &mix->lock);
+            pthread_mutex_unlock(&mix->lock);
+
+            snd_pcm_prepare(pcm);
+        }
+
+        int err = snd_pcm_wait(pcm, MIX_TIMEOUT_MSEC);
+        if (err == 0) {
+            ALSA_RT_LOG(mix->api, ALSA_LOG_DEBUG, "MixThreadEntry: sink=%s alive, streams=%ld", mix->sink->uid, atomic_load(&mix->count), 0, 0);
+            continue;
+        }
+
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm);
+        if (avail < 0) {
+            ALSA_RT_LOG(mix->api, ALSA_LOG_DEBUG, "MixThreadEntry: sink=%s recover error=%ld", mix->sink->uid, avail, 0, 0);
+            if (snd_pcm_recover(pcm, (int) avail, 1) < 0)
+                usleep(10*1000); // sink is gone, do not spin
+            continue;
+        }
+
+        while (avail >= (snd_pcm_sframes_t) mix->period) {
+            ALSA_TRACE_BEGIN(trace);
+            pthread_mutex_lock(&mix->lock);
+            MixOnePeriod(mix);
+            pthread_mutex_unlock(&mix->lock);
+            if (mix->ncards > 1) MixSplitPeriod(mix);
+
+            snd_pcm_sframes_t written = snd_pcm_writei(pcm, out, mix->period);
+            ALSA_TRACE_END(trace, "MixOnePeriod");
+            if (written < 0) {
+                snd_pcm_recover(pcm, (int) written, 1);
+                break;
+            }
+            avail -= written;
+        }
+    }
+
+    pthread_exit(0);
+    return NULL;
+}
+
+STATIC int MixCardOpen(SoftMixerT *mixer, AlsaMixCardT *card, AlsaSndPcmT *sink) {
+    card->sink = sink;
+
+    card->pcm = AlsaPcmOpenHw(mixer, sink->uid, sink->sndcard, sink->ccount, SND_PCM_STREAM_PLAYBACK);
+    if (!card->pcm) goto OnErrorExit;
+
+    card->channels = card->pcm->params->channels;
+    card->frameSize = (snd_pcm_format_physical_width(card->pcm->params->format) / 8) * card->channels;
+
+    return 0;
+
+OnErrorExit:
+    return -1;
+}
+
+// failed creation: mix thread never ran, card threads already started are stopped first
+STATIC void MixFree(AlsaSinkMixT *mix) {
+    atomic_store(&mix->stop, true);
+
+    for (int cdx = 0; cdx < mix->ncards; cdx++) {
+        AlsaMixCardT *card = &mix->cards[cdx];
+
+        if (card->started) {
+            eventfd_write(card->wakeFd, 1);
+            pthread_join(card->thread, NULL);
+        }
+        if (card->wakeFd >= 0) close(card->wakeFd);
+        if (card->rbuf) alsa_ringbuf_free(card->rbuf);
+        AlsaDriftFree(card->drift);
+        free(card->out);
+
+        AlsaPcmCloseHw(card->pcm);
+    }
+
+    free(mix->cards);
+    free(mix->acc);
+    free(mix->out);
+    free(mix->inputs);
+    pthread_cond_destroy(&mix->wake);
+    pthread_mutex_destroy(&mix->lock);
+    free(mix);
+}
+
+STATIC AlsaSinkMixT *MixCreate(SoftMixerT *mixer, AlsaSndPcmT **sinks, int count) {
+    AlsaSinkMixT *mix = calloc(1, sizeof (AlsaSinkMixT));
+    AlsaSndPcmT *sink = sinks[0];
+    int error;
+
+    mix->sink = sink;
+    mix->api = mixer->api;
+    mix->max = mixer->max.streams;
+    mix->inputs = calloc(mix->max, sizeof (AlsaMixInputT));
+    atomic_init(&mix->count, 0);
+    atomic_init(&mix->stop, false);
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(&mix->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    pthread_cond_init(&mix->wake, NULL);
+
+    mix->ncards = count;
+    mix->cards = calloc(count, sizeof (AlsaMixCardT));
+    for (int cdx = 0; cdx < count; cdx++)
+        mix->cards[cdx].wakeFd = -1;
+
+    for (int cdx = 0; cdx < count; cdx++) {
+        AlsaMixCardT *card = &mix->cards[cdx];
+
+        card->mix = mix;
+        error = MixCardOpen(mixer, card, sinks[cdx]);
+        if (error) goto OnErrorExit;
+
+        // one mixed period feeds every card: same sample format and rate
+        AlsaPcmHwInfoT *first = mix->cards[0].pcm->params, *params = card->pcm->params;
+        if (params->format != first->format || params->rate != first->rate) {
+            AFB_ApiError(mixer->api, "%s: sink=%s [%d,%s] should match sink=%s [%d,%s] to be linked", __func__,
+                         card->sink->uid, params->rate, params->formatS, sink->uid, first->rate, first->formatS);
+            goto OnErrorExit;
+        }
+
+        card->offset = mix->channels;
+        mix->channels += card->channels;
+    }
+
+    mix->pcm = mix->cards[0].pcm;
+    mix->format = mix->pcm->params->format;
+    mix->period = mix->pcm->params->period_frames;
+    mix->rate = mix->pcm->params->rate;
+    mix->frameSize = (snd_pcm_format_physical_width(mix->format) / 8) * mix->channels;
+
+    if (!AlsaConvertSupported(mix->format)) {
+        AFB_ApiError(mixer->api, "%s: sink=%s native mixing supports S16_LE|S24_LE|S24_3LE|S32_LE|FLOAT_LE only format=%d", __func__, sink->uid, mix->format);
+        goto OnErrorExit;
+    }
+    mix->acc = malloc(mix->period * mix->channels * sizeof (float));
+    mix->out = malloc(mix->period * mix->frameSize);
+
+    for (int cdx = 0; count > 1 && cdx < count; cdx++) {
+        AlsaMixCardT *card = &mix->cards[cdx];
+        card->out = malloc(mix->period * card->frameSize);
+        if (cdx == 0) continue;
+
+        snd_pcm_uframes_t frames = card->pcm->params->buffer_frames;
+        if (frames < 4 * mix->period) frames = 4 * mix->period;
+        card->rbuf = alsa_ringbuf_new(2 * frames, card->frameSize);
+        card->drift = AlsaDriftCreate(mixer, card->pcm->params, card->frameSize, card->pcm->params->buffer_frames);
+        if (!card->rbuf) goto OnErrorExit;
+
+        card->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (card->wakeFd < 0) {
+            AFB_ApiError(mixer->api, "%s: sink=%s fail to create wakeup eventfd err=%s", __func__, card->sink->uid, strerror(errno));
+            goto OnErrorExit;
+        }
+        atomic_init(&card->resync, false);
+        atomic_init(&card->overruns, 0);
+
+        if ((error = pthread_create(&card->thread, NULL, &MixCardThreadEntry, card)) != 0) {
+            AFB_ApiError(mixer->api, "%s: sink=%s fail to create card thread err=%d", __func__, card->sink->uid, error);
+            goto OnErrorExit;
+        }
+        card->started = true;
+        AlsaPcmThreadPriority(mixer, card->thread, card->sink->uid);
+    }
+
+    if ((error = pthread_create(&mix->thread, NULL, &MixThreadEntry, mix)) != 0) {
+        AFB_ApiError(mixer->api, "%s: sink=%s fail to create mix thread err=%d", __func__, sink->uid, error);
+        goto OnErrorExit;
+    }
+    AlsaPcmThreadPriority(mixer, mix->thread, sink->uid);
+
+    return mix;
+
+OnErrorExit:
+    MixFree(mix);
+    return NULL;
+}
+
+// sink mix is created with its first stream, parallel stream startup creates it before starting any copy
+PUBLIC int AlsaMixPrepare(SoftMixerT *mixer, AlsaSndPcmT *sink) {
+    if (!sink->mix) sink->mix = MixCreate(mixer, &sink, 1);
+    return sink->mix ? 0 : -1;
+}
+
+// multi-card zone: its sinks (NULL terminated) share one mix, created at zone attach before any stream
+PUBLIC int AlsaMixLink(SoftMixerT *mixer, AlsaSndPcmT **sinks) {
+    AlsaSinkMixT *mix = sinks[0]->mix;
+    int count;
+
+    for (count = 0; sinks[count]; count++) {
+        if (sinks[count]->mix != mix) goto OnLinkError;
+    }
+    if (count < 2) return 0;
+
+    // already linked by a previous zone over the same sinks
+    if (mix) {
+        for (int idx = 0; idx < count; idx++) {
+            if (mix->ncards != count || mix->cards[idx].sink != sinks[idx]) goto OnOrderError;
+        }
+        return 0;
+    }
+
+    mix = MixCreate(mixer, sinks, count);
+    if (!mix) goto OnErrorExit;
+
+    for (int idx = 0; idx < count; idx++)
+        sinks[idx]->mix = mix;
+
+    AFB_ApiNotice(mixer->api, "%s: sink=%s linked with %d sinks channels=%d", __func__, sinks[0]->uid, count - 1, mix->channels);
+    return 0;
+
+OnLinkError:
+    AFB_ApiError(mixer->api, "%s: sink=%s already mixed with other sinks, zones over several sinks should use the same sinks in the same order", __func__, sinks[count]->uid);
+    goto OnErrorExit;
+OnOrderError:
+    AFB_ApiError(mixer->api, "%s: sink=%s already linked with other sinks or in another order, zones over several sinks should use the same sinks in the same order", __func__, sinks[0]->uid);
+OnErrorExit:
+    return -1;
+}
+
+// first channel of a sink in its mix channel space, non zero for sinks linked behind the first one
+PUBLIC int AlsaMixSinkOffset(AlsaSndPcmT *sink) {
+    AlsaSinkMixT *mix = sink->mix;
+
+    for (int cdx = 0; mix && cdx < mix->ncards; cdx++) {
+        if (mix->cards[cdx].sink == sink) return (int) mix->cards[cdx].offset;
+    }
+    return 0;
+}
+
+PUBLIC unsigned int AlsaMixChannels(AlsaSndPcmT *sink) {
+    return sink->mix ? sink->mix->channels : 0;
+}
+
+// zone streams go through the zone matrix and ducking rules, other streams through their own
+// matrix built from 'route' (route[streamChannel] = sinkChannel or -1 when not routed)
+PUBLIC int AlsaMixAttach(SoftMixerT *mixer, AlsaSndPcmT *sink, AlsaPcmCopyHandleT *copy, const int *route, AlsaSndZoneT *zone) {
+    AlsaMatrixT *matrix = zone ? zone->matrix : NULL;
+    AlsaSinkMixT *mix;
+
+    if (AlsaMixPrepare(mixer, sink)) goto OnErrorExit;
+    mix = sink->mix;
+
+    pthread_mutex_lock(&mix->lock);
+    int index = atomic_load(&mix->count);
+    if (index >= mix->max) {
+        pthread_mutex_unlock(&mix->lock);
+        AFB_ApiError(mixer->api, "%s: sink=%s too many streams max=%d", __func__, sink->uid, mix->max);
+        goto OnErrorExit;
+    }
+
+    if (!AlsaConvertSupported(copy->pcmIn->params->format)) {
+        pthread_mutex_unlock(&mix->lock);
+        AFB_ApiError(mixer->api, "%s: sink=%s stream format=%d unsupported by native mixing", __func__, sink->uid,
+                     copy->pcmIn->params->format);
+        goto OnErrorExit;
+    }
+
+    if (matrix && (AlsaMatrixInputs(matrix) != copy->channels || AlsaMatrixOutputs(matrix) != mix->channels)) {
+        pthread_mutex_unlock(&mix->lock);
+        AFB_ApiError(mixer->api, "%s: sink=%s matrix %dx%d does not fit stream channels=%d sink channels=%d", __func__, sink->uid,
+                     AlsaMatrixInputs(matrix), AlsaMatrixOutputs(matrix), copy->channels, mix->channels);
+        goto OnErrorExit;
+    }
+
+    AlsaMixInputT *input = &mix->inputs[index];
+    memset(input, 0, sizeof (AlsaMixInputT));
+    input->copy = copy;
+    input->channels = copy->channels;
+    input->format = copy->pcmIn->params->format;
+    input->scratch = malloc(mix->period * copy->frame_size);
+    input->fscratch = malloc(mix->period * input->channels * sizeof (float));
+    input->zone = zone;
+    input->duck = 1.0f;
+
+    if (matrix) {
+        input->matrix = matrix;
+    } else {
+        float *gains = AlsaMatrixGains(NULL, input->channels, mix->channels);
+        for (unsigned int idx = 0; idx < input->channels; idx++) {
+            if (route[idx] >= 0 && route[idx] < (int) mix->channels) gains[idx * mix->channels + route[idx]] = 1.0f;
+        }
+        input->matrix = AlsaMatrixCreate(input->channels, mix->channels, gains);
+        input->ownMatrix = true;
+        free(gains);
+    }
+
+    atomic_store_explicit(&mix->count, index + 1, memory_order_release);
+    copy->mix = mix;
+    pthread_cond_signal(&mix->wake);
+    pthread_mutex_unlock(&mix->lock);
+
+    AFB_ApiNotice(mixer->api, "%s: sink=%s stream input=%d channels=%d matrix=%s%s", __func__, sink->uid, index,
+                  input->channels, AlsaMatrixKernel(input->matrix), input->ownMatrix ? "" : " (zone)");
+    return 0;
+
+OnErrorExit:
+    return -1;
+}
+
+// zone matrix update: inputs using 'previous' switch to 'matrix' between two periods, 'previous' may then be freed
+PUBLIC void AlsaMixSetMatrix(AlsaSndPcmT *sink, AlsaMatrixT *previous, AlsaMatrixT *matrix) {
+    AlsaSinkMixT *mix = sink->mix;
+    if (!mix) return;
+
+    pthread_mutex_lock(&mix->lock);
+    int count = atomic_load(&mix->count);
+    for (int idx = 0; idx < count; idx++) {
+        if (mix->inputs[idx].matrix == previous) mix->inputs[idx].matrix = matrix;
+    }
+    pthread_mutex_unlock(&mix->lock);
+}
+
+// once returned, the mix thread does not read the copy ring anymore
+PUBLIC int AlsaMixDetach(SoftMixerT *mixer, AlsaPcmCopyHandleT *copy) {
+    AlsaSinkMixT *mix = copy->mix;
+    if (!mix) return -1;
+
+    pthread_mutex_lock(&mix->lock);
+    int count = atomic_load(&mix->count);
+    for (int idx = 0; idx < count; idx++) {
+        AlsaMixInputT *input = &mix->inputs[idx];
+        if (input->copy != copy) continue;
+
+        free(input->scratch);
+        free(input->fscratch);
+        if (input->ownMatrix) AlsaMatrixFree(input->matrix);
+
+        // keep inputs packed, last one takes the free place
+        if (idx != count - 1) *input = mix->inputs[count - 1];
+        atomic_store_explicit(&mix->count, count - 1, memory_order_release);
+        copy->mix = NULL;
+        pthread_mutex_unlock(&mix->lock);
+
+        AFB_ApiNotice(mixer->api, "%s: sink=%s stream=%s detached", __func__, mix->sink->uid, copy->info);
+        return 0;
+    }
+    pthread_mutex_unlock(&mix->lock);
+
+    AFB_ApiError(mixer->api, "%s: sink=%s stream=%s not attached", __func__, mix->sink->uid, copy->info);
+    return -1;
+}
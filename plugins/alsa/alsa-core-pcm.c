@@ -27,50 +27,32 @@ for the specific language governing permissions and
 #include "alsa-softmixer.h"
 #include <pthread.h>
 #include <sys/syscall.h>
+#include <sys/eventfd.h>
 #include <sched.h>
 
 #include "time_utils.h"
 
+#define COPY_POLL_FDS_MAX 8
+
 static int xrun(snd_pcm_t * pcm, int error);
 static int suspend(snd_pcm_t * pcm, int error);
+static void *readThreadEntry(void *handle);
+static void *writeThreadEntry(void *handle);
 
+// stopped copy handles, their threads stay parked until next stream
+struct AlsaCopyPoolS {
+    pthread_mutex_t lock;
+    int count;
+    int max;
+    AlsaPcmCopyHandleT **handles;
+};
 
-STATIC int AlsaPeriodSize(snd_pcm_format_t pcmFormat) {
-    int pcmSampleSize;
-
-    switch (pcmFormat) {
-
-        case SND_PCM_FORMAT_S8:
-        case SND_PCM_FORMAT_U8:
-            pcmSampleSize = 1;
-            break;
-
-        case SND_PCM_FORMAT_U16_LE:
-        case SND_PCM_FORMAT_U16_BE:
-        case SND_PCM_FORMAT_S16_LE:
-        case SND_PCM_FORMAT_S16_BE:
-            pcmSampleSize = 2;
-            break;
 
-        case SND_PCM_FORMAT_U24_LE:
-        case SND_PCM_FORMAT_U24_BE:
-        case SND_PCM_FORMAT_S24_LE:
-        case SND_PCM_FORMAT_S24_BE:
-            pcmSampleSize = 3;
-            break;
-
-        case SND_PCM_FORMAT_U32_LE:
-        case SND_PCM_FORMAT_U32_BE:
-        case SND_PCM_FORMAT_S32_LE:
-        case SND_PCM_FORMAT_S32_BE:
-            pcmSampleSize = 4;
-            break;
-
-        default:
-            pcmSampleSize = 0;
-    }
+// bytes per sample as laid out in buffers: S24_LE sits in 4 bytes, S24_3LE in 3, FLOAT in 4
+STATIC int AlsaPeriodSize(snd_pcm_format_t pcmFormat) {
+    int width = snd_pcm_format_physical_width(pcmFormat);
 
-    return pcmSampleSize;
+    return (width > 0) ? width / 8 : 0;
 }
 
 PUBLIC int AlsaPcmConf(SoftMixerT *mixer, AlsaPcmCtlT *pcm, int mode) {
@@ -99,9 +81,7 @@ PUBLIC int AlsaPcmConf(SoftMixerT *mixer, AlsaPcmCtlT *pcm, int mode) {
     AFB_ApiDebug(mixer->api, "PARAMS before:\n");
     AlsaDumpPcmParams(mixer, pxmHwParams);
 
-    if (!opts->access)
-         opts->access = SND_PCM_ACCESS_RW_INTERLEAVED;
-
+    // access is always set by ApiPcmSetParams (RW_INTERLEAVED by default), MMAP_INTERLEAVED is 0
     snd_pcm_hw_params_get_access(pxmHwParams, &access);
     error = snd_pcm_hw_params_set_access(pcm->handle, pxmHwParams, opts->access);
     if (error) {
@@ -158,23 +138,25 @@ PUBLIC int AlsaPcmConf(SoftMixerT *mixer, AlsaPcmCtlT *pcm, int mode) {
      * 2) sets start and stop threashold in software params
      * ... is taken as such from 'aplay' in alsa-utils */
 
-    unsigned buffer_time = 0;
+    unsigned buffer_time = 0, buffer_time_max = 0;
     unsigned period_time = 0;
+    unsigned periods = opts->periods ? opts->periods : ALSA_DEFAULT_PCM_PERIODS;
     snd_pcm_uframes_t buffer_frames = 0;
     snd_pcm_uframes_t period_frames = 0;
 
-	error = snd_pcm_hw_params_get_buffer_time_max(pxmHwParams, &buffer_time, 0);
-
-	AFB_ApiInfo(mixer->api, "HW_BUFFER_TIME MAX is %d\n", buffer_time);
+	error = snd_pcm_hw_params_get_buffer_time_max(pxmHwParams, &buffer_time_max, 0);
 
-	if (buffer_time > 500000)
-		buffer_time = 500000;
+	AFB_ApiInfo(mixer->api, "HW_BUFFER_TIME MAX is %d\n", buffer_time_max);
 
-	if (period_time == 0 && period_frames == 0) {
-		if (buffer_time > 0)
-			period_time = buffer_time / 4;
-		else
-			period_frames = buffer_frames / 4;
+	// stream params: explicit period size first, then latency target, else default buffer
+	if (opts->period_frames > 0) {
+		period_frames = opts->period_frames;
+		buffer_frames = period_frames * periods;
+	} else {
+		buffer_time = opts->latency_ms ? opts->latency_ms * 1000 : ALSA_DEFAULT_PCM_BUFFER_TIME;
+		if (buffer_time_max > 0 && buffer_time > buffer_time_max)
+			buffer_time = buffer_time_max;
+		period_time = buffer_time / periods;
 	}
 
 	if (period_time > 0) {
@@ -223,6 +205,7 @@ PUBLIC int AlsaPcmConf(SoftMixerT *mixer, AlsaPcmCtlT *pcm, int mode) {
     snd_pcm_hw_params_get_channels(pxmHwParams, &opts->channels);
     snd_pcm_hw_params_get_format(pxmHwParams, &opts->format);
     snd_pcm_hw_params_get_rate(pxmHwParams, &opts->rate, 0);
+    snd_pcm_hw_params_get_access(pxmHwParams, &opts->access);
 
 	AFB_ApiInfo(mixer->api, "rate is %d", opts->rate);
 
@@ -245,6 +228,14 @@ PUBLIC int AlsaPcmConf(SoftMixerT *mixer, AlsaPcmCtlT *pcm, int mode) {
     	goto OnErrorExit;
     }
 
+    // keep effective values, they size the copy ring and thresholds
+    opts->period_frames = chunk_size;
+    opts->buffer_frames = buffer_size;
+    opts->periods = (unsigned) (buffer_size / chunk_size);
+
+    AFB_ApiInfo(mixer->api, "%s: period=%lu buffer=%lu frames latency=%u ms", modeS,
+                chunk_size, buffer_size, (unsigned) (buffer_size * 1000 / opts->rate));
+
     int avail_min = -1;
     size_t n;
     int rate = opts->rate;
@@ -317,21 +308,123 @@ OnErrorExit:
     return -1;
 }
 
-STATIC int AlsaPcmReadCB( struct pollfd * pfd, AlsaPcmCopyHandleT * pcmCopyHandle) {
-	char string[32];
+// sink or source sound card pcm driven by a mixer thread: opened non blocking on the card
+// hw device with 'channels' and the card params in RW access, configured and prepared
+PUBLIC AlsaPcmCtlT *AlsaPcmOpenHw(SoftMixerT *mixer, const char *uid, AlsaSndCtlT *sndcard, unsigned int channels, snd_pcm_stream_t mode) {
+    AlsaPcmCtlT *pcm = calloc(1, sizeof (AlsaPcmCtlT));
+    char *pcmName = NULL;
+    int error;
+
+    if (asprintf(&pcmName, "%s,%d,%d", sndcard->cid.cardid, sndcard->cid.device, sndcard->cid.subdev) == -1)
+        goto OnErrorExit;
+
+    pcm->cid.cardid = pcmName;
+    pcm->params = malloc(sizeof (AlsaPcmHwInfoT));
+    memcpy(pcm->params, sndcard->params, sizeof (AlsaPcmHwInfoT));
+    pcm->params->channels = channels;
+    pcm->params->access = SND_PCM_ACCESS_RW_INTERLEAVED;
+
+    error = snd_pcm_open(&pcm->handle, pcmName, mode, SND_PCM_NONBLOCK);
+    if (error < 0) {
+        AFB_ApiError(mixer->api, "%s: %s fail to open pcm=%s error=%s", __func__, uid, pcmName, snd_strerror(error));
+        pcm->handle = NULL;
+        goto OnErrorExit;
+    }
+
+    error = AlsaPcmConf(mixer, pcm, mode);
+    if (error) {
+        AFB_ApiError(mixer->api, "%s: %s fail to configure pcm=%s", __func__, uid, pcmName);
+        goto OnErrorExit;
+    }
+
+    if ((error = snd_pcm_prepare(pcm->handle)) < 0) {
+        AFB_ApiError(mixer->api, "%s: %s fail to prepare pcm=%s error=%s", __func__, uid, pcmName, snd_strerror(error));
+        goto OnErrorExit;
+    }
+
+    return pcm;
+
+OnErrorExit:
+    AlsaPcmCloseHw(pcm);
+    return NULL;
+}
+
+PUBLIC void AlsaPcmCloseHw(AlsaPcmCtlT *pcm) {
+    if (!pcm) return;
+    if (pcm->handle) snd_pcm_close(pcm->handle);
+    free((char*) pcm->cid.cardid);
+    free(pcm->params);
+    free(pcm);
+}
+
+// audio threads run with the highest FIFO priority, a failure only costs latency
+PUBLIC void AlsaPcmThreadPriority(SoftMixerT *mixer, pthread_t thread, const char *owner) {
+    struct sched_param params;
+    params.sched_priority = sched_get_priority_max(SCHED_FIFO);
+
+    int error = pthread_setschedparam(thread, SCHED_FIFO, &params);
+    if (error) {
+        AFB_ApiWarning(mixer->api, "%s: %s fail to increase thread priority err=%s", __func__, owner, strerror(error));
+    }
+}
+
+// address of frame 'offset' within an interleaved mmap area
+#define MMAP_AREA_FRAME(area, offset) ((char*)(area)->addr + (area)->first/8 + (offset)*(area)->step/8)
+
+// copy available frames from the capture DMA area (one copy instead of readi + ring push)
+STATIC snd_pcm_sframes_t AlsaPcmMmapRead(snd_pcm_t * pcm, void * dst, snd_pcm_uframes_t nbFrames, size_t frameSize) {
+	const snd_pcm_channel_area_t * areas;
+	snd_pcm_uframes_t offset, frames = nbFrames;
+	snd_pcm_sframes_t committed;
+
+	int error = snd_pcm_mmap_begin(pcm, &areas, &offset, &frames);
+	if (error < 0)
+		return error;
+
+	memcpy(dst, MMAP_AREA_FRAME(&areas[0], offset), frames*frameSize);
+
+	committed = snd_pcm_mmap_commit(pcm, offset, frames);
+	if (committed >= 0 && (snd_pcm_uframes_t)committed != frames)
+		return -EPIPE;
+	return committed;
+}
+
+// copy frames to the playback DMA area (one copy instead of ring pop + writei)
+STATIC snd_pcm_sframes_t AlsaPcmMmapWrite(snd_pcm_t * pcm, const void * src, snd_pcm_uframes_t nbFrames, size_t frameSize) {
+	const snd_pcm_channel_area_t * areas;
+	snd_pcm_uframes_t offset, frames = nbFrames;
+	snd_pcm_sframes_t committed;
 
+	int error = snd_pcm_mmap_begin(pcm, &areas, &offset, &frames);
+	if (error < 0)
+		return error;
+
+	memcpy(MMAP_AREA_FRAME(&areas[0], offset), src, frames*frameSize);
+
+	committed = snd_pcm_mmap_commit(pcm, offset, frames);
+	if (committed >= 0 && (snd_pcm_uframes_t)committed != frames)
+		return -EPIPE;
+
+	// mmap commit never auto-starts: restart once frames are queued again (first write, after an xrun recovery)
+	if (committed > 0 && snd_pcm_state(pcm) == SND_PCM_STATE_PREPARED)
+		snd_pcm_start(pcm);
+	return committed;
+}
+
+PUBLIC int AlsaPcmReadCB( struct pollfd * pfd, AlsaPcmCopyHandleT * pcmCopyHandle) {
 	snd_pcm_sframes_t availIn;
 	snd_pcm_t * pcmIn = pcmCopyHandle->pcmIn->handle;
 	alsa_ringbuf_t * rbuf = pcmCopyHandle->rbuf;
-	snd_pcm_uframes_t bufSize = alsa_ringbuf_buffer_size(rbuf);
+	AlsaPcmCopyStatsT * stats = &pcmCopyHandle->stats;
+	uint64_t wakeNs = AlsaStatsNow();
+	snd_pcm_uframes_t copied = 0;
+	ALSA_TRACE_BEGIN(trace);
 
 	int err;
 
 	// PCM has was closed
 	if ((pfd->revents & POLLHUP) != 0) {
-		AFB_ApiNotice(pcmCopyHandle->api,
-				"%s PCM=%s hanghup/disconnected",
-				__func__, ALSA_PCM_UID(pcmIn, string));
+		ALSA_RT_LOG(pcmCopyHandle->api, ALSA_LOG_NOTICE, "AlsaPcmReadCB: stream=%s capture hanghup/disconnected", pcmCopyHandle->info, 0, 0, 0);
 		goto ExitOnSuccess;
 	}
 
@@ -344,8 +437,9 @@ STATIC int AlsaPcmReadCB( struct pollfd * pfd, AlsaPcmCopyHandleT * pcmCopyHandl
 	availIn = snd_pcm_avail_update(pcmIn);
 	if (availIn <= 0) {
 		if (availIn == -EPIPE) {
+			ALSA_STATS_ADD(stats->capture.xruns, 1);
 			int ret = xrun(pcmIn, (int)availIn);
-			AFB_ApiDebug(pcmCopyHandle->api, "XXX read EPIPE (recov=%d) {%s}!", ret, ALSA_PCM_UID(pcmIn, string));
+			ALSA_RT_LOG(pcmCopyHandle->api, ALSA_LOG_DEBUG, "AlsaPcmReadCB: stream=%s avail EPIPE recover=%ld", pcmCopyHandle->info, ret, 0, 0);
 
 			// For some (undocumented...) reason, a start is mandatory.
 			snd_pcm_start(pcmIn);
@@ -356,25 +450,24 @@ STATIC int AlsaPcmReadCB( struct pollfd * pfd, AlsaPcmCopyHandleT * pcmCopyHandl
 	while (true) {
 
 		snd_pcm_sframes_t nbRead;
+		void * buf;
 
-		pthread_mutex_lock(&pcmCopyHandle->mutex);
-		snd_pcm_sframes_t remain = alsa_ringbuf_frames_remain_capacity(rbuf);
+		// ring buffer is lock free, only this thread may reduce the remaining capacity
+		snd_pcm_sframes_t remain = alsa_ringbuf_frames_push_region(rbuf, &buf);
 
 		if (remain <= 0) {
-			pthread_mutex_unlock(&pcmCopyHandle->mutex);
-			// Wake up the reader, in case it is sleeping,
-			// that lets it an opportunity to pop something.
-			sem_post(&pcmCopyHandle->sem);
 			break;
 		}
 
-		if (remain < availIn)
+		// never read more than what the ring can hold
+		if (remain > availIn)
 			remain = availIn;
 
-		char buf[remain*pcmCopyHandle->frame_size];
-		pthread_mutex_unlock(&pcmCopyHandle->mutex);
-
-		nbRead = snd_pcm_readi(pcmIn, buf, remain);
+		// read straight into the ring buffer
+		if (pcmCopyHandle->mmapIn)
+			nbRead = AlsaPcmMmapRead(pcmIn, buf, remain, pcmCopyHandle->frame_size);
+		else
+			nbRead = snd_pcm_readi(pcmIn, buf, remain);
 
 		if (nbRead == 0) {
 			break;
@@ -382,10 +475,16 @@ STATIC int AlsaPcmReadCB( struct pollfd * pfd, AlsaPcmCopyHandleT * pcmCopyHandl
 		if (nbRead < 0) {
 			if (nbRead== -EPIPE) {
 				err = xrun(pcmIn, (int)nbRead);
-				AFB_ApiDebug(pcmCopyHandle->api, "read EPIPE (%d), recov %d", ++pcmCopyHandle->read_err_count, err);
+				ALSA_STATS_ADD(stats->capture.xruns, 1);
+
+				// recovery only prepares the pcm, mmap reads never start it again
+				if (pcmCopyHandle->mmapIn)
+					snd_pcm_start(pcmIn);
+				ALSA_RT_LOG(pcmCopyHandle->api, ALSA_LOG_DEBUG, "AlsaPcmReadCB: stream=%s read EPIPE xruns=%ld recover=%ld", pcmCopyHandle->info, atomic_load(&stats->capture.xruns), err, 0);
 				goto ExitOnSuccess;
 			} else if (nbRead== -ESTRPIPE) {
-				AFB_ApiDebug(pcmCopyHandle->api, "read ESTRPIPE");
+				ALSA_RT_LOG(pcmCopyHandle->api, ALSA_LOG_DEBUG, "AlsaPcmReadCB: stream=%s read ESTRPIPE", pcmCopyHandle->info, 0, 0, 0);
+				ALSA_STATS_ADD(stats->capture.suspends, 1);
 				if ((err = suspend(pcmIn, (int)nbRead)) < 0)
 					goto ExitOnSuccess;
 				nbRead = 0;
@@ -393,16 +492,12 @@ STATIC int AlsaPcmReadCB( struct pollfd * pfd, AlsaPcmCopyHandleT * pcmCopyHandl
 				goto ExitOnSuccess;
 			}
 		}
-		pthread_mutex_lock(&pcmCopyHandle->mutex);
-		alsa_ringbuf_frames_push(rbuf, buf, nbRead);
-		snd_pcm_uframes_t used = alsa_ringbuf_frames_used(rbuf);
-		pthread_mutex_unlock(&pcmCopyHandle->mutex);
-
-		// Wait for having the buffer full enough before waking up the playback
-		// else it will starve immediately.
-		if (used > 0.8 * (double)bufSize) {
-			sem_post(&pcmCopyHandle->sem);
-		}
+		// native volume: scale frames in place before they become visible to playback
+		if (pcmCopyHandle->pcmIn->gain && nbRead > 0)
+			AlsaGainApply(pcmCopyHandle->pcmIn->gain, buf, nbRead);
+
+		alsa_ringbuf_frames_push_commit(rbuf, nbRead);
+		copied += nbRead;
 
 		availIn -= nbRead;
 
@@ -414,6 +509,14 @@ STATIC int AlsaPcmReadCB( struct pollfd * pfd, AlsaPcmCopyHandleT * pcmCopyHandl
 	}
 
 ExitOnSuccess:
+	AlsaStatsFill(stats, alsa_ringbuf_frames_used(rbuf), alsa_ringbuf_capacity(rbuf));
+	AlsaStatsWakeup(&stats->capture, wakeNs, stats->periodNs, copied);
+	ALSA_TRACE_END(trace, "AlsaPcmReadCB");
+
+	// wake up the playback thread as soon as it has a period to write
+	if (pcmCopyHandle->wakeFd >= 0 && alsa_ringbuf_frames_used(rbuf) >= pcmCopyHandle->wake_threshold)
+		eventfd_write(pcmCopyHandle->wakeFd, 1);
+
 	return 0;
 }
 
@@ -447,7 +550,7 @@ static void readSuspend(AlsaPcmCopyHandleT * pcmCopyHandle) {
 	pcmCopyHandle->saveFd = pcmCopyHandle->pollFds[1].fd;
 	pcmCopyHandle->pollFds[1].fd = -1;
 
-	AFB_ApiNotice(pcmCopyHandle->api, "capture muted");
+	ALSA_RT_LOG(pcmCopyHandle->api, ALSA_LOG_NOTICE, "readSuspend: stream=%s capture muted", pcmCopyHandle->info, 0, 0, 0);
 }
 
 static void readResume(AlsaPcmCopyHandleT * pcmCopyHandle) {
@@ -456,23 +559,47 @@ static void readResume(AlsaPcmCopyHandleT * pcmCopyHandle) {
 	pcmCopyHandle->pollFds[1].fd = pcmCopyHandle->saveFd;
 	snd_pcm_prepare(pcmCopyHandle->pcmIn->handle);
 	snd_pcm_start(pcmCopyHandle->pcmIn->handle);
-	AFB_ApiNotice(pcmCopyHandle->api, "capture unmuted");
+	ALSA_RT_LOG(pcmCopyHandle->api, ALSA_LOG_NOTICE, "readResume: stream=%s capture unmuted", pcmCopyHandle->info, 0, 0, 0);
 }
 
 
+/*
+ * Copy threads are created once per handle and reused by successive streams.
+ * Between two streams they park here, AlsaPcmCopyStop waits until every thread
+ * of the handle is parked before it releases stream resources. The playback
+ * thread stays parked for capture only streams (native mixing).
+ */
+STATIC bool CopyThreadPark(AlsaPcmCopyHandleT *pcmCopyHandle, bool playback) {
+	bool quit;
+
+	pthread_mutex_lock(&pcmCopyHandle->lock);
+	pcmCopyHandle->parked++;
+	pthread_cond_broadcast(&pcmCopyHandle->cond);
+
+	while (!pcmCopyHandle->quit &&
+	       (!atomic_load(&pcmCopyHandle->running) || (playback && !pcmCopyHandle->pcmOut)))
+		pthread_cond_wait(&pcmCopyHandle->cond, &pcmCopyHandle->lock);
+
+	pcmCopyHandle->parked--;
+	quit = pcmCopyHandle->quit;
+	pthread_mutex_unlock(&pcmCopyHandle->lock);
+	return !quit;
+}
+
 static void *readThreadEntry(void *handle) {
 #define LOOP_TIMEOUT_MSEC	10*1000 /* 10 seconds */
 
     AlsaPcmCopyHandleT *pcmCopyHandle = (AlsaPcmCopyHandleT*) handle;
     pcmCopyHandle->tid = (int) syscall(SYS_gettid);
 
-    AFB_ApiNotice(pcmCopyHandle->api,
-                  "%s :%s/%d Started, muted=%d",
-                  __func__, pcmCopyHandle->info, pcmCopyHandle->tid, pcmCopyHandle->pcmIn->mute);
-
    	struct pollfd * mutePfd =  &pcmCopyHandle->pollFds[0];
    	struct pollfd * framePfd = &pcmCopyHandle->pollFds[1];
 
+  while (CopyThreadPark(pcmCopyHandle, false)) {
+
+    ALSA_RT_LOG(pcmCopyHandle->api, ALSA_LOG_NOTICE, "readThreadEntry: stream=%s started, muted=%ld",
+                pcmCopyHandle->info, pcmCopyHandle->pcmIn->mute, 0, 0);
+
    	mutePfd->events  = POLLIN | POLLHUP;
    	framePfd->events = POLLIN | POLLHUP;
 
@@ -481,18 +608,23 @@ static void *readThreadEntry(void *handle) {
   	if (muted)
    		readSuspend(pcmCopyHandle);
 
-    /* loop until end */
-    for (;;) {
+    /* loop until stream is stopped */
+    while (atomic_load_explicit(&pcmCopyHandle->running, memory_order_acquire)) {
 
   	   	int err = poll(pcmCopyHandle->pollFds, pcmCopyHandle->nbPcmFds, LOOP_TIMEOUT_MSEC);
+
+  	   	// stop order comes with a write on the mute pipe
+  	   	if (!atomic_load_explicit(&pcmCopyHandle->running, memory_order_acquire))
+  	   		break;
+
     	if (err < 0) {
-    		AFB_ApiError(pcmCopyHandle->api, "%s: poll err %s", __func__, strerror(errno));
+    		ALSA_RT_LOG(pcmCopyHandle->api, ALSA_LOG_ERROR, "readThreadEntry: stream=%s poll errno=%ld", pcmCopyHandle->info, errno, 0, 0);
     		continue;
     	}
 
     	if (err == 0) {
     		/* timeout */
-    		AFB_ApiDebug(pcmCopyHandle->api, "%s(%s) alive, mute %d", __func__, pcmCopyHandle->pcmIn->cid.cardid, muted );
+    		ALSA_RT_LOG(pcmCopyHandle->api, ALSA_LOG_DEBUG, "readThreadEntry: stream=%s alive, mute=%ld", pcmCopyHandle->info, muted, 0, 0);
     		continue;
     	}
 
@@ -527,166 +659,460 @@ static void *readThreadEntry(void *handle) {
     	}
 
     	if (framePfd->revents & POLLHUP) {
-    		AFB_ApiNotice(pcmCopyHandle->api, "Frame POLLHUP");
+    		ALSA_RT_LOG(pcmCopyHandle->api, ALSA_LOG_NOTICE, "readThreadEntry: stream=%s frame POLLHUP", pcmCopyHandle->info, 0, 0, 0);
     		continue;
     	}
 
    		AlsaPcmReadCB(&pcmCopyHandle->pollFds[1], pcmCopyHandle);
     }
+  }
 
 	pthread_exit(0);
 	return NULL;
 }
 
 
-static void *writeThreadEntry(void *handle) {
-    AlsaPcmCopyHandleT *pcmCopyHandle = (AlsaPcmCopyHandleT*) handle;
+// Push as much as possible from the ring buffer to the playback PCM. Never waits for
+// output room, frames left in the ring are written on next call.
+PUBLIC int AlsaPcmWriteCB(AlsaPcmCopyHandleT * pcmCopyHandle) {
 	snd_pcm_t * pcmOut = pcmCopyHandle->pcmOut->handle;
-
 	alsa_ringbuf_t * rbuf = pcmCopyHandle->rbuf;
+	AlsaDriftT * drift = pcmCopyHandle->drift;
+	AlsaPcmCopyStatsT * stats = &pcmCopyHandle->stats;
+	uint64_t wakeNs = AlsaStatsNow();
+	snd_pcm_uframes_t copied = 0;
+
+	// stream latency is what is queued in the ring plus what is queued in the playback PCM
+	if (drift) {
+		snd_pcm_sframes_t delay;
+		if (snd_pcm_delay(pcmOut, &delay) == 0)
+			AlsaDriftUpdate(drift, (snd_pcm_sframes_t) alsa_ringbuf_frames_used(rbuf) + delay);
+	}
 
-	snd_pcm_status_t *pcmOutStatus;
-	snd_pcm_uframes_t pcmOutSize;
+	while (true) {
+		snd_pcm_sframes_t used, nbWritten;
+		snd_pcm_sframes_t availOut = snd_pcm_avail(pcmOut);
+
+		if (availOut < 0) {
+			if (availOut == -EPIPE) {
+				ALSA_RT_LOG(pcmCopyHandle->api, ALSA_LOG_DEBUG, "AlsaPcmWriteCB: stream=%s avail EPIPE", pcmCopyHandle->info, 0, 0, 0);
+				ALSA_STATS_ADD(stats->playback.xruns, 1);
+				xrun(pcmOut, (int)availOut);
+				continue;
+			}
+			if (availOut == -ESTRPIPE) {
+				ALSA_RT_LOG(pcmCopyHandle->api, ALSA_LOG_DEBUG, "AlsaPcmWriteCB: stream=%s avail ESTRPIPE", pcmCopyHandle->info, 0, 0, 0);
+				ALSA_STATS_ADD(stats->playback.suspends, 1);
+				suspend(pcmOut, (int)availOut);
+				continue;
+			}
+		}
+
+		// no space for output, caller waits for the PCM to reach avail_min
+		if (availOut < pcmCopyHandle->write_threshold) {
+			break;
+		}
 
-	snd_pcm_sframes_t threshold;
+		// write straight from the ring buffer (or the resampler), wrapped part goes on next loop
+		const void * buf;
+		if (drift)
+			used = AlsaDriftPull(drift, rbuf, availOut, &buf);
+		else
+			used = alsa_ringbuf_frames_pop_region(rbuf, &buf);
+		if (used <= 0) {
+			break; // will wait again
+		}
+		if (used > availOut)
+			used = availOut;
 
-	snd_pcm_status_alloca(&pcmOutStatus);
-	snd_pcm_status(pcmOut, pcmOutStatus);
-	pcmOutSize = snd_pcm_status_get_avail_max(pcmOutStatus);
+		ALSA_TRACE_BEGIN(trace);
+		if (pcmCopyHandle->mmapOut)
+			nbWritten = AlsaPcmMmapWrite(pcmOut, buf, used, pcmCopyHandle->frame_size);
+		else
+			nbWritten = snd_pcm_writei( pcmOut, buf, used);
+		ALSA_TRACE_END(trace, "snd_pcm_writei");
+		if (nbWritten <= 0) {
+			if (nbWritten == -EPIPE) {
+				int err = xrun(pcmOut, (int)nbWritten);
+				ALSA_STATS_ADD(stats->playback.xruns, 1);
+				ALSA_RT_LOG(pcmCopyHandle->api, ALSA_LOG_DEBUG, "AlsaPcmWriteCB: stream=%s write EPIPE xruns=%ld recover=%ld", pcmCopyHandle->info, atomic_load(&stats->playback.xruns), err, 0);
 
-	/* This threshold is the expected space available in the hw output buffer
-	 * The aim is to wait to have a significant amount of space, in order to
-	 * avoid to write to the device too often, or take a very small amount of
-	 * frames from the ring buffer. So basically, this saves some CPU load */
+				continue;
+			} else if (nbWritten == -ESTRPIPE) {
+				ALSA_RT_LOG(pcmCopyHandle->api, ALSA_LOG_DEBUG, "AlsaPcmWriteCB: stream=%s write ESTRPIPE", pcmCopyHandle->info, 0, 0, 0);
+				ALSA_STATS_ADD(stats->playback.suspends, 1);
+				break;
+			}
+			ALSA_RT_LOG(pcmCopyHandle->api, ALSA_LOG_DEBUG, "AlsaPcmWriteCB: stream=%s unhandled write error=%ld", pcmCopyHandle->info, nbWritten, 0, 0);
+			break;
+		}
 
-	threshold = pcmOutSize / 3;
+		if (drift)
+			AlsaDriftRelease(drift, nbWritten);
+		else
+			alsa_ringbuf_frames_pop_commit(rbuf, nbWritten);
+		copied += nbWritten;
+	}
 
-	for (;;) {
+	AlsaStatsWakeup(&stats->playback, wakeNs, 0, copied);
+	return 0;
+}
 
-		sem_wait(&pcmCopyHandle->sem);
+static void *writeThreadEntry(void *handle) {
+    AlsaPcmCopyHandleT *pcmCopyHandle = (AlsaPcmCopyHandleT*) handle;
 
-		while (true) {
-			snd_pcm_sframes_t used, nbWritten;
-			snd_pcm_sframes_t availOut = snd_pcm_avail(pcmOut);
+    // pollFds[0] is the producer eventfd, [1] the stop eventfd, following ones belong to the playback PCM
+    struct pollfd pollFds[COPY_POLL_FDS_MAX];
 
-			if (availOut < 0) {
-				if (availOut == -EPIPE) {
-					AFB_ApiDebug(pcmCopyHandle->api, "write update EPIPE");
-					xrun(pcmOut, (int)availOut);
-					continue;
-				}
-				if (availOut == -ESTRPIPE) {
-					AFB_ApiDebug(pcmCopyHandle->api, "write update ESTRPIPE");
-					suspend(pcmOut, (int)availOut);
-					continue;
-				}
-			}
+  while (CopyThreadPark(pcmCopyHandle, true)) {
+    snd_pcm_t * pcmOut = pcmCopyHandle->pcmOut->handle;
+    int pcmOutCount = snd_pcm_poll_descriptors_count(pcmOut);
+    eventfd_t ticks;
 
-			// no space for output
-			if (availOut <= threshold) {
-				usleep(500);
-				continue;
-			}
+    if (pcmOutCount > COPY_POLL_FDS_MAX - 2) {
+    	ALSA_RT_LOG(pcmCopyHandle->api, ALSA_LOG_WARNING, "writeThreadEntry: stream=%s too many playback fds=%ld", pcmCopyHandle->info, pcmOutCount, 0, 0);
+    	pcmOutCount = COPY_POLL_FDS_MAX - 2;
+    }
 
-			pthread_mutex_lock(&pcmCopyHandle->mutex);
-			used = alsa_ringbuf_frames_used(rbuf);
-			if (used <= 0) {
-				pthread_mutex_unlock(&pcmCopyHandle->mutex);
-				break; // will wait again
-			}
+    pollFds[0].fd = pcmCopyHandle->wakeFd;
+    pollFds[0].events = POLLIN;
+    pollFds[1].fd = pcmCopyHandle->ctlFd;
+    pollFds[1].events = POLLIN;
+    snd_pcm_poll_descriptors(pcmOut, &pollFds[2], pcmOutCount);
 
-			if (used > availOut)
-				used = availOut;
+	while (atomic_load_explicit(&pcmCopyHandle->running, memory_order_acquire)) {
+		int err;
 
-			char buf[used*pcmCopyHandle->frame_size];
-			alsa_ringbuf_frames_pop(rbuf, buf, used);
-			pthread_mutex_unlock(&pcmCopyHandle->mutex);
+		// drain pending wakeups before looking at the ring, so that none may be lost
+		eventfd_read(pcmCopyHandle->wakeFd, &ticks);
 
-			nbWritten = snd_pcm_writei( pcmOut, buf, used);
-			if (nbWritten <= 0) {
-				if (nbWritten == -EPIPE) {
-					int err = xrun(pcmOut, (int)nbWritten);
-					AFB_ApiDebug(pcmCopyHandle->api, "XXX write EPIPE (%d), recov %d", ++pcmCopyHandle->write_err_count , err);
-
-					continue;
-				} else if (nbWritten == -ESTRPIPE) {
-					AFB_ApiDebug(pcmCopyHandle->api, "XXX write ESTRPIPE");
-					break;
-				}
-				AFB_ApiDebug(pcmCopyHandle->api, "Unhandled error %s", strerror(errno));
-				break;
-			}
+		AlsaPcmWriteCB(pcmCopyHandle);
 
+		// nothing left to play: wait for the producer, else wait for room in the output PCM
+		if (alsa_ringbuf_is_empty(pcmCopyHandle->rbuf)) {
+			err = poll(pollFds, 2, LOOP_TIMEOUT_MSEC);
+		} else {
+			unsigned short revents;
+			err = poll(&pollFds[1], pcmOutCount + 1, LOOP_TIMEOUT_MSEC);
+			if (err > 0)
+				snd_pcm_poll_descriptors_revents(pcmOut, &pollFds[2], pcmOutCount, &revents);
 		}
 
+		if (err < 0 && errno != EINTR) {
+			ALSA_RT_LOG(pcmCopyHandle->api, ALSA_LOG_ERROR, "writeThreadEntry: stream=%s poll errno=%ld", pcmCopyHandle->info, errno, 0, 0);
+		}
 	}
 
+	// consume the stop order
+	eventfd_read(pcmCopyHandle->ctlFd, &ticks);
+  }
+
    	pthread_exit(0);
    	return NULL;
 }
 
 
+STATIC void CopyDestroy(AlsaPcmCopyHandleT *cHandle) {
+
+    // only valid on a stopped handle, parked threads exit
+    pthread_mutex_lock(&cHandle->lock);
+    cHandle->quit = true;
+    pthread_cond_broadcast(&cHandle->cond);
+    pthread_mutex_unlock(&cHandle->lock);
+
+    if (cHandle->threads > 0) pthread_join(cHandle->rthread, NULL);
+    if (cHandle->threads > 1) pthread_join(cHandle->wthread, NULL);
+
+    if (cHandle->ctlFd >= 0) close(cHandle->ctlFd);
+    if (cHandle->rbuf) alsa_ringbuf_free(cHandle->rbuf);
+    pthread_cond_destroy(&cHandle->cond);
+    pthread_mutex_destroy(&cHandle->lock);
+    free(cHandle);
+}
+
+STATIC AlsaPcmCopyHandleT *CopyCreate(SoftMixerT *mixer) {
+    AlsaPcmCopyHandleT *cHandle = calloc(1, sizeof (AlsaPcmCopyHandleT));
+    int error;
+
+    pthread_mutex_init(&cHandle->lock, NULL);
+    pthread_cond_init(&cHandle->cond, NULL);
+    atomic_init(&cHandle->running, false);
+    cHandle->api = mixer->api;
+    cHandle->info = "pcmCpy";
+    cHandle->wakeFd = -1;
+    cHandle->ctlFd = -1;
+
+    // shared engine workers service the stream, no thread of its own
+    if (mixer->engine.mode == COPY_ENGINE_SHARED)
+        return cHandle;
+
+    cHandle->ctlFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (cHandle->ctlFd < 0) {
+        AFB_ApiError(mixer->api, "%s: Fail to create stop eventfd err=%s", __func__, strerror(errno));
+        goto OnErrorExit;
+    }
+
+    // threads start parked, AlsaPcmCopy releases them
+    if ((error = pthread_create(&cHandle->rthread, NULL, &readThreadEntry, cHandle)) != 0) {
+        AFB_ApiError(mixer->api, "%s: Fail create read thread err=%d", __func__, error);
+        goto OnErrorExit;
+    }
+    cHandle->threads++;
+
+    if ((error = pthread_create(&cHandle->wthread, NULL, &writeThreadEntry, cHandle)) != 0) {
+        AFB_ApiError(mixer->api, "%s: Fail create write thread err=%d", __func__, error);
+        goto OnErrorExit;
+    }
+    cHandle->threads++;
+
+    // request a higher priority for each audio stream thread
+    AlsaPcmThreadPriority(mixer, cHandle->rthread, "copy read");
+    AlsaPcmThreadPriority(mixer, cHandle->wthread, "copy write");
+
+    return cHandle;
+
+OnErrorExit:
+    CopyDestroy(cHandle);
+    return NULL;
+}
+
+STATIC AlsaPcmCopyHandleT *CopyPoolTake(SoftMixerT *mixer) {
+    AlsaCopyPoolT *pool = mixer->engine.spare;
+    AlsaPcmCopyHandleT *cHandle = NULL;
+
+    if (pool) {
+        pthread_mutex_lock(&pool->lock);
+        if (pool->count > 0) cHandle = pool->handles[--pool->count];
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    // pool is empty: cold creation
+    if (!cHandle) cHandle = CopyCreate(mixer);
+    return cHandle;
+}
+
+STATIC void CopyPoolPut(SoftMixerT *mixer, AlsaPcmCopyHandleT *cHandle) {
+    AlsaCopyPoolT *pool = mixer->engine.spare;
+
+    if (pool) {
+        pthread_mutex_lock(&pool->lock);
+        if (pool->count < pool->max) {
+            pool->handles[pool->count++] = cHandle;
+            cHandle = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    if (cHandle) CopyDestroy(cHandle);
+}
+
+// pool keeps every stopped handle (up to max_stream + pool), 'pool' of them are created upfront
+PUBLIC int AlsaPcmCopyPoolInit(SoftMixerT *mixer) {
+    AlsaCopyPoolT *pool = calloc(1, sizeof (AlsaCopyPoolT));
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->max = (int) mixer->max.streams + mixer->engine.pool;
+    pool->handles = calloc(pool->max, sizeof (AlsaPcmCopyHandleT*));
+    mixer->engine.spare = pool;
+
+    for (int idx = 0; idx < mixer->engine.pool; idx++) {
+        AlsaPcmCopyHandleT *cHandle = CopyCreate(mixer);
+        if (!cHandle) goto OnErrorExit;
+        pool->handles[pool->count++] = cHandle;
+    }
+
+    AFB_ApiNotice(mixer->api, "%s: mixer=%s %d copy handle(s) ready", __func__, mixer->uid, pool->count);
+    return 0;
+
+OnErrorExit:
+    return -1;
+}
+
+PUBLIC void AlsaPcmCopyPoolFree(SoftMixerT *mixer) {
+    AlsaCopyPoolT *pool = mixer->engine.spare;
+    if (!pool) return;
+
+    for (int idx = 0; idx < pool->count; idx++)
+        CopyDestroy(pool->handles[idx]);
+
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->handles);
+    free(pool);
+    mixer->engine.spare = NULL;
+}
+
+/*
+ * Stop a running copy and release every stream resource. Consumers are detached
+ * first, then copy threads park (or the engine worker drops the stream), so that
+ * nothing touches PCMs or ring anymore when they are closed. The handle, its
+ * threads and its ring go back to the pool.
+ *
+ * An idle stream keeps its capture PCM open (stopped, ctl and verb still use it)
+ * with its negotiated hw/sw params, and its ring is released: the next AlsaPcmCopy
+ * skips capture configuration and only re-prepares and restarts it.
+ */
+PUBLIC void AlsaPcmCopyStop(SoftMixerT *mixer, AlsaPcmCopyHandleT *copy, bool idle) {
+    AlsaPcmCtlT *pcmIn = copy->pcmIn, *pcmOut = copy->pcmOut;
+    bool mute = pcmIn->mute;
+
+    if (copy->mix)
+        AlsaMixDetach(mixer, copy);
+
+    if (copy->threads == 0) {
+        AlsaCopyEngineDetach(mixer, copy);
+    } else {
+        pthread_mutex_lock(&copy->lock);
+        atomic_store(&copy->running, false);
+
+        // wake up capture (mute pipe) and playback (stop eventfd) wherever they wait
+        ssize_t ret = write(pcmIn->muteFd, &mute, sizeof(mute));
+        (void) ret;
+        eventfd_write(copy->ctlFd, 1);
+
+        while (copy->parked < copy->threads)
+            pthread_cond_wait(&copy->cond, &copy->lock);
+        pthread_mutex_unlock(&copy->lock);
+    }
+
+    if (idle) {
+        snd_pcm_drop(pcmIn->handle);
+        alsa_ringbuf_free(copy->rbuf);
+        copy->rbuf = NULL;
+    } else {
+        snd_pcm_close(pcmIn->handle);
+        pcmIn->handle = NULL;
+    }
+
+    if (pcmOut) {
+        snd_pcm_close(pcmOut->handle);
+        pcmOut->handle = NULL;
+        free(pcmOut->params);
+        pcmOut->params = NULL;
+    }
+
+    close(copy->pollFds[0].fd);
+    close(pcmIn->muteFd);
+    pcmIn->muteFd = -1;
+    if (copy->wakeFd >= 0) close(copy->wakeFd);
+
+    AlsaGainFree(pcmIn->gain);
+    pcmIn->gain = NULL;
+    if (copy->drift) AlsaDriftFree(copy->drift);
+
+    // forget the stream, threads and ring are kept for next one
+    copy->pcmIn = NULL;
+    copy->pcmOut = NULL;
+    copy->drift = NULL;
+    copy->wakeFd = -1;
+    copy->info = "pcmCpy";
+    memset(&copy->stats, 0, sizeof (copy->stats));
+
+    CopyPoolPut(mixer, copy);
+}
+
+// drop a pcm definition added to alsa-lib global config by alsa-plug-*.c
+PUBLIC void AlsaPcmConfigRemove(SoftMixerT *mixer, const char *pcmName) {
+    snd_config_t *pcmConfig, *plugConfig;
+
+    if (!pcmName) return;
+    if (snd_config_search(snd_config, "pcm", &pcmConfig) < 0) return;
+    if (snd_config_search(pcmConfig, pcmName, &plugConfig) < 0) return;
+
+    int error = snd_config_delete(plugConfig);
+    if (error < 0)
+        AFB_ApiWarning(mixer->api, "%s: fail to remove pcm=%s config error=%s", __func__, pcmName, snd_strerror(error));
+}
+
 PUBLIC int AlsaPcmCopyMuteSignal(SoftMixerT *mixer, AlsaPcmCtlT *pcmIn, bool mute) {
+	// copy not started (lazy startup, idle stream), initial state is read at start
+	if (pcmIn->muteFd <= 0) {
+		pcmIn->mute = mute;
+		return 0;
+	}
+
 	ssize_t ret = write(pcmIn->muteFd, &mute, sizeof(mute));
 	(void) ret;
 	return 0;
 }
 
+PUBLIC int AlsaPcmCopyVolumeSignal(SoftMixerT *mixer, AlsaPcmCtlT *pcmIn, long volume, unsigned int rampUsec) {
+	if (!pcmIn->gain)
+		return -1;
+
+	AlsaGainSetVolume(pcmIn->gain, volume, rampUsec);
+	return 0;
+}
+
 
+/*
+ * Start copying 'stream' capture into its ring, then to pcmOut (or to the sink mix
+ * thread when pcmOut is NULL). On success stream->copy is set, on failure everything
+ * set up here is released and stream->copy is left untouched.
+ */
 PUBLIC int AlsaPcmCopy(SoftMixerT *mixer, AlsaStreamAudioT *stream, AlsaPcmCtlT *pcmIn, AlsaPcmCtlT *pcmOut, AlsaPcmHwInfoT * opts) {
+    AlsaPcmCopyHandleT *cHandle = NULL;
+    int pMuteFd[2] = {-1, -1};
     char string[32];
     int error;
 
     // Fulup need to check https://www.alsa-project.org/alsa-doc/alsa-lib/group___p_c_m___direct.html
 
+    // pcmOut is NULL with native mixing, the ring is then consumed by the sink mix thread
     AlsaDumpPcmInfo(mixer,"PcmIn",pcmIn->handle);
-    AlsaDumpPcmInfo(mixer,"PcmOut",pcmOut->handle);
+    if (pcmOut) AlsaDumpPcmInfo(mixer,"PcmOut",pcmOut->handle);
 
-    AFB_ApiInfo(mixer->api, "%s: Configure CAPTURE PCM", __func__);
+    // idle stream resume: capture kept its negotiated params, it is only re-prepared below
+    bool resume = (pcmIn->params != NULL);
 
     /* remember configuration of capture */
-    pcmIn->params = (AlsaPcmHwInfoT*)malloc(sizeof(AlsaPcmHwInfoT));
-    memcpy(pcmIn->params, opts, sizeof(AlsaPcmHwInfoT));
-
-    pcmOut->params = (AlsaPcmHwInfoT*)malloc(sizeof(AlsaPcmHwInfoT));
-    memcpy(pcmOut->params, opts, sizeof(AlsaPcmHwInfoT));
-
+    if (!resume) {
+        pcmIn->params = (AlsaPcmHwInfoT*)malloc(sizeof(AlsaPcmHwInfoT));
+        memcpy(pcmIn->params, opts, sizeof(AlsaPcmHwInfoT));
+    }
     pcmIn->mixer = mixer;
-    pcmOut->mixer = mixer;
 
-    AFB_ApiInfo(mixer->api, "%s: Configure CAPTURE PCM", __func__);
+    if (pcmOut) {
+        pcmOut->params = (AlsaPcmHwInfoT*)malloc(sizeof(AlsaPcmHwInfoT));
+        memcpy(pcmOut->params, opts, sizeof(AlsaPcmHwInfoT));
+        pcmOut->mixer = mixer;
+    }
 
     // prepare PCM for capture and replay
-    error = AlsaPcmConf(mixer, pcmIn, SND_PCM_STREAM_CAPTURE);
-    if (error) {
-    	AFB_ApiError(mixer->api, "%s: PCM configuration for capture failed", __func__);
-    	goto OnErrorExit;
+    if (!resume) {
+        AFB_ApiInfo(mixer->api, "%s: Configure CAPTURE PCM", __func__);
+        error = AlsaPcmConf(mixer, pcmIn, SND_PCM_STREAM_CAPTURE);
+        if (error) {
+            AFB_ApiError(mixer->api, "%s: PCM configuration for capture failed", __func__);
+            goto OnErrorExit;
+        }
     }
 
-    AFB_ApiInfo(mixer->api, "%s: Configure PLAYBACK PCM", __func__);
+    if (pcmOut) {
+        AFB_ApiInfo(mixer->api, "%s: Configure PLAYBACK PCM", __func__);
 
-    // input and output should match
-    error = AlsaPcmConf(mixer, pcmOut, SND_PCM_STREAM_PLAYBACK);
-    if (error) {
-    	AFB_ApiError(mixer->api, "%s: PCM configuration for playback failed", __func__);
-    	goto OnErrorExit;
-    }
+        // input and output should match
+        error = AlsaPcmConf(mixer, pcmOut, SND_PCM_STREAM_PLAYBACK);
+        if (error) {
+            AFB_ApiError(mixer->api, "%s: PCM configuration for playback failed", __func__);
+            goto OnErrorExit;
+        }
 
-    // Prepare PCM for usage
-    if ((error = snd_pcm_prepare(pcmOut->handle)) < 0) {
-        AFB_ApiError(mixer->api, "%s: Fail to prepare PLAYBACK PCM=%s error=%s", __func__, ALSA_PCM_UID(pcmOut->handle, string), snd_strerror(error));
-        goto OnErrorExit;
-    };
+        // Prepare PCM for usage
+        if ((error = snd_pcm_prepare(pcmOut->handle)) < 0) {
+            AFB_ApiError(mixer->api, "%s: Fail to prepare PLAYBACK PCM=%s error=%s", __func__, ALSA_PCM_UID(pcmOut->handle, string), snd_strerror(error));
+            goto OnErrorExit;
+        };
+
+        // Start PCM
+        if ((error = snd_pcm_start(pcmOut->handle)) < 0) {
+            AFB_ApiError(mixer->api, "%s: Fail to start PLAYBACK PCM=%s error=%s", __func__, ALSA_PCM_UID(pcmOut->handle, string), snd_strerror(error));
+            goto OnErrorExit;
+        };
+    }
 
     // Prepare PCM for usage
     if ((error = snd_pcm_prepare(pcmIn->handle)) < 0) {
-        AFB_ApiError(mixer->api, "%s: Fail to prepare CAPTURE PCM=%s error=%s", __func__, ALSA_PCM_UID(pcmOut->handle, string), snd_strerror(error));
-        goto OnErrorExit;
-    };
-
-    // Start PCM
-    if ((error = snd_pcm_start(pcmOut->handle)) < 0) {
-        AFB_ApiError(mixer->api, "%s: Fail to start PLAYBACK PCM=%s error=%s", __func__, ALSA_PCM_UID(pcmIn->handle, string), snd_strerror(error));
+        AFB_ApiError(mixer->api, "%s: Fail to prepare CAPTURE PCM=%s error=%s", __func__, ALSA_PCM_UID(pcmIn->handle, string), snd_strerror(error));
         goto OnErrorExit;
     };
 
@@ -696,9 +1122,14 @@ PUBLIC int AlsaPcmCopy(SoftMixerT *mixer, AlsaStreamAudioT *stream, AlsaPcmCtlT
         goto OnErrorExit;
     };
 
-    AlsaPcmCopyHandleT *cHandle= calloc(1, sizeof(AlsaPcmCopyHandleT));
+    cHandle = CopyPoolTake(mixer);
+    if (!cHandle) {
+        AFB_ApiError(mixer->api, "%s: Fail to get a copy handle", __func__);
+        goto OnErrorExit;
+    }
 
-    cHandle->info = "pcmCpy";
+    cHandle->info = stream->uid ? (char*) stream->uid : "pcmCpy";
+    cHandle->wakeFd = -1;
     cHandle->pcmIn = pcmIn;
     cHandle->pcmOut = pcmOut;
     cHandle->api = mixer->api;
@@ -708,12 +1139,57 @@ PUBLIC int AlsaPcmCopy(SoftMixerT *mixer, AlsaStreamAudioT *stream, AlsaPcmCtlT
 
 	AFB_ApiInfo(mixer->api, "%s: Frame size is %zu", __func__, cHandle->frame_size);
 
-	snd_pcm_uframes_t nbFrames = 2 * opts->rate; // Exactly 2 second of buffer
+	// use direct DMA access on each side where MMAP_INTERLEAVED was effectively negotiated
+	cHandle->mmapIn  = (pcmIn->params->access  == SND_PCM_ACCESS_MMAP_INTERLEAVED);
+	cHandle->mmapOut = (pcmOut && pcmOut->params->access == SND_PCM_ACCESS_MMAP_INTERLEAVED);
+
+	AFB_ApiInfo(mixer->api, "%s: copy mode capture=%s playback=%s", __func__,
+	            cHandle->mmapIn?"mmap":"rw", cHandle->mmapOut?"mmap":"rw");
+
+	// copy ring holds twice the largest hw buffer, this is enough headroom as frames
+	// are forwarded to playback as soon as one playback period is available
+	snd_pcm_uframes_t nbFrames = pcmIn->params->buffer_frames;
+	if (pcmOut && pcmOut->params->buffer_frames > nbFrames)
+		nbFrames = pcmOut->params->buffer_frames;
+	nbFrames *= 2;
+
+    // ring of a previous stream is reused when large enough
+    if (cHandle->rbuf && (cHandle->rbuf->frameSize != cHandle->frame_size || alsa_ringbuf_capacity(cHandle->rbuf) < nbFrames)) {
+        alsa_ringbuf_free(cHandle->rbuf);
+        cHandle->rbuf = NULL;
+    }
+    if (cHandle->rbuf) alsa_ringbuf_reset(cHandle->rbuf);
+    else cHandle->rbuf = alsa_ringbuf_new(nbFrames, cHandle->frame_size);
+    if (!cHandle->rbuf) {
+        AFB_ApiError(mixer->api, "%s: Fail to allocate copy buffer nbframes=%zu", __func__, nbFrames);
+        goto OnErrorExit;
+    }
+
+	// capture period is the reference of wakeup jitter
+	if (pcmIn->params->rate) {
+		cHandle->stats.periodNs = (uint64_t) pcmIn->params->period_frames * 1000000000ULL / pcmIn->params->rate;
+	}
+
+	/* This threshold is the expected space available in the hw output buffer.
+	 * It matches the playback avail_min (one period), so that the playback
+	 * thread sleeps in poll() until the PCM can take a full period */
+	if (pcmOut) cHandle->write_threshold = pcmOut->avail_min;
 
-    cHandle->rbuf = alsa_ringbuf_new(nbFrames, cHandle->frame_size);
+	/* Capture wakes up playback once the ring holds a full playback period */
+	if (pcmOut) cHandle->wake_threshold = pcmOut->avail_min;
 
-    cHandle->read_err_count  = 0;
-    cHandle->write_err_count = 0;
+	// native volume, stream->volume holds the ctl numid, start gain from the initial volume in %
+	if (mixer->volume == VOLUME_NATIVE) {
+		pcmIn->gain = AlsaGainCreate(mixer, pcmIn->params, stream->start.volume);
+		if (!pcmIn->gain) goto OnErrorExit;
+	}
+
+	// optional adaptive resampling between capture and sink clocks, native mixing resamples in its mix thread
+	if (stream->drift) {
+		AlsaPcmHwInfoT *params = pcmOut ? pcmOut->params : pcmIn->params;
+		cHandle->drift = AlsaDriftCreate(mixer, params, cHandle->frame_size, params->buffer_frames);
+		AFB_ApiInfo(mixer->api, "%s: drift compensation %s", __func__, cHandle->drift ? "enabled" : "disabled");
+	}
 
     AFB_ApiInfo(mixer->api, "%s Copy buffer nbframes is %zu", __func__, nbFrames);
 
@@ -729,7 +1205,7 @@ PUBLIC int AlsaPcmCopy(SoftMixerT *mixer, AlsaStreamAudioT *stream, AlsaPcmCtlT
     if (pcmInCount > 1) {
     	AFB_ApiError(mixer->api,
     	             "%s: Fail, pcmIn=%s; having more than one FD on capture PCM is not supported (here, %d)",
-    	             __func__, ALSA_PCM_UID(pcmOut->handle, string) , pcmInCount);
+    	             __func__, ALSA_PCM_UID(pcmIn->handle, string) , pcmInCount);
     	goto OnErrorExit;
     }
 
@@ -737,12 +1213,11 @@ PUBLIC int AlsaPcmCopy(SoftMixerT *mixer, AlsaStreamAudioT *stream, AlsaPcmCtlT
     if ((error = snd_pcm_poll_descriptors(pcmIn->handle, &pcmInFd, 1)) < 0) {
         AFB_ApiError(mixer->api,
                      "%s: Fail pcmIn=%s get pollfds error=%s",
-                     __func__, ALSA_PCM_UID(pcmOut->handle, string), snd_strerror(error));
+                     __func__, ALSA_PCM_UID(pcmIn->handle, string), snd_strerror(error));
         goto OnErrorExit;
     };
 
     // create the mute pipe
-    int pMuteFd[2];
     error = pipe(pMuteFd);
     if (error < 0) {
         AFB_ApiError(mixer->api,
@@ -764,65 +1239,72 @@ PUBLIC int AlsaPcmCopy(SoftMixerT *mixer, AlsaStreamAudioT *stream, AlsaPcmCtlT
 
     cHandle->nbPcmFds = pcmInCount+1;
 
-    error = sem_init(&cHandle->sem, 0 , 0);
-    if (error < 0) {
-    	AFB_ApiError(mixer->api,
-    	                     "%s Fail initialize loop semaphore pcmIn=%s err=%d",
-    	                     __func__, ALSA_PCM_UID(pcmIn->handle, string), error);
-    	goto OnErrorExit;
-    }
-
-    pthread_mutexattr_t attr;
-    pthread_mutexattr_init(&attr);
-    pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
-
-    error = pthread_mutex_init(&cHandle->mutex, &attr);
-    if (error < 0) {
-    	AFB_ApiError(mixer->api,
-    	                     "%s Fail initialize loop mutex pcmIn=%s err=%d",
-    	                     __func__, ALSA_PCM_UID(pcmIn->handle, string), error);
-    }
-
-
-    /// start a thread for writing
-    if ((error = pthread_create(&cHandle->wthread, NULL, &readThreadEntry, cHandle)) < 0) {
-        AFB_ApiError(mixer->api,
-                     "%s Fail create write thread pcmOut=%s err=%d",
-                     __func__, ALSA_PCM_UID(pcmOut->handle, string), error);
-        goto OnErrorExit;
-    }
-
-    // start a thread for reading
-    if ((error = pthread_create(&cHandle->rthread, NULL, &writeThreadEntry, cHandle)) < 0) {
-        AFB_ApiError(mixer->api,
-                     "%s Fail create read thread pcmIn=%s err=%d",
-                     __func__, ALSA_PCM_UID(pcmIn->handle, string), error);
-        goto OnErrorExit;
+    // shared engine: streams are multiplexed on a pool of per CPU workers
+    if (mixer->engine.mode == COPY_ENGINE_SHARED) {
+        error = AlsaCopyEngineAttach(mixer, cHandle);
+        if (error) {
+            AFB_ApiError(mixer->api,
+                         "%s Fail to attach pcmIn=%s to copy engine",
+                         __func__, ALSA_PCM_UID(pcmIn->handle, string));
+            goto OnErrorExit;
+        }
+        stream->copy = cHandle;
+        return 0;
     }
 
-    // request a higher priority for each audio stream thread
-    struct sched_param params;
-    params.sched_priority = sched_get_priority_max(SCHED_FIFO);
-
-    error= pthread_setschedparam(cHandle->rthread, SCHED_FIFO, &params);
-    if (error) {
-        AFB_ApiWarning(mixer->api,
-                       "%s: Failed to increase stream read thread priority pcmIn=%s err=%s",
-                       __func__, ALSA_PCM_UID(pcmIn->handle, string), strerror(error));
+    // producer to playback thread wakeup, native mixing is capture only: caller attaches the ring to its sink mix thread
+    if (pcmOut) {
+        cHandle->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (cHandle->wakeFd < 0) {
+            AFB_ApiError(mixer->api,
+                         "%s Fail to create wakeup eventfd pcmIn=%s err=%s",
+                         __func__, ALSA_PCM_UID(pcmIn->handle, string), strerror(errno));
+            goto OnErrorExit;
+        }
     }
 
-    error= pthread_setschedparam(cHandle->wthread, SCHED_FIFO, &params);
-    if (error) {
-        AFB_ApiWarning(mixer->api,
-                       "%s: Failed to increase stream write thread priority pcmIn=%s err=%s",
-                       __func__, ALSA_PCM_UID(pcmOut->handle, string), strerror(error));
-    }
+    // release parked copy threads
+    pthread_mutex_lock(&cHandle->lock);
+    atomic_store(&cHandle->running, true);
+    pthread_cond_broadcast(&cHandle->cond);
+    pthread_mutex_unlock(&cHandle->lock);
 
+    stream->copy = cHandle;
     return 0;
 
 OnErrorExit:
     AFB_ApiError(mixer->api, "%s: - pcmIn=%s" , __func__, ALSA_PCM_UID(pcmIn->handle, string));
-    AFB_ApiError(mixer->api, "%s: - pcmOut=%s", __func__, ALSA_PCM_UID(pcmOut->handle, string));
+    if (pcmOut) AFB_ApiError(mixer->api, "%s: - pcmOut=%s", __func__, ALSA_PCM_UID(pcmOut->handle, string));
+
+    // copy threads never ran: PCMs are stopped, fds, gain and resampler released, the handle goes back to the pool
+    snd_pcm_drop(pcmIn->handle);
+    if (pcmOut) snd_pcm_drop(pcmOut->handle);
+
+    if (pMuteFd[0] >= 0) close(pMuteFd[0]);
+    if (pMuteFd[1] >= 0) close(pMuteFd[1]);
+    pcmIn->muteFd = -1;
+
+    AlsaGainFree(pcmIn->gain);
+    pcmIn->gain = NULL;
+
+    if (cHandle) {
+        if (cHandle->wakeFd >= 0) close(cHandle->wakeFd);
+        if (cHandle->drift) AlsaDriftFree(cHandle->drift);
+        cHandle->pcmIn = NULL;
+        cHandle->pcmOut = NULL;
+        cHandle->drift = NULL;
+        cHandle->wakeFd = -1;
+        cHandle->info = "pcmCpy";
+        memset(&cHandle->stats, 0, sizeof (cHandle->stats));
+        CopyPoolPut(mixer, cHandle);
+    }
+
+    free(pcmIn->params);
+    pcmIn->params = NULL;
+    if (pcmOut) {
+        free(pcmOut->params);
+        pcmOut->params = NULL;
+    }
     return -1;
 }
 
@@ -0,0 +1,97 @@
+/*
+ * Copyright(C) 2018 "IoT.bzh"
+ * Author Fulup Ar Foll <fulup@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http : //www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Per stream copy statistics. Counters are updated by the copy threads without
+ * any lock (each direction has a single writer) and read from the binder main
+ * loop when a client asks for stream info or mixer stats.
+ */
+
+#define _GNU_SOURCE  // needed for vasprintf
+
+#include "alsa-softmixer.h"
+#include <time.h>
+
+PUBLIC uint64_t AlsaStatsNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+STATIC void StatsMax(atomic_ullong *field, uint64_t value) {
+    if (value > atomic_load_explicit(field, memory_order_relaxed))
+        atomic_store_explicit(field, value, memory_order_relaxed);
+}
+
+// one wakeup of a copy thread: processing time since 'startNs', and jitter against 'periodNs' when not null
+PUBLIC void AlsaStatsWakeup(AlsaPcmDirStatsT *dir, uint64_t startNs, uint64_t periodNs, snd_pcm_uframes_t frames) {
+    uint64_t busy = AlsaStatsNow() - startNs;
+
+    ALSA_STATS_ADD(dir->wakeups, 1);
+    ALSA_STATS_ADD(dir->frames, frames);
+    ALSA_STATS_ADD(dir->busyNs, busy);
+    StatsMax(&dir->busyMaxNs, busy);
+
+    if (periodNs && dir->lastWakeNs) {
+        uint64_t interval = startNs - dir->lastWakeNs;
+        uint64_t jitter = (interval > periodNs) ? interval - periodNs : periodNs - interval;
+        ALSA_STATS_ADD(dir->jitterNs, jitter);
+        StatsMax(&dir->jitterMaxNs, jitter);
+    }
+    dir->lastWakeNs = startNs;
+}
+
+PUBLIC void AlsaStatsFill(AlsaPcmCopyStatsT *stats, size_t used, size_t capacity) {
+    if (!capacity) return;
+
+    size_t bin = (used * ALSA_STATS_FILL_BINS) / capacity;
+    if (bin >= ALSA_STATS_FILL_BINS) bin = ALSA_STATS_FILL_BINS - 1;
+    ALSA_STATS_ADD(stats->fill[bin], 1);
+}
+
+STATIC json_object *StatsDirJson(AlsaPcmDirStatsT *dir) {
+    json_object *dirJ;
+    uint64_t wakeups = atomic_load_explicit(&dir->wakeups, memory_order_relaxed);
+    uint64_t busy = atomic_load_explicit(&dir->busyNs, memory_order_relaxed);
+    uint64_t jitter = atomic_load_explicit(&dir->jitterNs, memory_order_relaxed);
+
+    wrap_json_pack(&dirJ, "{sI,si,si,sI,sI,sI,sI,sI}"
+            , "frames", (int64_t) atomic_load_explicit(&dir->frames, memory_order_relaxed)
+            , "xruns", (int) atomic_load_explicit(&dir->xruns, memory_order_relaxed)
+            , "suspends", (int) atomic_load_explicit(&dir->suspends, memory_order_relaxed)
+            , "wakeups", (int64_t) wakeups
+            , "busy_avg_ns", (int64_t) (wakeups ? busy / wakeups : 0)
+            , "busy_max_ns", (int64_t) atomic_load_explicit(&dir->busyMaxNs, memory_order_relaxed)
+            , "jitter_avg_ns", (int64_t) (wakeups > 1 ? jitter / (wakeups - 1) : 0)
+            , "jitter_max_ns", (int64_t) atomic_load_explicit(&dir->jitterMaxNs, memory_order_relaxed)
+            );
+    return dirJ;
+}
+
+PUBLIC json_object *AlsaStatsJson(AlsaPcmCopyHandleT *copy) {
+    json_object *statsJ, *fillJ = json_object_new_array();
+
+    for (int idx = 0; idx < ALSA_STATS_FILL_BINS; idx++) {
+        json_object_array_add(fillJ, json_object_new_int64((int64_t) atomic_load_explicit(&copy->stats.fill[idx], memory_order_relaxed)));
+    }
+
+    wrap_json_pack(&statsJ, "{so,so,so,sI}"
+            , "capture", StatsDirJson(&copy->stats.capture)
+            , "playback", StatsDirJson(&copy->stats.playback)
+            , "fill", fillJ
+            , "period_ns", (int64_t) copy->stats.periodNs
+            );
+    return statsJ;
+}
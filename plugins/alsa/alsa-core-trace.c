@@ -0,0 +1,130 @@
+/*
+ * Copyright(C) 2018 "IoT.bzh"
+ * Author Fulup Ar Foll <fulup@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http : //www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Period level tracing: ALSA_TRACE_BEGIN/END record the duration of hot path
+ * sections into a per thread ring of events (no lock, single writer). The mixer
+ * 'trace' verb switches recording at runtime and dumps every ring as a
+ * Chrome/Perfetto JSON trace. When disabled, a section costs one predictable
+ * branch; building with SMIXER_TRACE_DISABLE removes it completely.
+ */
+
+#define _GNU_SOURCE  // needed for vasprintf
+
+#include "alsa-softmixer.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#define TRACE_RING_EVENTS 8192  // per thread, oldest events are overwritten
+
+typedef struct {
+    const char *name;
+    uint64_t startNs;
+    uint64_t durNs;
+} AlsaTraceEventT;
+
+typedef struct AlsaTraceRingS {
+    int tid;
+    atomic_ulong head;  // events ever written, slot is head % TRACE_RING_EVENTS
+    AlsaTraceEventT events[TRACE_RING_EVENTS];
+    struct AlsaTraceRingS *next;
+} AlsaTraceRingT;
+
+PUBLIC atomic_bool AlsaTraceEnabled;
+
+static _Atomic (AlsaTraceRingT*) traceRings;
+static __thread AlsaTraceRingT *traceRing;
+
+// first event of a thread: allocate its ring and link it (lock free push)
+STATIC AlsaTraceRingT *TraceRingGet(void) {
+    if (traceRing) return traceRing;
+
+    AlsaTraceRingT *ring = calloc(1, sizeof (AlsaTraceRingT));
+    if (!ring) return NULL;
+    ring->tid = (int) syscall(SYS_gettid);
+
+    ring->next = atomic_load(&traceRings);
+    while (!atomic_compare_exchange_weak(&traceRings, &ring->next, ring));
+
+    traceRing = ring;
+    return ring;
+}
+
+PUBLIC void AlsaTraceRecord(const char *name, uint64_t startNs) {
+    AlsaTraceRingT *ring = TraceRingGet();
+    if (!ring) return;
+
+    unsigned long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    AlsaTraceEventT *event = &ring->events[head % TRACE_RING_EVENTS];
+    event->name = name;
+    event->startNs = startNs;
+    event->durNs = AlsaStatsNow() - startNs;
+
+    // publish the event to the dumper
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+PUBLIC void AlsaTraceEnable(bool enable) {
+    atomic_store(&AlsaTraceEnabled, enable);
+}
+
+// forget recorded events, rings stay allocated for their threads
+PUBLIC void AlsaTraceClear(void) {
+    for (AlsaTraceRingT *ring = atomic_load(&traceRings); ring; ring = ring->next)
+        atomic_store(&ring->head, 0);
+}
+
+/*
+ * Write every ring as Chrome trace 'complete' events (ph=X, timestamps in us).
+ * Rings keep being written while dumping: an event overwritten meanwhile may be
+ * reported with its newer content, which is acceptable for a diagnostic.
+ */
+PUBLIC int AlsaTraceDump(SoftMixerT *mixer, const char *path, int *count) {
+    int pid = (int) getpid();
+    bool first = true;
+    FILE *file = NULL;
+
+    // shared directories such as /tmp: never follow a planted symlink
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd >= 0) file = fdopen(fd, "w");
+
+    *count = 0;
+    if (!file) {
+        AFB_ApiError(mixer->api, "%s: fail to open trace file=%s error=%s", __func__, path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (AlsaTraceRingT *ring = atomic_load(&traceRings); ring; ring = ring->next) {
+        unsigned long head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        unsigned long tail = (head > TRACE_RING_EVENTS) ? head - TRACE_RING_EVENTS : 0;
+
+        for (unsigned long idx = tail; idx < head; idx++) {
+            AlsaTraceEventT *event = &ring->events[idx % TRACE_RING_EVENTS];
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    first ? "" : ",\n", event->name, pid, ring->tid,
+                    (double) event->startNs / 1000.0, (double) event->durNs / 1000.0);
+            first = false;
+            (*count)++;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    AFB_ApiNotice(mixer->api, "%s: %d events written to %s", __func__, *count, path);
+    return 0;
+}
@@ -45,6 +45,7 @@ STATIC int VolRampTimerCB(sd_event_source* source, uint64_t timer, void* handle)
     VolRampHandleT *rHandle = (VolRampHandleT*)handle;
     int error;
     uint64_t usec;
+    ALSA_TRACE_BEGIN(trace);
 
     // RampDown
     if (rHandle->current > rHandle->target) {
@@ -64,6 +65,7 @@ STATIC int VolRampTimerCB(sd_event_source* source, uint64_t timer, void* handle)
     // we reach target stop volram event
     if (rHandle->current == rHandle->target) {
         sd_event_source_unref(rHandle->evtsrc);
+        free((char*) rHandle->uid);
         free(rHandle);
     } else {
         // otherwise validate timer for a new run
@@ -72,14 +74,26 @@ STATIC int VolRampTimerCB(sd_event_source* source, uint64_t timer, void* handle)
         error = sd_event_source_set_time(rHandle->evtsrc, usec + rHandle->ramp->delay);
     }
 
+    ALSA_TRACE_END(trace, "VolRampTimerCB");
     return 0;
 
 OnErrorExit:
     AFB_ApiWarning(rHandle->mixer->api, "VolRampTimerCB stream=%s numid=%d value=%ld", rHandle->uid, rHandle->numid, rHandle->current);
     sd_event_source_unref(source); // abandon volRamp
+    free((char*) rHandle->uid);
+    free(rHandle);
     return -1;
 }
 
+// native volume: duration of the whole ramp from 'curvol' to 'newvol', played as one smooth fade
+PUBLIC unsigned int AlsaVolRampUsec(AlsaVolRampT *ramp, long curvol, long newvol) {
+    long step = (newvol < curvol) ? ramp->stepDown : ramp->stepUp;
+    long delta = labs(newvol - curvol);
+    if (step <= 0) step = 1;
+
+    return (unsigned int) (((delta + step - 1) / step) * ramp->delay);
+}
+
 PUBLIC int AlsaVolRampApply(SoftMixerT *mixer, AlsaSndCtlT *sndcard, AlsaStreamAudioT *stream, json_object *rampJ) {
     long curvol, newvol;
     const char *uid, *volS;
@@ -97,6 +111,12 @@ PUBLIC int AlsaVolRampApply(SoftMixerT *mixer, AlsaSndCtlT *sndcard, AlsaStreamA
         goto OnErrorExit;
     }
 
+    error = AlsaCtlNumidGetLong(mixer, sndcard, stream->volume, &curvol);
+    if (error) {
+        AFB_ApiError(mixer->api, "AlsaVolRampApply:mixer=%s stream=%s ramp=%s Fail to get volume from numid=%d", mixer->uid, stream->uid, uid, stream->volume);
+        goto OnErrorExit;
+    }
+
     switch (json_object_get_type(volJ)) {
 
         case json_type_string:
@@ -139,12 +159,6 @@ PUBLIC int AlsaVolRampApply(SoftMixerT *mixer, AlsaSndCtlT *sndcard, AlsaStreamA
 
     }
 
-    error = AlsaCtlNumidGetLong(mixer, sndcard, stream->volume, &curvol);
-    if (error) {
-        AFB_ApiError(mixer->api, "AlsaVolRampApply:mixer=%s stream=%s ramp=%s Fail to get volume from numid=%d", mixer->uid, stream->uid, uid, stream->volume);
-        goto OnErrorExit;
-    }
-    
     // search for ramp uid in mixer
     for (index=0; index<= mixer->max.ramps; index++) {
         if (!strcasecmp(mixer->ramps[index]->uid, uid)) {
@@ -157,8 +171,16 @@ PUBLIC int AlsaVolRampApply(SoftMixerT *mixer, AlsaSndCtlT *sndcard, AlsaStreamA
         goto OnErrorExit;        
     }
 
+    // native volume: the copy thread interpolates the whole ramp per sample, ctl is set once to final value
+    if (stream->copy && stream->copy->pcmIn->gain) {
+        AlsaPcmCopyVolumeSignal(mixer, stream->copy->pcmIn, newvol, AlsaVolRampUsec(mixer->ramps[index], curvol, newvol));
+        error = AlsaCtlNumidSetLong(mixer, sndcard, stream->volume, newvol);
+        if (error) goto OnErrorExit;
+        return 0;
+    }
+
     VolRampHandleT *rHandle = calloc(1, sizeof (VolRampHandleT));
-    rHandle->uid = stream->uid;
+    rHandle->uid = strdup(stream->uid); // stream may be closed before ramp ends
     rHandle->numid = stream->volume;
     rHandle->sndcard = sndcard;
     rHandle->mixer = mixer;
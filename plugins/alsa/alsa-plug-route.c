@@ -29,6 +29,7 @@ typedef struct {
     int cardidx;
     int ccount;
     int port;
+    AlsaSndPcmT *sink;
 } ChannelCardPortT;
 
 STATIC int CardChannelByUid(SoftMixerT *mixer, const char *uid, ChannelCardPortT *response) {
@@ -54,6 +55,7 @@ STATIC int CardChannelByUid(SoftMixerT *mixer, const char *uid, ChannelCardPortT
                 response->ccount  = pcm->ccount;
                 response->cardid  = pcm->sndcard->cid.cardid;
                 response->cardidx = pcm->sndcard->cid.cardidx;
+                response->sink    = pcm;
                 found = true;
                 break;
             }
@@ -73,6 +75,74 @@ OnErrorExit:
     return -1;
 }
 
+// zone over several sound cards: one 'multi' pcm binds its channels to every card dmix, in zone card order
+STATIC char *CreateMultiConfig(SoftMixerT *mixer, AlsaSndZoneT *zone) {
+    snd_config_t *multiConfig = NULL, *elemConfig, *slavesConfig, *slaveConfig, *bindingsConfig, *bindConfig, *pcmConfig;
+    char *multiUid = NULL, *dmixUid = NULL;
+    char idS[8];
+    int error = 0, channel = 0;
+
+    if (asprintf(&multiUid, "multi-%s", zone->uid) == -1)
+        goto OnErrorExit;
+
+    snd_config_update();
+    error += snd_config_top(&multiConfig);
+    error += snd_config_set_id(multiConfig, multiUid);
+    error += snd_config_imake_string(&elemConfig, "type", "multi");
+    error += snd_config_add(multiConfig, elemConfig);
+    error += snd_config_make_compound(&slavesConfig, "slaves", 0);
+    error += snd_config_make_compound(&bindingsConfig, "bindings", 0);
+    if (error) goto OnErrorExit;
+
+    for (int cdx = 0; zone->cards[cdx]; cdx++) {
+        AlsaSndPcmT *sink = zone->cards[cdx];
+
+        if (asprintf(&dmixUid, "dmix-%s", sink->uid) == -1)
+            goto OnErrorExit;
+
+        snprintf(idS, sizeof (idS), "%d", cdx);
+        error += snd_config_make_compound(&slaveConfig, idS, 0);
+        error += snd_config_imake_string(&elemConfig, "pcm", dmixUid);
+        error += snd_config_add(slaveConfig, elemConfig);
+        error += snd_config_imake_integer(&elemConfig, "channels", sink->ccount);
+        error += snd_config_add(slaveConfig, elemConfig);
+        error += snd_config_add(slavesConfig, slaveConfig);
+        free(dmixUid);
+        dmixUid = NULL;
+
+        // multi channels are every card channels, in card order
+        for (int chdx = 0; chdx < sink->ccount; chdx++, channel++) {
+            snprintf(idS, sizeof (idS), "%d", channel);
+            error += snd_config_make_compound(&bindConfig, idS, 0);
+            snprintf(idS, sizeof (idS), "%d", cdx);
+            error += snd_config_imake_string(&elemConfig, "slave", idS);
+            error += snd_config_add(bindConfig, elemConfig);
+            error += snd_config_imake_integer(&elemConfig, "channel", chdx);
+            error += snd_config_add(bindConfig, elemConfig);
+            error += snd_config_add(bindingsConfig, bindConfig);
+        }
+        if (error) goto OnErrorExit;
+    }
+
+    error += snd_config_add(multiConfig, slavesConfig);
+    error += snd_config_add(multiConfig, bindingsConfig);
+    error += snd_config_search(snd_config, "pcm", &pcmConfig);
+    error += snd_config_add(pcmConfig, multiConfig);
+    if (error) {
+        AFB_ApiError(mixer->api, "%s: zone(%s) fail to add config multi=%s error=%s", __func__, zone->uid, multiUid, snd_strerror(error));
+        goto OnErrorExit;
+    }
+
+    AlsaDumpCtlConfig(mixer, "plug-multi", multiConfig, 1);
+    return multiUid;
+
+OnErrorExit:
+    free(multiUid);
+    free(dmixUid);
+    AFB_ApiNotice(mixer->api, "%s: zone(%s) FAIL", __func__, zone->uid);
+    return NULL;
+}
+
 PUBLIC AlsaPcmCtlT* AlsaCreateRoute(SoftMixerT *mixer, AlsaSndZoneT *zone, int open) {
     snd_config_t *routeConfig, *elemConfig, *slaveConfig, *tableConfig, *pcmConfig;
     int scount=0, error = 0;
@@ -101,13 +171,49 @@ PUBLIC AlsaPcmCtlT* AlsaCreateRoute(SoftMixerT *mixer, AlsaSndZoneT *zone, int o
         goto OnErrorExit;
     }
     
-    // move from hardware to DMIX attach to sndcard
-    if (asprintf(&dmixUid, "dmix-%s", slave.uid) == -1)
-        goto OnErrorExit;
+    // sound cards holding zone channels, in zone order. Every card of a zone shares one rate and format
+    int ncards = 0, ccount = 0, maxport = 0;
+    zone->cards = calloc(mixer->max.sinks + 1, sizeof (AlsaSndPcmT*));
+    for (scount = 0; zone->sinks[scount] != NULL; scount++) {
+        int cdx;
+
+        error = CardChannelByUid(mixer, zone->sinks[scount]->uid, &channel);
+        if (error) {
+            AFB_ApiError(mixer->api, "AlsaCreateRoute:zone(%s) fail to find channel=%s", zone->uid, zone->sinks[scount]->uid);
+            goto OnErrorExit;
+        }
+        if (zone->sinks[scount]->port > maxport) maxport = zone->sinks[scount]->port;
+
+        for (cdx = 0; cdx < ncards; cdx++) {
+            if (zone->cards[cdx] == channel.sink) break;
+        }
+        if (cdx < ncards) continue;
+
+        AlsaPcmHwInfoT *first = zone->cards[0] ? zone->cards[0]->sndcard->params : NULL;
+        AlsaPcmHwInfoT *params = channel.sink->sndcard->params;
+        if (first && (first->rate != params->rate || first->format != params->format)) {
+            AFB_ApiError(mixer->api, "AlsaCreateRoute:zone(%s) sound cards should share rate and format %s[%d,%s] != %s[%d,%s]", zone->uid,
+                         slave.cardid, first->rate, first->formatS, channel.cardid, params->rate, params->formatS);
+            goto OnErrorExit;
+        }
+
+        zone->cards[ncards++] = channel.sink;
+        ccount += channel.ccount;
+    }
+
+    // move from hardware to DMIX attach to sndcard, or to a multi plugin over every card DMIX
+    if (ncards > 1) {
+        dmixUid = CreateMultiConfig(mixer, zone);
+        if (!dmixUid) goto OnErrorExit;
+    } else {
+        if (asprintf(&dmixUid, "dmix-%s", slave.uid) == -1)
+            goto OnErrorExit;
+    }
 
     // temporary store to unable multiple channel to route to the same port
-    snd_config_t **cports = alloca(slave.ccount * sizeof (void*));
-    memset(cports, 0, slave.ccount * sizeof (void*));
+    int nports = (maxport >= slave.ccount) ? maxport + 1 : slave.ccount;
+    snd_config_t **cports = alloca(nports * sizeof (void*));
+    memset(cports, 0, nports * sizeof (void*));
     int zcount = 0;
 
     // We create 1st ttable to retrieve sndcard slave and channel count
@@ -121,13 +227,11 @@ PUBLIC AlsaPcmCtlT* AlsaCreateRoute(SoftMixerT *mixer, AlsaSndZoneT *zone, int o
             goto OnErrorExit;
         }
 
-        if (slave.cardidx != channel.cardidx) {
-            AFB_ApiError(mixer->api, "AlsaCreateRoute:zone(%s) cannot span over multiple sound card %s != %s ", zone->uid, slave.cardid, channel.cardid);
-            goto OnErrorExit;
-        }
-
+        // multi channels: target card channels follow the ones of cards before it
         int port = zone->sinks[scount]->port;
         int target = channel.port;
+        for (int cdx = 0; zone->cards[cdx] != channel.sink; cdx++)
+            target += zone->cards[cdx]->ccount;
         double volume = 1.0; // currently only support 100%
 
         // if channel entry does not exit into ttable create it now 
@@ -169,7 +273,7 @@ PUBLIC AlsaPcmCtlT* AlsaCreateRoute(SoftMixerT *mixer, AlsaSndZoneT *zone, int o
     error += snd_config_add(slaveConfig, elemConfig);
     if (error) goto OnErrorExit;
 
-    error += snd_config_imake_integer(&elemConfig, "channels", slave.ccount);
+    error += snd_config_imake_integer(&elemConfig, "channels", ccount);
     if (error) goto OnErrorExit;
     error += snd_config_add(slaveConfig, elemConfig);
 
@@ -203,6 +307,8 @@ PUBLIC AlsaPcmCtlT* AlsaCreateRoute(SoftMixerT *mixer, AlsaSndZoneT *zone, int o
     return pcmRoute;
 
 OnErrorExit:
+    free(zone->cards);
+    zone->cards = NULL;
     free(pcmRoute);
     free(cardid);
     free(dmixUid);
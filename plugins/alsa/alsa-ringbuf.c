@@ -1,50 +1,150 @@
 #include "alsa-ringbuf.h"
 
+#include <stdlib.h>
+#include <string.h>
+
+static snd_pcm_uframes_t pow2_roundup(snd_pcm_uframes_t value) {
+	snd_pcm_uframes_t pow2 = 1;
+	while (pow2 < value)
+		pow2 <<= 1;
+	return pow2;
+}
+
 alsa_ringbuf_t * alsa_ringbuf_new(snd_pcm_uframes_t capacity, size_t frameSize) {
-	alsa_ringbuf_t * rb = malloc(sizeof(alsa_ringbuf_t));
+	alsa_ringbuf_t * rb = NULL;
+
+	if (posix_memalign((void**)&rb, ALSA_RINGBUF_CACHELINE, sizeof(alsa_ringbuf_t)) != 0)
+		goto OnErrorExit;
 
-	rb->rbuf = ringbuf_new(capacity*frameSize);
+	rb->capacity = pow2_roundup(capacity);
+	rb->mask = rb->capacity - 1;
 	rb->frameSize = frameSize;
+
+	if (posix_memalign((void**)&rb->buf, ALSA_RINGBUF_CACHELINE, rb->capacity*frameSize) != 0)
+		goto OnErrorExit;
+
+	atomic_init(&rb->head, 0);
+	atomic_init(&rb->tail, 0);
 	return rb;
+
+OnErrorExit:
+	free(rb);
+	return NULL;
 }
 
 snd_pcm_uframes_t alsa_ringbuf_buffer_size(const alsa_ringbuf_t *rb) {
-	return ringbuf_buffer_size(rb->rbuf)/rb->frameSize;
+	return rb->capacity;
 }
 
 void alsa_ringbuf_free(alsa_ringbuf_t *rb) {
-	ringbuf_free(&rb->rbuf);
+	free(rb->buf);
 	free(rb);
 }
 
+// not thread safe: both producer and consumer should be idle
 void alsa_ringbuf_reset(alsa_ringbuf_t * rb) {
-	ringbuf_reset(rb->rbuf);
+	atomic_store(&rb->head, 0);
+	atomic_store(&rb->tail, 0);
 }
 
 snd_pcm_uframes_t alsa_ringbuf_capacity(const alsa_ringbuf_t *rb) {
-	return ringbuf_capacity(rb->rbuf)/rb->frameSize;
+	return rb->capacity;
 }
 
-snd_pcm_uframes_t alsa_ringbuf_frames_remain_capacity(const alsa_ringbuf_t *rb) {
-	return ringbuf_bytes_free(rb->rbuf)/rb->frameSize;
+snd_pcm_uframes_t alsa_ringbuf_frames_used(const alsa_ringbuf_t *rb) {
+	unsigned long head = atomic_load_explicit(&((alsa_ringbuf_t*)rb)->head, memory_order_acquire);
+	unsigned long tail = atomic_load_explicit(&((alsa_ringbuf_t*)rb)->tail, memory_order_acquire);
+	return head - tail;
 }
 
-snd_pcm_uframes_t alsa_ringbuf_frames_used(const alsa_ringbuf_t *rb) {
-	return ringbuf_bytes_used(rb->rbuf)/rb->frameSize;
+snd_pcm_uframes_t alsa_ringbuf_frames_remain_capacity(const alsa_ringbuf_t *rb) {
+	return rb->capacity - alsa_ringbuf_frames_used(rb);
 }
 
 bool alsa_ringbuf_is_full(const alsa_ringbuf_t *rb) {
-	return ringbuf_is_full(rb->rbuf)==1;
+	return alsa_ringbuf_frames_used(rb) == rb->capacity;
 }
 
 bool alsa_ringbuf_is_empty(const alsa_ringbuf_t *rb) {
-	return ringbuf_is_empty(rb->rbuf)==1;
+	return alsa_ringbuf_frames_used(rb) == 0;
+}
+
+snd_pcm_uframes_t alsa_ringbuf_frames_push(alsa_ringbuf_t * rb, const void * src, snd_pcm_uframes_t nb) {
+	unsigned long head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+	unsigned long tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+	snd_pcm_uframes_t room = rb->capacity - (head - tail);
+
+	if (nb > room)
+		nb = room;
+
+	// copy may wrap at the end of the buffer
+	snd_pcm_uframes_t offset = head & rb->mask;
+	snd_pcm_uframes_t first = rb->capacity - offset;
+	if (first > nb)
+		first = nb;
+
+	memcpy(rb->buf + offset*rb->frameSize, src, first*rb->frameSize);
+	memcpy(rb->buf, (const char*)src + first*rb->frameSize, (nb-first)*rb->frameSize);
+
+	// publish frames to the consumer
+	atomic_store_explicit(&rb->head, head + nb, memory_order_release);
+	return nb;
+}
+
+snd_pcm_uframes_t alsa_ringbuf_frames_pop(alsa_ringbuf_t * rb, void * dst, snd_pcm_uframes_t nb) {
+	unsigned long tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+	unsigned long head = atomic_load_explicit(&rb->head, memory_order_acquire);
+	snd_pcm_uframes_t used = head - tail;
+
+	if (nb > used)
+		nb = used;
+
+	snd_pcm_uframes_t offset = tail & rb->mask;
+	snd_pcm_uframes_t first = rb->capacity - offset;
+	if (first > nb)
+		first = nb;
+
+	memcpy(dst, rb->buf + offset*rb->frameSize, first*rb->frameSize);
+	memcpy((char*)dst + first*rb->frameSize, rb->buf, (nb-first)*rb->frameSize);
+
+	// release room to the producer
+	atomic_store_explicit(&rb->tail, tail + nb, memory_order_release);
+	return nb;
 }
 
-void alsa_ringbuf_frames_push(alsa_ringbuf_t * rb, const void * src, snd_pcm_uframes_t nb) {
-	ringbuf_memcpy_into(rb->rbuf, src, nb*rb->frameSize);
+snd_pcm_uframes_t alsa_ringbuf_frames_push_region(alsa_ringbuf_t * rb, void ** ptr) {
+	unsigned long head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+	unsigned long tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+	snd_pcm_uframes_t room = rb->capacity - (head - tail);
+	snd_pcm_uframes_t offset = head & rb->mask;
+
+	// stop at the end of the buffer, next call will return the wrapped part
+	if (room > rb->capacity - offset)
+		room = rb->capacity - offset;
+
+	*ptr = rb->buf + offset*rb->frameSize;
+	return room;
+}
+
+void alsa_ringbuf_frames_push_commit(alsa_ringbuf_t * rb, snd_pcm_uframes_t nb) {
+	unsigned long head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+	atomic_store_explicit(&rb->head, head + nb, memory_order_release);
+}
+
+snd_pcm_uframes_t alsa_ringbuf_frames_pop_region(alsa_ringbuf_t * rb, const void ** ptr) {
+	unsigned long tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+	unsigned long head = atomic_load_explicit(&rb->head, memory_order_acquire);
+	snd_pcm_uframes_t used = head - tail;
+	snd_pcm_uframes_t offset = tail & rb->mask;
+
+	if (used > rb->capacity - offset)
+		used = rb->capacity - offset;
+
+	*ptr = rb->buf + offset*rb->frameSize;
+	return used;
 }
 
-void alsa_ringbuf_frames_pop(alsa_ringbuf_t * rb, void * dst, snd_pcm_uframes_t nb) {
-	ringbuf_memcpy_from(dst, rb->rbuf, nb*rb->frameSize);
+void alsa_ringbuf_frames_pop_commit(alsa_ringbuf_t * rb, snd_pcm_uframes_t nb) {
+	unsigned long tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+	atomic_store_explicit(&rb->tail, tail + nb, memory_order_release);
 }
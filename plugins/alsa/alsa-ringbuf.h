@@ -1,13 +1,28 @@
 #ifndef __INC_ALSA_RINGBUF_H
 #define __INC_ALSA_RINGBUF_H
 
-#include "ringbuf.h"
-
 #include <alsa/asoundlib.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+
+/*
+ * Single producer / single consumer frame ring buffer.
+ *
+ * The capture thread is the only one to move 'head', the playback thread is
+ * the only one to move 'tail', so no lock is needed between them. Both indexes
+ * are free running frame counters, the capacity is rounded up to a power of two
+ * so that the position within the buffer is a simple mask. Each index lives on
+ * its own cache line to avoid false sharing between the two threads.
+ */
+
+#define ALSA_RINGBUF_CACHELINE 64
 
 typedef struct {
-	ringbuf_t rbuf;
+	_Alignas(ALSA_RINGBUF_CACHELINE) atomic_ulong head;  // written by producer only
+	_Alignas(ALSA_RINGBUF_CACHELINE) atomic_ulong tail;  // written by consumer only
+	_Alignas(ALSA_RINGBUF_CACHELINE) char * buf;
+	snd_pcm_uframes_t capacity;
+	snd_pcm_uframes_t mask;
 	size_t frameSize;
 } alsa_ringbuf_t ;
 
@@ -21,7 +36,18 @@ extern snd_pcm_uframes_t alsa_ringbuf_frames_used(const alsa_ringbuf_t *rb);
 extern bool alsa_ringbuf_is_full(const alsa_ringbuf_t *rb);
 extern bool alsa_ringbuf_is_empty(const alsa_ringbuf_t *rb);
 
-extern void alsa_ringbuf_frames_push(alsa_ringbuf_t * rb, const void * buf, snd_pcm_uframes_t nb);
-extern void alsa_ringbuf_frames_pop(alsa_ringbuf_t * rb, void * buf, snd_pcm_uframes_t nb);
+// push/pop never overflow nor underflow, they return the number of frames really moved
+extern snd_pcm_uframes_t alsa_ringbuf_frames_push(alsa_ringbuf_t * rb, const void * buf, snd_pcm_uframes_t nb);
+extern snd_pcm_uframes_t alsa_ringbuf_frames_pop(alsa_ringbuf_t * rb, void * buf, snd_pcm_uframes_t nb);
+
+/*
+ * Zero copy access: *_region returns the number of contiguous frames that may be
+ * written (push) or read (pop) in place at *ptr, *_commit then moves the index.
+ * Producer only calls push_*, consumer only calls pop_*.
+ */
+extern snd_pcm_uframes_t alsa_ringbuf_frames_push_region(alsa_ringbuf_t * rb, void ** ptr);
+extern void alsa_ringbuf_frames_push_commit(alsa_ringbuf_t * rb, snd_pcm_uframes_t nb);
+extern snd_pcm_uframes_t alsa_ringbuf_frames_pop_region(alsa_ringbuf_t * rb, const void ** ptr);
+extern void alsa_ringbuf_frames_pop_commit(alsa_ringbuf_t * rb, snd_pcm_uframes_t nb);
 
 #endif /* __INC_ALSA_RINGBUF_H */
@@ -28,8 +28,9 @@
 #include <assert.h>
 #include <alsa/asoundlib.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
 #include <systemd/sd-event.h>
-#include <semaphore.h>
 
 #include "ctl-plugin.h"
 #include "wrap-json.h"
@@ -47,6 +48,8 @@
 #define MAINLOOP_WATCHDOG 30000
 #define ALSA_DEFAULT_PCM_RATE 48000
 #define ALSA_DEFAULT_PCM_VOLUME 80
+#define ALSA_DEFAULT_PCM_PERIODS 4
+#define ALSA_DEFAULT_PCM_BUFFER_TIME 500000 /* usec */
 
 #define ALSA_CARDID_MAX_LEN 64
 
@@ -77,9 +80,38 @@
 typedef enum {
     FONTEND_NUMID_IGNORE,
     FONTEND_NUMID_PAUSE,
-    FONTEND_NUMID_RUN
+    FONTEND_NUMID_RUN,
+    FONTEND_NUMID_VOLUME
 } RegistryNumidT;
 
+typedef enum {
+    COPY_ENGINE_THREADS,  // one capture and one playback thread per stream
+    COPY_ENGINE_SHARED    // every streams multiplexed on a pool of epoll workers
+} AlsaCopyEngineModeT;
+
+typedef enum {
+    MIXING_DMIX,    // streams go through softvol/rate/route/dmix alsa plugins
+    MIXING_NATIVE   // streams are summed in process by one mix thread per sink
+} AlsaMixingModeT;
+
+typedef enum {
+    VOLUME_SOFTVOL, // stream volume through alsa softvol plugin
+    VOLUME_NATIVE   // stream volume applied in process by copy thread with smoothing
+} AlsaVolumeModeT;
+
+typedef struct AlsaCopyEngineS AlsaCopyEngineT;
+typedef struct AlsaDriftS AlsaDriftT;
+typedef struct AlsaSinkMixS AlsaSinkMixT;
+typedef struct AlsaGainS AlsaGainT;
+typedef struct AlsaCtlCacheS AlsaCtlCacheT;
+typedef struct AlsaCopyPoolS AlsaCopyPoolT;
+typedef struct AlsaCaptureS AlsaCaptureT;
+typedef struct AlsaCaptureConsumerS AlsaCaptureConsumerT;
+typedef struct AlsaCapturePeriodS AlsaCapturePeriodT;
+typedef struct AlsaMatrixS AlsaMatrixT;
+typedef struct AlsaDuckS AlsaDuckT;
+typedef struct AlsaEventsS AlsaEventsT;
+
 typedef struct {
     int cardidx;
     const char *devpath;
@@ -98,6 +130,10 @@ typedef struct {
     snd_pcm_format_t format;
     snd_pcm_access_t access;
     size_t sampleSize;
+    unsigned int latency_ms;          // target hw buffer duration, 0 for default
+    unsigned int periods;             // periods per hw buffer, 0 for default
+    snd_pcm_uframes_t period_frames;  // explicit period size, overrides latency_ms
+    snd_pcm_uframes_t buffer_frames;  // effective hw buffer size (read back from PCM)
 } AlsaPcmHwInfoT;
 
 typedef struct {
@@ -109,10 +145,36 @@ typedef struct {
     AlsaPcmHwInfoT *params;
 
     void * mixer;
+    AlsaGainT *gain;    // native volume only, applied on captured frames
+    void *stream;       // owning stream, loop subdev run events start (lazy, idle) or idle its copy
 
     snd_pcm_uframes_t avail_min;
 } AlsaPcmCtlT;
 
+// per stream statistics, each direction is only written by its own copy thread (relaxed atomics)
+#define ALSA_STATS_FILL_BINS 8
+#define ALSA_STATS_ADD(field, count) \
+    atomic_store_explicit(&(field), atomic_load_explicit(&(field), memory_order_relaxed) + (count), memory_order_relaxed)
+
+typedef struct {
+    atomic_ullong frames;
+    atomic_uint xruns;
+    atomic_uint suspends;
+    atomic_ullong wakeups;
+    atomic_ullong busyNs;       // processing time per wakeup (sum and max)
+    atomic_ullong busyMaxNs;
+    atomic_ullong jitterNs;     // |wakeup interval - period| (sum and max)
+    atomic_ullong jitterMaxNs;
+    uint64_t lastWakeNs;        // owner thread only
+} AlsaPcmDirStatsT;
+
+typedef struct {
+    AlsaPcmDirStatsT capture;
+    AlsaPcmDirStatsT playback;
+    atomic_ullong fill[ALSA_STATS_FILL_BINS];  // ring fill level at capture wakeups, by 1/8 of capacity
+    uint64_t periodNs;                          // capture period, reference for jitter
+} AlsaPcmCopyStatsT;
+
 typedef struct {
 	AlsaPcmCtlT *pcmIn;
 	AlsaPcmCtlT *pcmOut;
@@ -124,9 +186,10 @@ typedef struct {
 
     // IO Job
 	alsa_ringbuf_t * rbuf;
+	bool mmapIn;   // capture side uses snd_pcm_mmap_begin/commit
+	bool mmapOut;  // playback side uses snd_pcm_mmap_begin/commit
 
-	uint32_t		  write_err_count;
-	uint32_t		  read_err_count;
+	AlsaPcmCopyStatsT stats;
 
     unsigned int channels;
     sd_event *sdLoop;
@@ -140,11 +203,26 @@ typedef struct {
     int nbPcmFds;
     struct pollfd pollFds[2];
 
-    sem_t sem;
-    pthread_mutex_t mutex;
+    snd_pcm_sframes_t write_threshold;
+    snd_pcm_uframes_t wake_threshold;
+
+    AlsaDriftT *drift;  // NULL unless drift compensation is enabled
+
+    int wakeFd;  // eventfd, capture -> playback wakeup
 
     int saveFd;
 
+    AlsaSinkMixT *mix;  // native mixing: sink mix thread consuming the ring
+
+    // lifecycle: copy threads park on 'cond' between two streams, see alsa-core-pcm.c pool
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    atomic_bool running;
+    bool quit;
+    int parked;
+    int threads;  // 0 with shared engine
+    int ctlFd;    // eventfd, wakes playback thread on stop
+
 } AlsaPcmCopyHandleT;
 
 typedef struct {
@@ -178,6 +256,7 @@ typedef struct {
     int numid;
     RegistryNumidT type;
     AlsaPcmCtlT *pcm;
+    bool pending;   // value change queued in current event burst
 } RegistryEntryPcmT;
 
 typedef struct {
@@ -186,16 +265,25 @@ typedef struct {
     snd_ctl_t *ctl;
     AlsaPcmHwInfoT *params;
     RegistryEntryPcmT **registry;
+    RegistryEntryPcmT **numids;  // registry indexed by numid (direct table)
+    int nsize;
+    AlsaCtlCacheT *cache;        // control elements directory, see alsa-core-ctl.c
+    bool subscribed;             // ctl events attached to main loop
 } AlsaSndCtlT;
 
-
+// one cached control element, owned by the sound card cache (do not free)
 typedef struct {
-    const char *uid;
-    AlsaPcmChannelT **sources;
-    AlsaPcmChannelT **sinks;
-    int ccount;
-    AlsaPcmHwInfoT *params;
-} AlsaSndZoneT;
+    int numid;
+    const char *name;
+    snd_ctl_elem_id_t *id;
+    snd_ctl_elem_type_t type;
+    long min;
+    long max;
+    unsigned int count;
+    bool readable;
+    bool writable;
+} AlsaCtlElemT;
+
 
 typedef struct {
     const char *uid;
@@ -206,12 +294,31 @@ typedef struct {
     AlsaSndControlT mute;
     AlsaPcmChannelT **channels;
     snd_pcm_stream_t direction;
+    AlsaSinkMixT *mix;  // native mixing only, created on first stream (or by a multi-card zone)
+    AlsaCaptureT *capture;  // sources only, shared capture created by its first zone consumer
 } AlsaSndPcmT;
 
+typedef struct {
+    const char *uid;
+    AlsaPcmChannelT **sources;
+    AlsaPcmChannelT **sinks;
+    int ccount;
+    AlsaPcmHwInfoT *params;
+    AlsaSndPcmT **cards;    // sinks holding zone channels in zone order, more than one for multi-card zones
+    AlsaMatrixT *matrix;    // native mixing: zone channels x mix channels gains, updated by the mixer 'matrix' verb
+    AlsaDuckT *duck;        // native mixing: zones ducked while one of this zone streams plays
+} AlsaSndZoneT;
+
 typedef struct {
     const char*uid;
     int index;
-    int numid;
+    int numid;              // run control, snd-aloop "PCM Slave Active" when not given
+    const char *name;       // capabilities read from loop ctl at attach (no pcm open)
+    struct {
+        int rate;           // numids of snd-aloop "PCM Slave Rate|Format|Channels",
+        int format;         // parameters of the playback side once active
+        int channels;
+    } slave;
 } AlsaLoopSubdevT;
 
 typedef struct {
@@ -232,8 +339,26 @@ typedef struct {
     const char *ramp;
     int volume;
     int mute;
+    int drift;
     AlsaPcmHwInfoT *params;
     AlsaPcmCopyHandleT *copy;
+    AlsaSndCtlT *sndcard;       // card holding stream controls (loop or source)
+    AlsaLoopSubdevT *subdev;    // loop subdev allocated to this stream, if any
+    const char *plugs[2];       // alsa-lib pcm configs created for this stream (softvol, rate)
+
+    // copy start is split from stream setup (parallel/lazy startup)
+    struct {
+        AlsaPcmCtlT *capture;   // opened at setup to validate the source
+        AlsaPcmCtlT *playback;  // plugin chain head, opened at start (NULL with native mixing)
+        AlsaSndPcmT *sink;      // native mixing target
+        int *route;             // native mixing stream to sink channel route
+        AlsaSndZoneT *zone;     // native mixing through the zone matrix and ducking instead of route
+        long volume;            // initial volume in %, stream->volume then holds its numid
+        bool started;
+        int error;
+    } start;
+    sd_event_source *idle;      // armed while loop subdev is inactive, copy stops when it fires
+    AlsaCaptureConsumerT *capture;  // capture zone stream: source fan-out consumer writing start.playback
 } AlsaStreamAudioT;
 
 typedef struct {
@@ -250,6 +375,25 @@ typedef struct {
         unsigned int streams;
         unsigned int ramps;
     } max;
+    struct {
+        AlsaCopyEngineModeT mode;
+        int workers;
+        int pool;               // copy handles created ahead of streams
+        AlsaCopyEngineT *handle;
+        AlsaCopyPoolT *spare;   // stopped copy handles, reused by next stream
+    } engine;
+    struct {
+        bool parallel;          // start streams of one attach concurrently
+        bool lazy;              // start loop streams copy when their subdev turns active
+        int workers;            // parallel start threads, one per CPU by default
+    } startup;
+    int idleMs;                 // stop copy of streams inactive for that long, 0 never
+    struct {
+        int maxRate;            // events pushed per second and per object at most
+        AlsaEventsT *handle;    // created by the first subscription
+    } events;
+    AlsaMixingModeT mixing;
+    AlsaVolumeModeT volume;
     AlsaSndLoopT **loops;
     AlsaSndPcmT **sinks;
     AlsaSndPcmT **sources;
@@ -279,6 +423,9 @@ PUBLIC void AlsaDumpCtlConfig(SoftMixerT *mixer, const char* info, snd_config_t
 // alsa-core-ctl.c
 PUBLIC snd_ctl_elem_id_t *AlsaCtlGetNumidElemId(SoftMixerT *mixer, AlsaSndCtlT *sndcard, int numid) ;
 PUBLIC snd_ctl_elem_id_t *AlsaCtlGetNameElemId(SoftMixerT *mixer, AlsaSndCtlT *sndcard, const char *ctlName) ;
+PUBLIC AlsaCtlElemT *AlsaCtlGetNumidElem(SoftMixerT *mixer, AlsaSndCtlT *sndcard, int numid);
+PUBLIC AlsaCtlElemT *AlsaCtlGetNameElem(SoftMixerT *mixer, AlsaSndCtlT *sndcard, const char *ctlName);
+PUBLIC void AlsaCtlCacheInvalidate(AlsaSndCtlT *sndcard);
 PUBLIC snd_ctl_t *AlsaCtlOpenCtl(SoftMixerT *mixer, const char *cardid) ;
 PUBLIC int CtlElemIdGetLong(SoftMixerT *mixer, AlsaSndCtlT *sndcard, snd_ctl_elem_id_t *elemId, long *value) ;
 PUBLIC int CtlElemIdSetLong(SoftMixerT *mixer, AlsaSndCtlT *sndcard, snd_ctl_elem_id_t *elemId, long value) ;
@@ -291,22 +438,152 @@ PUBLIC int AlsaCtlCreateControl(SoftMixerT *mixer, AlsaSndCtlT *sndcard, char* c
 PUBLIC snd_ctl_t* AlsaCrlFromPcm(SoftMixerT *mixer, snd_pcm_t *pcm) ;
 PUBLIC int AlsaCtlSubscribe(SoftMixerT *mixer, const char *uid, AlsaSndCtlT *sndcard) ;
 PUBLIC int AlsaCtlRegister(SoftMixerT *mixer, AlsaSndCtlT *sndcard, AlsaPcmCtlT *pcmdev,  RegistryNumidT type, int numid);
+PUBLIC void AlsaCtlUnregister(SoftMixerT *mixer, AlsaSndCtlT *sndcard, AlsaPcmCtlT *pcmdev);
+PUBLIC int AlsaCtlRemoveControl(SoftMixerT *mixer, AlsaSndCtlT *sndcard, int numid);
 
 // alsa-core-pcm.c
 PUBLIC int AlsaPcmConf(SoftMixerT *mixer, AlsaPcmCtlT *pcm, int mode);
+PUBLIC AlsaPcmCtlT *AlsaPcmOpenHw(SoftMixerT *mixer, const char *uid, AlsaSndCtlT *sndcard, unsigned int channels, snd_pcm_stream_t mode);
+PUBLIC void AlsaPcmCloseHw(AlsaPcmCtlT *pcm);
+PUBLIC void AlsaPcmThreadPriority(SoftMixerT *mixer, pthread_t thread, const char *owner);
 PUBLIC int AlsaPcmCopy(SoftMixerT *mixer, AlsaStreamAudioT *stream, AlsaPcmCtlT *pcmIn, AlsaPcmCtlT *pcmOut, AlsaPcmHwInfoT * opts);
+PUBLIC int AlsaPcmReadCB(struct pollfd * pfd, AlsaPcmCopyHandleT * pcmCopyHandle);
+PUBLIC int AlsaPcmWriteCB(AlsaPcmCopyHandleT * pcmCopyHandle);
+PUBLIC int AlsaPcmCopyPoolInit(SoftMixerT *mixer);
+PUBLIC void AlsaPcmCopyPoolFree(SoftMixerT *mixer);
+PUBLIC void AlsaPcmCopyStop(SoftMixerT *mixer, AlsaPcmCopyHandleT *copy, bool idle);
+PUBLIC void AlsaPcmConfigRemove(SoftMixerT *mixer, const char *pcmName);
+
+// alsa-core-engine.c
+PUBLIC int AlsaCopyEnginePrepare(SoftMixerT *mixer);
+PUBLIC int AlsaCopyEngineAttach(SoftMixerT *mixer, AlsaPcmCopyHandleT *pcmCopyHandle);
+PUBLIC int AlsaCopyEngineDetach(SoftMixerT *mixer, AlsaPcmCopyHandleT *pcmCopyHandle);
+
+// alsa-core-mix.c
+PUBLIC int AlsaMixPrepare(SoftMixerT *mixer, AlsaSndPcmT *sink);
+PUBLIC int AlsaMixLink(SoftMixerT *mixer, AlsaSndPcmT **sinks);
+PUBLIC int AlsaMixSinkOffset(AlsaSndPcmT *sink);
+PUBLIC unsigned int AlsaMixChannels(AlsaSndPcmT *sink);
+PUBLIC int AlsaMixAttach(SoftMixerT *mixer, AlsaSndPcmT *sink, AlsaPcmCopyHandleT *copy, const int *route, AlsaSndZoneT *zone);
+PUBLIC void AlsaMixSetMatrix(AlsaSndPcmT *sink, AlsaMatrixT *previous, AlsaMatrixT *matrix);
+PUBLIC int AlsaMixDetach(SoftMixerT *mixer, AlsaPcmCopyHandleT *copy);
+
+// alsa-core-capture.c
+PUBLIC AlsaCaptureConsumerT *AlsaCaptureAttach(SoftMixerT *mixer, AlsaSndPcmT *source, const int *map, unsigned int channels, AlsaPcmCtlT *pcmOut);
+PUBLIC int AlsaCaptureDetach(SoftMixerT *mixer, AlsaCaptureConsumerT *consumer);
+PUBLIC AlsaCapturePeriodT *AlsaCapturePull(AlsaCaptureConsumerT *consumer, const void **data, snd_pcm_uframes_t *frames);
+PUBLIC void AlsaCaptureRelease(AlsaCapturePeriodT *period);
+PUBLIC void AlsaCaptureGather(AlsaCaptureConsumerT *consumer, const void *data, snd_pcm_uframes_t frames, void *out);
+PUBLIC AlsaPcmHwInfoT *AlsaCaptureParams(AlsaCaptureConsumerT *consumer);
+
+// alsa-core-matrix.c
+PUBLIC AlsaMatrixT *AlsaMatrixCreate(unsigned int inputs, unsigned int outputs, const float *gains);
+PUBLIC void AlsaMatrixFree(AlsaMatrixT *matrix);
+PUBLIC void AlsaMatrixApply(const AlsaMatrixT *matrix, float *acc, const float *in, snd_pcm_uframes_t frames);
+PUBLIC float *AlsaMatrixGains(const AlsaMatrixT *matrix, unsigned int inputs, unsigned int outputs);
+PUBLIC unsigned int AlsaMatrixInputs(const AlsaMatrixT *matrix);
+PUBLIC unsigned int AlsaMatrixOutputs(const AlsaMatrixT *matrix);
+PUBLIC const char *AlsaMatrixKernel(const AlsaMatrixT *matrix);
+PUBLIC json_object *AlsaMatrixJson(const AlsaMatrixT *matrix);
+
+// alsa-core-duck.c
+PUBLIC AlsaDuckT *AlsaDuckCreate(SoftMixerT *mixer, const char *uid, json_object *duckJ);
+PUBLIC void AlsaDuckFree(AlsaDuckT *duck);
+PUBLIC void AlsaDuckResolve(SoftMixerT *mixer);
+PUBLIC bool AlsaDuckGate(const AlsaDuckT *duck, const float *samples, size_t count, snd_pcm_uframes_t frames, unsigned int rate, snd_pcm_uframes_t *hold);
+PUBLIC bool AlsaDuckRule(const AlsaDuckT *duck, const AlsaSndZoneT *target, float *gain, unsigned int *attackMs, unsigned int *releaseMs);
+PUBLIC float AlsaDuckCoef(unsigned int ms, unsigned int rate);
+PUBLIC void AlsaDuckApply(float *buf, unsigned int channels, snd_pcm_uframes_t frames, float *gain, float target, float coef);
+
+// alsa-core-convert.c: float32 internal format, 'count' is in samples
+PUBLIC bool AlsaConvertSupported(snd_pcm_format_t format);
+PUBLIC void AlsaConvertToFloat(snd_pcm_format_t format, const void *src, float *dst, size_t count);
+PUBLIC void AlsaConvertFromFloat(snd_pcm_format_t format, const float *src, void *dst, size_t count);
+
+// alsa-core-drift.c
+PUBLIC AlsaDriftT *AlsaDriftCreate(SoftMixerT *mixer, AlsaPcmHwInfoT *params, size_t frameSize, snd_pcm_uframes_t maxFrames);
+PUBLIC void AlsaDriftFree(AlsaDriftT *drift);
+PUBLIC void AlsaDriftReset(AlsaDriftT *drift);
+PUBLIC double AlsaDriftUpdate(AlsaDriftT *drift, snd_pcm_sframes_t latency);
+PUBLIC snd_pcm_uframes_t AlsaDriftProcess(AlsaDriftT *drift, const void *in, snd_pcm_uframes_t inFrames,
+                                          snd_pcm_uframes_t *inUsed, snd_pcm_uframes_t outFrames, const void **out);
+PUBLIC snd_pcm_uframes_t AlsaDriftPull(AlsaDriftT *drift, alsa_ringbuf_t *rbuf, snd_pcm_uframes_t maxFrames, const void **out);
+PUBLIC void AlsaDriftRelease(AlsaDriftT *drift, snd_pcm_uframes_t frames);
+
+// alsa-core-stats.c
+PUBLIC uint64_t AlsaStatsNow(void);
+PUBLIC void AlsaStatsWakeup(AlsaPcmDirStatsT *dir, uint64_t startNs, uint64_t periodNs, snd_pcm_uframes_t frames);
+PUBLIC void AlsaStatsFill(AlsaPcmCopyStatsT *stats, size_t used, size_t capacity);
+PUBLIC json_object *AlsaStatsJson(AlsaPcmCopyHandleT *copy);
+
+// alsa-core-log.c: formats are "%s" (tag) followed by up to 3 long conversions
+#define ALSA_LOG_TAG_MAX 32
+#define ALSA_LOG_SITE_INTERVAL_MS 1000
+
+typedef enum {
+    ALSA_LOG_ERROR,
+    ALSA_LOG_WARNING,
+    ALSA_LOG_NOTICE,
+    ALSA_LOG_INFO,
+    ALSA_LOG_DEBUG,
+} AlsaLogLevelT;
+
+typedef struct {
+    AlsaLogLevelT level;
+    const char *fmt;
+    atomic_ullong lastNs;
+    atomic_uint suppressed;
+} AlsaLogSiteT;
+
+PUBLIC void AlsaLogPush(AlsaLogSiteT *site, AFB_ApiT api, const char *tag, long arg0, long arg1, long arg2);
+PUBLIC int AlsaLogDrain(void);
+PUBLIC int AlsaLogStart(SoftMixerT *mixer);
+
+// log from a real time thread, never blocks nor allocates
+#define ALSA_RT_LOG(api, level, fmt, tag, arg0, arg1, arg2) do { \
+    static AlsaLogSiteT _alsaLogSite = { level, fmt }; \
+    AlsaLogPush(&_alsaLogSite, api, tag, (long) (arg0), (long) (arg1), (long) (arg2)); \
+} while (0)
+
+// alsa-core-trace.c (build with SMIXER_TRACE_DISABLE to compile tracing out)
+PUBLIC void AlsaTraceRecord(const char *name, uint64_t startNs);
+PUBLIC void AlsaTraceEnable(bool enable);
+PUBLIC void AlsaTraceClear(void);
+PUBLIC int AlsaTraceDump(SoftMixerT *mixer, const char *path, int *count);
+extern atomic_bool AlsaTraceEnabled;
+#ifndef SMIXER_TRACE_DISABLE
+#define ALSA_TRACE_BEGIN(var) \
+    uint64_t var = __builtin_expect(atomic_load_explicit(&AlsaTraceEnabled, memory_order_relaxed), 0) ? AlsaStatsNow() : 0
+#define ALSA_TRACE_END(var, name) \
+    do { if (__builtin_expect((var) != 0, 0)) AlsaTraceRecord(name, var); } while (0)
+#else
+#define ALSA_TRACE_BEGIN(var) const uint64_t var = 0
+#define ALSA_TRACE_END(var, name) (void) (var)
+#endif
+
+// alsa-core-gain.c
+PUBLIC AlsaGainT *AlsaGainCreate(SoftMixerT *mixer, AlsaPcmHwInfoT *params, long volume);
+PUBLIC void AlsaGainFree(AlsaGainT *gain);
+PUBLIC void AlsaGainSetVolume(AlsaGainT *gain, long volume, unsigned int rampUsec);
+PUBLIC void AlsaGainApply(AlsaGainT *gain, void *buf, snd_pcm_uframes_t frames);
+PUBLIC bool AlsaGainIsUnity(AlsaGainT *gain);
 
 // alsa-plug-*.c _snd_pcm_PLUGIN_open_ see macro ALSA_PLUG_PROTO(plugin)
 PUBLIC int AlsaPcmCopy(SoftMixerT *mixer, AlsaStreamAudioT *streamAudio, AlsaPcmCtlT *pcmIn, AlsaPcmCtlT *pcmOut, AlsaPcmHwInfoT * opts);
 PUBLIC int AlsaPcmCopyMuteSignal(SoftMixerT *mixer, AlsaPcmCtlT *pcmIn, bool mute);
+PUBLIC int AlsaPcmCopyVolumeSignal(SoftMixerT *mixer, AlsaPcmCtlT *pcmIn, long volume, unsigned int rampUsec);
 PUBLIC AlsaPcmCtlT* AlsaCreateSoftvol(SoftMixerT *mixer, AlsaStreamAudioT *stream, char *slaveid, AlsaSndCtlT *sndcard, char* ctlName, int max, int open);
 PUBLIC AlsaPcmCtlT* AlsaCreateRoute(SoftMixerT *mixer, AlsaSndZoneT *zone, int open);
 PUBLIC AlsaPcmCtlT* AlsaCreateRate(SoftMixerT *mixer, const char* pcmName, AlsaPcmCtlT *pcmSlave, AlsaPcmHwInfoT *params, int open);
 PUBLIC AlsaPcmCtlT* AlsaCreateDmix(SoftMixerT *mixer, const char* pcmName, AlsaSndPcmT *pcmSlave, int open);
 
 // alsa-api-*
+PUBLIC int ApiBatchApply(SoftMixerT *mixer, AFB_ReqT request, json_object *argsJ);
+PUBLIC void AlsaEventsStream(SoftMixerT *mixer, AlsaStreamAudioT *stream, RegistryNumidT type, long value);
+PUBLIC int ApiEventsSubscribe(SoftMixerT *mixer, AFB_ReqT request, json_object *argsJ, bool subscribe);
 PUBLIC AlsaLoopSubdevT *ApiLoopFindSubdev(SoftMixerT *mixer, const char *streamUid, const char *targetUid, AlsaSndLoopT **loop);
 PUBLIC int ApiLoopAttach(SoftMixerT *mixer, AFB_ReqT request, const char *uid, json_object * argsJ);
+PUBLIC int ApiLoopCheckSubdev(SoftMixerT *mixer, AlsaSndLoopT *loop, AlsaLoopSubdevT *subdev, AlsaPcmHwInfoT *params);
 PUBLIC AlsaPcmHwInfoT *ApiPcmSetParams(SoftMixerT *mixer, const char *uid, json_object *paramsJ);
 PUBLIC AlsaSndPcmT *ApiPcmAttachOne(SoftMixerT *mixer, const char *uid, snd_pcm_stream_t direction, json_object *argsJ);
 PUBLIC AlsaVolRampT *ApiRampGetByUid(SoftMixerT *mixer, const char *uid);
@@ -317,11 +594,16 @@ PUBLIC AlsaSndPcmT  *ApiSinkGetByUid(SoftMixerT *mixer, const char *target);
 PUBLIC AlsaSndCtlT *ApiSourceFindSubdev(SoftMixerT *mixer, const char *target);
 PUBLIC int ApiSourceAttach(SoftMixerT *mixer, AFB_ReqT request, const char *uid, json_object * argsJ);
 PUBLIC int ApiStreamAttach(SoftMixerT *mixer, AFB_ReqT request, const char *uid, const char *prefix, json_object * argsJ);
+PUBLIC int ApiStreamRemove(SoftMixerT *mixer, AlsaStreamAudioT *stream);
+PUBLIC int ApiStreamActivity(SoftMixerT *mixer, AlsaStreamAudioT *stream, bool active);
 PUBLIC AlsaSndZoneT *ApiZoneGetByUid(SoftMixerT *mixer, const char *target);
 PUBLIC int ApiZoneAttach(SoftMixerT *mixer, AFB_ReqT request, const char *uid, json_object * argsJ);
+PUBLIC AlsaMatrixT *ApiZoneNativeMatrix(SoftMixerT *mixer, AlsaSndZoneT *zone);
+PUBLIC int ApiZoneSetMatrix(SoftMixerT *mixer, AlsaSndZoneT *zone, const float *gains);
 
 // alsa-effect-ramp.c
 PUBLIC AlsaVolRampT *ApiRampGetByUid(SoftMixerT *mixer, const char *uid);
 PUBLIC int AlsaVolRampApply(SoftMixerT *mixer, AlsaSndCtlT *sndcard, AlsaStreamAudioT *stream, json_object *rampJ);
+PUBLIC unsigned int AlsaVolRampUsec(AlsaVolRampT *ramp, long curvol, long newvol);
 
 #endif
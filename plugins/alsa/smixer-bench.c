@@ -0,0 +1,486 @@
+/*
+ * Copyright(C) 2018 "IoT.bzh"
+ * Author Fulup Ar Foll <fulup@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http : //www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * smixer-bench: standalone benchmark of the audio hot paths (ring buffers,
+ * copy loop, mixing/gain kernels, drift resampler). It needs no sound card,
+ * the copy loop runs between alsa 'null' PCMs (or any PCM given with --pcm).
+ * Results are printed as JSON on stdout, one entry per benchmark.
+ *
+ * Built with STATIC defined empty, so that file local kernels are reachable.
+ */
+
+#define _GNU_SOURCE
+
+#include "alsa-softmixer.h"
+#include "ringbuf.h"
+
+#include <getopt.h>
+#include <math.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_PERIODS 20000
+#define BENCH_DEFAULT_PERIOD  256
+#define BENCH_MAX_CHANNELS    8
+
+typedef struct {
+    int periods;
+    snd_pcm_uframes_t period;
+    const char *capture;
+    const char *playback;
+} BenchOptsT;
+
+typedef struct {
+    const char *name;
+    const char *variant;
+    size_t frameSize;
+    uint64_t *samples;  // ns per period
+    int count;
+    uint64_t frames;
+} BenchRunT;
+
+// silent api, every log level is masked
+static struct afb_api_x3 benchApi;
+
+STATIC uint64_t BenchNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+STATIC int BenchCompare(const void *a, const void *b) {
+    uint64_t va = *(const uint64_t*) a, vb = *(const uint64_t*) b;
+    return (va > vb) - (va < vb);
+}
+
+STATIC BenchRunT *BenchStart(BenchOptsT *opts, const char *name, const char *variant, size_t frameSize) {
+    BenchRunT *run = calloc(1, sizeof (BenchRunT));
+    run->name = name;
+    run->variant = variant;
+    run->frameSize = frameSize;
+    run->samples = calloc(opts->periods, sizeof (uint64_t));
+    return run;
+}
+
+STATIC void BenchSample(BenchRunT *run, uint64_t start, snd_pcm_uframes_t frames) {
+    run->samples[run->count++] = BenchNow() - start;
+    run->frames += frames;
+}
+
+STATIC void BenchReport(json_object *resultsJ, BenchRunT *run) {
+    json_object *runJ;
+    uint64_t total = 0;
+
+    if (run->count == 0 || run->frames == 0) {
+        wrap_json_pack(&runJ, "{ss ss ss}", "name", run->name, "variant", run->variant, "error", "no frames processed");
+        goto OnExit;
+    }
+
+    for (int idx = 0; idx < run->count; idx++) total += run->samples[idx];
+    qsort(run->samples, run->count, sizeof (uint64_t), BenchCompare);
+
+    wrap_json_pack(&runJ, "{ss ss si sI sI sf sf sI sI sI}"
+            , "name", run->name
+            , "variant", run->variant
+            , "frame_size", (int) run->frameSize
+            , "periods", (int64_t) run->count
+            , "frames", (int64_t) run->frames
+            , "frames_per_sec", (double) run->frames * 1e9 / (double) total
+            , "ns_per_frame", (double) total / (double) run->frames
+            , "p50_ns", (int64_t) run->samples[run->count / 2]
+            , "p99_ns", (int64_t) run->samples[(run->count * 99) / 100]
+            , "max_ns", (int64_t) run->samples[run->count - 1]
+            );
+
+OnExit:
+    json_object_array_add(resultsJ, runJ);
+    free(run->samples);
+    free(run);
+}
+
+// legacy byte ring (ringbuf.c), one period in and out per iteration
+STATIC void BenchRingbuf(BenchOptsT *opts, json_object *resultsJ, size_t frameSize, const char *variant) {
+    size_t bytes = opts->period * frameSize;
+    ringbuf_t rbuf = ringbuf_new(4 * bytes);
+    char *src = calloc(1, bytes), *dst = calloc(1, bytes);
+    BenchRunT *run = BenchStart(opts, "ringbuf", variant, frameSize);
+
+    for (int idx = 0; idx < opts->periods; idx++) {
+        uint64_t start = BenchNow();
+        ringbuf_memcpy_into(rbuf, src, bytes);
+        ringbuf_memcpy_from(dst, rbuf, bytes);
+        BenchSample(run, start, opts->period);
+    }
+
+    BenchReport(resultsJ, run);
+    ringbuf_free(&rbuf);
+    free(src);
+    free(dst);
+}
+
+// lock free frame ring (alsa-ringbuf.c), copy and zero copy (region) flavours
+STATIC void BenchAlsaRingbuf(BenchOptsT *opts, json_object *resultsJ, size_t frameSize, const char *variant) {
+    alsa_ringbuf_t *rbuf = alsa_ringbuf_new(4 * opts->period, frameSize);
+    char *src = calloc(opts->period, frameSize), *dst = calloc(opts->period, frameSize);
+    BenchRunT *run = BenchStart(opts, "alsa-ringbuf", variant, frameSize);
+
+    for (int idx = 0; idx < opts->periods; idx++) {
+        uint64_t start = BenchNow();
+        alsa_ringbuf_frames_push(rbuf, src, opts->period);
+        alsa_ringbuf_frames_pop(rbuf, dst, opts->period);
+        BenchSample(run, start, opts->period);
+    }
+    BenchReport(resultsJ, run);
+
+    run = BenchStart(opts, "alsa-ringbuf-region", variant, frameSize);
+    for (int idx = 0; idx < opts->periods; idx++) {
+        snd_pcm_uframes_t done = 0;
+        uint64_t start = BenchNow();
+        while (done < opts->period) {
+            void *buf;
+            snd_pcm_sframes_t count = alsa_ringbuf_frames_push_region(rbuf, &buf);
+            if (count > (snd_pcm_sframes_t) (opts->period - done)) count = (snd_pcm_sframes_t) (opts->period - done);
+            memcpy(buf, src + done * frameSize, count * frameSize);
+            alsa_ringbuf_frames_push_commit(rbuf, count);
+            done += count;
+        }
+        while (done > 0) {
+            const void *buf;
+            snd_pcm_sframes_t count = alsa_ringbuf_frames_pop_region(rbuf, &buf);
+            if (count > (snd_pcm_sframes_t) done) count = (snd_pcm_sframes_t) done;
+            memcpy(dst, buf, count * frameSize);
+            alsa_ringbuf_frames_pop_commit(rbuf, count);
+            done -= count;
+        }
+        BenchSample(run, start, opts->period);
+    }
+    BenchReport(resultsJ, run);
+
+    alsa_ringbuf_free(rbuf);
+    free(src);
+    free(dst);
+}
+
+STATIC void BenchFill(void *buf, snd_pcm_format_t format, size_t samples) {
+    for (size_t idx = 0; idx < samples; idx++) {
+        double value = 0.5 * sin((double) idx * 0.01);
+        switch (format) {
+            case SND_PCM_FORMAT_S16_LE: ((int16_t*) buf)[idx] = (int16_t) (value * INT16_MAX); break;
+            case SND_PCM_FORMAT_S24_LE: ((int32_t*) buf)[idx] = (int32_t) (value * 8388607); break;
+            case SND_PCM_FORMAT_S24_3LE: {
+                int32_t sample = (int32_t) (value * 8388607);
+                ((uint8_t*) buf)[3 * idx] = (uint8_t) sample;
+                ((uint8_t*) buf)[3 * idx + 1] = (uint8_t) (sample >> 8);
+                ((uint8_t*) buf)[3 * idx + 2] = (uint8_t) (sample >> 16);
+                break;
+            }
+            case SND_PCM_FORMAT_S32_LE: ((int32_t*) buf)[idx] = (int32_t) (value * INT32_MAX); break;
+            default: ((float*) buf)[idx] = (float) value; break;
+        }
+    }
+}
+
+// sink mixing: 4 streams converted to float32 and accumulated, then saturated to sink format, per sink period
+STATIC void BenchMix(BenchOptsT *opts, json_object *resultsJ, snd_pcm_format_t format, const char *variant) {
+    const int streams = 4, channels = 2;
+    size_t samples = opts->period * channels;
+    size_t width = (size_t) snd_pcm_format_physical_width(format) / 8;
+    void *src = malloc(samples * width), *dst = malloc(samples * width);
+    float *fsrc = malloc(samples * sizeof (float)), *acc = malloc(samples * sizeof (float));
+    // unity diagonal, as a stream routed 1:1 to its sink
+    const float gains[] = {1.0f, 0.0f, 0.0f, 1.0f};
+    AlsaMatrixT *matrix = AlsaMatrixCreate(channels, channels, gains);
+    BenchRunT *run = BenchStart(opts, "mix-4-streams", variant, channels * width);
+
+    BenchFill(src, format, samples);
+    for (int idx = 0; idx < opts->periods; idx++) {
+        uint64_t start = BenchNow();
+        memset(acc, 0, samples * sizeof (float));
+        for (int sdx = 0; sdx < streams; sdx++) {
+            AlsaConvertToFloat(format, src, fsrc, samples);
+            AlsaMatrixApply(matrix, acc, fsrc, opts->period);
+        }
+        AlsaConvertFromFloat(format, acc, dst, samples);
+        BenchSample(run, start, opts->period);
+    }
+
+    BenchReport(resultsJ, run);
+    AlsaMatrixFree(matrix);
+    free(src);
+    free(dst);
+    free(fsrc);
+    free(acc);
+}
+
+// zone channel matrix alone on float32 frames, one kernel per shape (the variant reports the selected kernel)
+STATIC void BenchMatrix(BenchOptsT *opts, json_object *resultsJ, unsigned int inputs, unsigned int outputs, bool sparse) {
+    float *in = malloc(opts->period * inputs * sizeof (float)), *acc = malloc(opts->period * outputs * sizeof (float));
+    float *gains = AlsaMatrixGains(NULL, inputs, outputs);
+    char variant[32];
+
+    for (unsigned int idx = 0; idx < inputs; idx++) {
+        for (unsigned int odx = 0; odx < outputs; odx++) {
+            if (!sparse || odx == (idx + 1) % outputs) gains[idx * outputs + odx] = 0.5f;
+        }
+    }
+    AlsaMatrixT *matrix = AlsaMatrixCreate(inputs, outputs, gains);
+    snprintf(variant, sizeof (variant), "%ux%u-%s", inputs, outputs, AlsaMatrixKernel(matrix));
+
+    for (size_t idx = 0; idx < opts->period * inputs; idx++)
+        in[idx] = (float) ((int) (idx % 199) - 99) / 100.0f;
+
+    BenchRunT *run = BenchStart(opts, "matrix", variant, inputs * sizeof (float));
+    for (int idx = 0; idx < opts->periods; idx++) {
+        uint64_t start = BenchNow();
+        memset(acc, 0, opts->period * outputs * sizeof (float));
+        AlsaMatrixApply(matrix, acc, in, opts->period);
+        BenchSample(run, start, opts->period);
+    }
+
+    BenchReport(resultsJ, run);
+    AlsaMatrixFree(matrix);
+    free(gains);
+    free(in);
+    free(acc);
+}
+
+// edge conversions alone: stream format -> float32 -> stream format
+STATIC void BenchConvert(BenchOptsT *opts, json_object *resultsJ, snd_pcm_format_t format, const char *variant) {
+    const int channels = 2;
+    size_t samples = opts->period * channels;
+    size_t width = (size_t) snd_pcm_format_physical_width(format) / 8;
+    void *src = malloc(samples * width), *dst = malloc(samples * width);
+    float *fbuf = malloc(samples * sizeof (float));
+    BenchRunT *run = BenchStart(opts, "convert-roundtrip", variant, channels * width);
+
+    BenchFill(src, format, samples);
+    for (int idx = 0; idx < opts->periods; idx++) {
+        uint64_t start = BenchNow();
+        AlsaConvertToFloat(format, src, fbuf, samples);
+        AlsaConvertFromFloat(format, fbuf, dst, samples);
+        BenchSample(run, start, opts->period);
+    }
+
+    BenchReport(resultsJ, run);
+    free(src);
+    free(dst);
+    free(fbuf);
+}
+
+// native volume, steady gain and permanent ramp (new target every period)
+STATIC void BenchGain(BenchOptsT *opts, SoftMixerT *mixer, json_object *resultsJ, snd_pcm_format_t format, const char *variant) {
+    AlsaPcmHwInfoT params = {.rate = 48000, .channels = 2, .format = format};
+    size_t width = (size_t) snd_pcm_format_physical_width(format) / 8;
+    size_t samples = opts->period * params.channels;
+    void *buf = malloc(samples * width);
+    AlsaGainT *gain = AlsaGainCreate(mixer, &params, 80);
+    if (!gain) goto OnExit;
+
+    BenchFill(buf, format, samples);
+    BenchRunT *run = BenchStart(opts, "gain-steady", variant, params.channels * width);
+    for (int idx = 0; idx < opts->periods; idx++) {
+        uint64_t start = BenchNow();
+        AlsaGainApply(gain, buf, opts->period);
+        BenchSample(run, start, opts->period);
+    }
+    BenchReport(resultsJ, run);
+
+    run = BenchStart(opts, "gain-ramp", variant, params.channels * width);
+    for (int idx = 0; idx < opts->periods; idx++) {
+        AlsaGainSetVolume(gain, (idx & 1) ? 20 : 80, 1000000);
+        uint64_t start = BenchNow();
+        AlsaGainApply(gain, buf, opts->period);
+        BenchSample(run, start, opts->period);
+    }
+    BenchReport(resultsJ, run);
+    AlsaGainFree(gain);
+
+OnExit:
+    free(buf);
+}
+
+// drift resampler: integer/float conversion plus cubic interpolation
+STATIC void BenchDrift(BenchOptsT *opts, SoftMixerT *mixer, json_object *resultsJ, snd_pcm_format_t format, const char *variant) {
+    AlsaPcmHwInfoT params = {.rate = 48000, .channels = 2, .format = format};
+    size_t frameSize = params.channels * (size_t) snd_pcm_format_physical_width(format) / 8;
+    void *in = malloc(2 * opts->period * frameSize);
+    AlsaDriftT *drift = AlsaDriftCreate(mixer, &params, frameSize, opts->period);
+    if (!drift) goto OnExit;
+
+    BenchFill(in, format, 2 * opts->period * params.channels);
+    BenchRunT *run = BenchStart(opts, "drift-resample", variant, frameSize);
+    for (int idx = 0; idx < opts->periods; idx++) {
+        snd_pcm_uframes_t used;
+        const void *out;
+        AlsaDriftUpdate(drift, (snd_pcm_sframes_t) (opts->period + (idx % 7)));
+        uint64_t start = BenchNow();
+        snd_pcm_uframes_t produced = AlsaDriftProcess(drift, in, 2 * opts->period, &used, opts->period, &out);
+        BenchSample(run, start, produced);
+    }
+    BenchReport(resultsJ, run);
+    AlsaDriftFree(drift);
+
+OnExit:
+    free(in);
+}
+
+STATIC AlsaPcmCtlT *BenchOpenPcm(SoftMixerT *mixer, const char *name, snd_pcm_stream_t mode, AlsaPcmHwInfoT *params) {
+    AlsaPcmCtlT *pcm = calloc(1, sizeof (AlsaPcmCtlT));
+    pcm->cid.cardid = name;
+    pcm->params = malloc(sizeof (AlsaPcmHwInfoT));
+    memcpy(pcm->params, params, sizeof (AlsaPcmHwInfoT));
+
+    if (snd_pcm_open(&pcm->handle, name, mode, SND_PCM_NONBLOCK) < 0) goto OnErrorExit;
+    if (AlsaPcmConf(mixer, pcm, mode) < 0) goto OnErrorExit;
+    return pcm;
+
+OnErrorExit:
+    if (pcm->handle) snd_pcm_close(pcm->handle);
+    free(pcm->params);
+    free(pcm);
+    return NULL;
+}
+
+// copy loop as run by the copy threads: AlsaPcmReadCB then AlsaPcmWriteCB, one capture period each time
+STATIC void BenchCopy(BenchOptsT *opts, SoftMixerT *mixer, json_object *resultsJ, snd_pcm_format_t format, const char *variant) {
+    AlsaPcmHwInfoT params = {.rate = 48000, .channels = 2, .format = format, .access = SND_PCM_ACCESS_RW_INTERLEAVED,
+                             .period_frames = opts->period, .periods = 4};
+    AlsaPcmCopyHandleT copy = {0};
+    struct pollfd pfd = {.revents = POLLIN};
+    json_object *runJ;
+
+    AlsaPcmCtlT *pcmIn = BenchOpenPcm(mixer, opts->capture, SND_PCM_STREAM_CAPTURE, &params);
+    AlsaPcmCtlT *pcmOut = BenchOpenPcm(mixer, opts->playback, SND_PCM_STREAM_PLAYBACK, &params);
+    if (!pcmIn || !pcmOut) {
+        wrap_json_pack(&runJ, "{ss ss ss}", "name", "copy", "variant", variant, "error", "fail to open/configure PCMs");
+        json_object_array_add(resultsJ, runJ);
+        return;
+    }
+
+    copy.pcmIn = pcmIn;
+    copy.pcmOut = pcmOut;
+    copy.api = mixer->api;
+    copy.channels = params.channels;
+    copy.frame_size = pcmIn->params->channels * pcmIn->params->sampleSize;
+    copy.rbuf = alsa_ringbuf_new(2 * pcmOut->params->buffer_frames, copy.frame_size);
+    copy.write_threshold = (snd_pcm_sframes_t) pcmOut->avail_min;
+    copy.wake_threshold = pcmOut->avail_min;
+    copy.wakeFd = -1;
+
+    snd_pcm_prepare(pcmIn->handle);
+    snd_pcm_start(pcmIn->handle);
+
+    BenchRunT *run = BenchStart(opts, "copy", variant, copy.frame_size);
+    for (int idx = 0; idx < opts->periods; idx++) {
+        size_t before = alsa_ringbuf_frames_used(copy.rbuf);
+        uint64_t start = BenchNow();
+
+        AlsaPcmReadCB(&pfd, &copy);
+        size_t read = alsa_ringbuf_frames_used(copy.rbuf) - before;
+        AlsaPcmWriteCB(&copy);
+
+        BenchSample(run, start, read);
+    }
+    BenchReport(resultsJ, run);
+
+    alsa_ringbuf_free(copy.rbuf);
+    snd_pcm_close(pcmIn->handle);
+    snd_pcm_close(pcmOut->handle);
+}
+
+STATIC void BenchUsage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [--periods N] [--period FRAMES] [--capture PCM] [--pcm PCM]\n"
+            "   --periods  iterations per benchmark (default %d)\n"
+            "   --period   frames per iteration (default %d)\n"
+            "   --capture  copy loop capture PCM (default null)\n"
+            "   --pcm      copy loop playback PCM (default null), e.g. \"file:'/tmp/out.raw',raw\"\n",
+            prog, BENCH_DEFAULT_PERIODS, BENCH_DEFAULT_PERIOD);
+}
+
+int main(int argc, char *argv[]) {
+    BenchOptsT opts = {.periods = BENCH_DEFAULT_PERIODS, .period = BENCH_DEFAULT_PERIOD, .capture = "null", .playback = "null"};
+    SoftMixerT mixer = {.uid = "bench", .info = "smixer-bench", .api = &benchApi};
+    static const struct option longOpts[] = {
+        {"periods", required_argument, NULL, 'n'},
+        {"period", required_argument, NULL, 'p'},
+        {"capture", required_argument, NULL, 'c'},
+        {"pcm", required_argument, NULL, 'o'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "n:p:c:o:h", longOpts, NULL)) != -1) {
+        switch (opt) {
+            case 'n': opts.periods = atoi(optarg); break;
+            case 'p': opts.period = (snd_pcm_uframes_t) atol(optarg); break;
+            case 'c': opts.capture = optarg; break;
+            case 'o': opts.playback = optarg; break;
+            default:
+                BenchUsage(argv[0]);
+                return 1;
+        }
+    }
+    if (opts.periods <= 0 || opts.period == 0) {
+        BenchUsage(argv[0]);
+        return 1;
+    }
+
+    json_object *resultsJ = json_object_new_array();
+
+    BenchRingbuf(&opts, resultsJ, 4, "2ch-s16");
+    BenchRingbuf(&opts, resultsJ, 8, "2ch-s32");
+    BenchRingbuf(&opts, resultsJ, 4 * BENCH_MAX_CHANNELS, "8ch-s32");
+    BenchAlsaRingbuf(&opts, resultsJ, 4, "2ch-s16");
+    BenchAlsaRingbuf(&opts, resultsJ, 8, "2ch-s32");
+    BenchAlsaRingbuf(&opts, resultsJ, 4 * BENCH_MAX_CHANNELS, "8ch-s32");
+
+    BenchMix(&opts, resultsJ, SND_PCM_FORMAT_S16_LE, "2ch-s16");
+    BenchMix(&opts, resultsJ, SND_PCM_FORMAT_S32_LE, "2ch-s32");
+    BenchMix(&opts, resultsJ, SND_PCM_FORMAT_FLOAT_LE, "2ch-float");
+
+    BenchMatrix(&opts, resultsJ, 2, 6, false);
+    BenchMatrix(&opts, resultsJ, 6, 2, false);
+    BenchMatrix(&opts, resultsJ, 4, 4, true);
+    BenchMatrix(&opts, resultsJ, 4, 6, false);
+
+    BenchConvert(&opts, resultsJ, SND_PCM_FORMAT_S16_LE, "2ch-s16");
+    BenchConvert(&opts, resultsJ, SND_PCM_FORMAT_S24_LE, "2ch-s24");
+    BenchConvert(&opts, resultsJ, SND_PCM_FORMAT_S24_3LE, "2ch-s24-3");
+    BenchConvert(&opts, resultsJ, SND_PCM_FORMAT_S32_LE, "2ch-s32");
+
+    BenchGain(&opts, &mixer, resultsJ, SND_PCM_FORMAT_S16_LE, "2ch-s16");
+    BenchGain(&opts, &mixer, resultsJ, SND_PCM_FORMAT_S32_LE, "2ch-s32");
+    BenchGain(&opts, &mixer, resultsJ, SND_PCM_FORMAT_FLOAT_LE, "2ch-float");
+
+    BenchDrift(&opts, &mixer, resultsJ, SND_PCM_FORMAT_S16_LE, "2ch-s16");
+    BenchDrift(&opts, &mixer, resultsJ, SND_PCM_FORMAT_S32_LE, "2ch-s32");
+    BenchDrift(&opts, &mixer, resultsJ, SND_PCM_FORMAT_FLOAT_LE, "2ch-float");
+
+    BenchCopy(&opts, &mixer, resultsJ, SND_PCM_FORMAT_S16_LE, "2ch-s16");
+    BenchCopy(&opts, &mixer, resultsJ, SND_PCM_FORMAT_S32_LE, "2ch-s32");
+
+    json_object *reportJ;
+    wrap_json_pack(&reportJ, "{ss si si so}"
+            , "bench", "smixer-bench"
+            , "period_frames", (int) opts.period
+            , "periods", opts.periods
+            , "results", resultsJ
+            );
+    printf("%s\n", json_object_to_json_string_ext(reportJ, JSON_C_TO_STRING_PRETTY));
+    json_object_put(reportJ);
+    return 0;
+}
@@ -0,0 +1,408 @@
+/*
+ * Copyright(C) 2018 "IoT.bzh"
+ * Author Fulup Ar Foll <fulup@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http : //www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * smixer-check: correctness checks of the audio hot path kernels (frame ring,
+ * sample format conversion, channel matrix, drift resampler), run by ctest.
+ * No sound card needed. 'smixer-check <suite>' runs one suite, no argument runs
+ * them all; failures are printed on stderr and the exit status is non zero.
+ */
+
+#define _GNU_SOURCE
+
+#include "alsa-softmixer.h"
+
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: ", __func__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__); \
+            fputc('\n', stderr); \
+            checkFailed++; \
+        } \
+    } while (0)
+
+static int checkFailed;
+
+// silent api, every log level is masked
+static struct afb_api_x3 checkApi;
+
+// frame 'idx' of a test sequence, every byte of the frame tells its index
+STATIC void CheckFrameFill(char *frame, size_t frameSize, unsigned long idx) {
+    for (size_t bdx = 0; bdx < frameSize; bdx++)
+        frame[bdx] = (char) (idx * 7 + bdx);
+}
+
+STATIC bool CheckFrameIs(const char *frame, size_t frameSize, unsigned long idx) {
+    for (size_t bdx = 0; bdx < frameSize; bdx++) {
+        if (frame[bdx] != (char) (idx * 7 + bdx)) return false;
+    }
+    return true;
+}
+
+// push/pop clamp to room and data, copies wrap at the end of the buffer and across index overflow
+STATIC void CheckRingbufWrap(void) {
+    const size_t frameSize = 6;
+    alsa_ringbuf_t *rb = alsa_ringbuf_new(6, frameSize);
+    char src[16 * 6], dst[16 * 6];
+
+    CHECK(alsa_ringbuf_capacity(rb) == 8, "capacity=%lu expected 8", alsa_ringbuf_capacity(rb));
+    CHECK(alsa_ringbuf_is_empty(rb), "new ring not empty");
+
+    for (unsigned long idx = 0; idx < 16; idx++) CheckFrameFill(&src[idx * frameSize], frameSize, idx);
+
+    CHECK(alsa_ringbuf_frames_push(rb, src, 10) == 8, "push should clamp to capacity");
+    CHECK(alsa_ringbuf_is_full(rb), "ring not full");
+    CHECK(alsa_ringbuf_frames_push(rb, src, 1) == 0, "push on a full ring");
+
+    CHECK(alsa_ringbuf_frames_pop(rb, dst, 5) == 5, "pop 5");
+    CHECK(alsa_ringbuf_frames_remain_capacity(rb) == 5, "room=%lu expected 5", alsa_ringbuf_frames_remain_capacity(rb));
+
+    // head sits at offset 0 again, tail at 5: next push and pop both wrap
+    CHECK(alsa_ringbuf_frames_push(rb, &src[8 * frameSize], 5) == 5, "wrapped push");
+    CHECK(alsa_ringbuf_frames_pop(rb, dst, 16) == 8, "pop should clamp to used frames");
+    for (unsigned long idx = 0; idx < 8; idx++)
+        CHECK(CheckFrameIs(&dst[idx * frameSize], frameSize, idx + 5), "frame %lu not in order after wrap", idx);
+    CHECK(alsa_ringbuf_frames_pop(rb, dst, 1) == 0, "pop on an empty ring");
+
+    // free running indexes overflow, used frames stay head - tail
+    atomic_store(&rb->head, ULONG_MAX - 2);
+    atomic_store(&rb->tail, ULONG_MAX - 2);
+    CHECK(alsa_ringbuf_frames_push(rb, src, 7) == 7, "push across index overflow");
+    CHECK(alsa_ringbuf_frames_used(rb) == 7, "used=%lu expected 7", alsa_ringbuf_frames_used(rb));
+    CHECK(alsa_ringbuf_frames_pop(rb, dst, 7) == 7, "pop across index overflow");
+    for (unsigned long idx = 0; idx < 7; idx++)
+        CHECK(CheckFrameIs(&dst[idx * frameSize], frameSize, idx), "frame %lu corrupted across index overflow", idx);
+
+    alsa_ringbuf_free(rb);
+}
+
+// regions stop at the end of the buffer, the next region returns the wrapped part
+STATIC void CheckRingbufRegion(void) {
+    const size_t frameSize = 4;
+    alsa_ringbuf_t *rb = alsa_ringbuf_new(8, frameSize);
+    char src[8 * 4], dst[8 * 4];
+    const void *rptr;
+    void *wptr;
+
+    for (unsigned long idx = 0; idx < 8; idx++) CheckFrameFill(&src[idx * frameSize], frameSize, idx);
+
+    // head and tail at offset 6
+    alsa_ringbuf_frames_push(rb, src, 6);
+    alsa_ringbuf_frames_pop(rb, dst, 6);
+
+    CHECK(alsa_ringbuf_frames_push_region(rb, &wptr) == 2, "push region should stop at the buffer end");
+    CHECK(wptr == rb->buf + 6 * frameSize, "push region should start at offset 6");
+    memcpy(wptr, src, 2 * frameSize);
+    alsa_ringbuf_frames_push_commit(rb, 2);
+
+    CHECK(alsa_ringbuf_frames_push_region(rb, &wptr) == 6, "push region after wrap should hold the remaining room");
+    CHECK(wptr == rb->buf, "push region after wrap should start at offset 0");
+    memcpy(wptr, &src[2 * frameSize], 6 * frameSize);
+    alsa_ringbuf_frames_push_commit(rb, 6);
+
+    CHECK(alsa_ringbuf_is_full(rb), "ring not full after two regions");
+    CHECK(alsa_ringbuf_frames_push_region(rb, &wptr) == 0, "push region on a full ring");
+
+    CHECK(alsa_ringbuf_frames_pop_region(rb, &rptr) == 2, "pop region should stop at the buffer end");
+    for (unsigned long idx = 0; idx < 2; idx++)
+        CHECK(CheckFrameIs((const char*) rptr + idx * frameSize, frameSize, idx), "pop region frame %lu", idx);
+    alsa_ringbuf_frames_pop_commit(rb, 2);
+
+    CHECK(alsa_ringbuf_frames_pop_region(rb, &rptr) == 6, "pop region after wrap should hold the remaining frames");
+    for (unsigned long idx = 0; idx < 6; idx++)
+        CHECK(CheckFrameIs((const char*) rptr + idx * frameSize, frameSize, idx + 2), "wrapped pop region frame %lu", idx);
+
+    // partial commit leaves the rest in place
+    alsa_ringbuf_frames_pop_commit(rb, 4);
+    CHECK(alsa_ringbuf_frames_pop_region(rb, &rptr) == 2, "pop region after partial commit");
+    CHECK(CheckFrameIs(rptr, frameSize, 6), "pop region after partial commit frame");
+    alsa_ringbuf_frames_pop_commit(rb, 2);
+
+    CHECK(alsa_ringbuf_frames_pop_region(rb, &rptr) == 0, "pop region on an empty ring");
+    alsa_ringbuf_free(rb);
+}
+
+STATIC void CheckRingbuf(void) {
+    CheckRingbufWrap();
+    CheckRingbufRegion();
+}
+
+// S24_LE container value as written back by the float conversion: sign extended
+STATIC int32_t CheckS24(int32_t value) {
+    return (int32_t) ((uint32_t) value << 8) >> 8;
+}
+
+// every format value that float holds exactly must come back unchanged
+STATIC void CheckConvertRoundTrip(void) {
+    enum { COUNT = 65536 };
+    float *fbuf = malloc(COUNT * sizeof (float));
+    int16_t *s16 = malloc(COUNT * sizeof (int16_t)), *o16 = malloc(COUNT * sizeof (int16_t));
+    int32_t *s32 = malloc(COUNT * sizeof (int32_t)), *o32 = malloc(COUNT * sizeof (int32_t));
+    uint8_t *s24_3 = malloc(COUNT * 3), *o24_3 = malloc(COUNT * 3);
+    float *sflt = malloc(COUNT * sizeof (float)), *oflt = malloc(COUNT * sizeof (float));
+
+    // S16: every value
+    for (int idx = 0; idx < COUNT; idx++) s16[idx] = (int16_t) (idx - 32768);
+    AlsaConvertToFloat(SND_PCM_FORMAT_S16_LE, s16, fbuf, COUNT);
+    AlsaConvertFromFloat(SND_PCM_FORMAT_S16_LE, fbuf, o16, COUNT);
+    for (int idx = 0; idx < COUNT; idx++)
+        CHECK(o16[idx] == s16[idx], "S16 %d came back %d", s16[idx], o16[idx]);
+
+    // S24 in a 32 bits container: full range by steps, garbage in the unused top byte
+    for (int idx = 0; idx < COUNT; idx++) {
+        int32_t value = -8388608 + idx * 256 + (idx % 256);
+        if (idx == COUNT - 1) value = 8388607;
+        s32[idx] = (int32_t) (((uint32_t) value & 0xFFFFFF) | ((uint32_t) (idx & 0xFF) << 24));
+    }
+    AlsaConvertToFloat(SND_PCM_FORMAT_S24_LE, s32, fbuf, COUNT);
+    AlsaConvertFromFloat(SND_PCM_FORMAT_S24_LE, fbuf, o32, COUNT);
+    for (int idx = 0; idx < COUNT; idx++)
+        CHECK(o32[idx] == CheckS24(s32[idx]), "S24 %d came back %d", CheckS24(s32[idx]), o32[idx]);
+
+    // S24_3LE packed
+    for (int idx = 0; idx < COUNT; idx++) {
+        uint32_t value = (uint32_t) (-8388608 + idx * 256 + (idx % 256));
+        if (idx == COUNT - 1) value = 8388607;
+        s24_3[3 * idx] = (uint8_t) value;
+        s24_3[3 * idx + 1] = (uint8_t) (value >> 8);
+        s24_3[3 * idx + 2] = (uint8_t) (value >> 16);
+    }
+    AlsaConvertToFloat(SND_PCM_FORMAT_S24_3LE, s24_3, fbuf, COUNT);
+    AlsaConvertFromFloat(SND_PCM_FORMAT_S24_3LE, fbuf, o24_3, COUNT);
+    CHECK(!memcmp(s24_3, o24_3, COUNT * 3), "S24_3LE round trip differs");
+
+    // S32: float keeps 24 significant bits, values with 8 low zero bits round trip
+    for (int idx = 0; idx < COUNT; idx++) s32[idx] = (int32_t) ((uint32_t) (-8388608 + idx * 256 + (idx % 256)) << 8);
+    AlsaConvertToFloat(SND_PCM_FORMAT_S32_LE, s32, fbuf, COUNT);
+    AlsaConvertFromFloat(SND_PCM_FORMAT_S32_LE, fbuf, o32, COUNT);
+    for (int idx = 0; idx < COUNT; idx++)
+        CHECK(o32[idx] == s32[idx], "S32 %d came back %d", s32[idx], o32[idx]);
+
+    // FLOAT: anything in [-1.0, 1.0] is left untouched
+    for (int idx = 0; idx < COUNT; idx++) sflt[idx] = -1.0f + 2.0f * (float) idx / (float) (COUNT - 1);
+    AlsaConvertToFloat(SND_PCM_FORMAT_FLOAT_LE, sflt, fbuf, COUNT);
+    AlsaConvertFromFloat(SND_PCM_FORMAT_FLOAT_LE, fbuf, oflt, COUNT);
+    CHECK(!memcmp(sflt, oflt, COUNT * sizeof (float)), "FLOAT round trip differs");
+
+    free(fbuf);
+    free(s16); free(o16);
+    free(s32); free(o32);
+    free(s24_3); free(o24_3);
+    free(sflt); free(oflt);
+}
+
+// out of range floats clip to the format limits instead of wrapping
+STATIC void CheckConvertSaturation(void) {
+    const float in[] = {1.0f, -1.0f, 1.5f, -1.5f, 1e10f, -1e10f};
+    const int count = sizeof (in) / sizeof (in[0]);
+    int16_t s16[6];
+    int32_t s32[6];
+    uint8_t s24_3[6 * 3];
+    float flt[6];
+
+    AlsaConvertFromFloat(SND_PCM_FORMAT_S16_LE, in, s16, count);
+    for (int idx = 0; idx < count; idx++) {
+        int16_t expected = in[idx] > 0 ? INT16_MAX : INT16_MIN;
+        CHECK(s16[idx] == expected, "S16 %g gave %d expected %d", in[idx], s16[idx], expected);
+    }
+
+    AlsaConvertFromFloat(SND_PCM_FORMAT_S24_LE, in, s32, count);
+    for (int idx = 0; idx < count; idx++) {
+        int32_t expected = in[idx] > 0 ? 8388607 : -8388608;
+        CHECK(s32[idx] == expected, "S24 %g gave %d expected %d", in[idx], s32[idx], expected);
+    }
+
+    AlsaConvertFromFloat(SND_PCM_FORMAT_S24_3LE, in, s24_3, count);
+    for (int idx = 0; idx < count; idx++) {
+        uint32_t expected = in[idx] > 0 ? 0x7FFFFF : 0x800000;
+        uint32_t value = s24_3[3 * idx] | (uint32_t) s24_3[3 * idx + 1] << 8 | (uint32_t) s24_3[3 * idx + 2] << 16;
+        CHECK(value == expected, "S24_3LE %g gave 0x%06x expected 0x%06x", in[idx], value, expected);
+    }
+
+    AlsaConvertFromFloat(SND_PCM_FORMAT_S32_LE, in, s32, count);
+    for (int idx = 0; idx < count; idx++) {
+        int32_t expected = in[idx] > 0 ? 2147483520 : INT32_MIN;
+        CHECK(s32[idx] == expected, "S32 %g gave %d expected %d", in[idx], s32[idx], expected);
+    }
+
+    AlsaConvertFromFloat(SND_PCM_FORMAT_FLOAT_LE, in, flt, count);
+    for (int idx = 0; idx < count; idx++) {
+        float expected = in[idx] > 0 ? 1.0f : -1.0f;
+        CHECK(flt[idx] == expected, "FLOAT %g gave %g expected %g", in[idx], flt[idx], expected);
+    }
+}
+
+STATIC void CheckConvert(void) {
+    CheckConvertRoundTrip();
+    CheckConvertSaturation();
+}
+
+// apply 'gains' through the matrix kernel and through a plain scalar loop, accumulators must match
+STATIC void CheckMatrixCase(const char *name, unsigned int inputs, unsigned int outputs, const float *gains, const char *kernel) {
+    const snd_pcm_uframes_t frames = 67;
+    float *in = malloc(frames * inputs * sizeof (float));
+    float *acc = malloc(frames * outputs * sizeof (float));
+    float *ref = malloc(frames * outputs * sizeof (float));
+
+    for (size_t idx = 0; idx < frames * inputs; idx++) in[idx] = sinf((float) idx * 0.37f);
+    for (size_t idx = 0; idx < frames * outputs; idx++) acc[idx] = ref[idx] = cosf((float) idx * 0.11f) * 0.25f;
+
+    AlsaMatrixT *matrix = AlsaMatrixCreate(inputs, outputs, gains);
+    CHECK(!strcmp(AlsaMatrixKernel(matrix), kernel), "%s selected kernel=%s expected %s", name, AlsaMatrixKernel(matrix), kernel);
+    AlsaMatrixApply(matrix, acc, in, frames);
+
+    for (snd_pcm_uframes_t fdx = 0; fdx < frames; fdx++) {
+        for (unsigned int odx = 0; odx < outputs; odx++) {
+            for (unsigned int idx = 0; idx < inputs; idx++)
+                ref[fdx * outputs + odx] += in[fdx * inputs + idx] * gains[idx * outputs + odx];
+        }
+    }
+
+    for (size_t idx = 0; idx < frames * outputs; idx++) {
+        if (fabsf(acc[idx] - ref[idx]) > 1e-5f) {
+            CHECK(false, "%s sample %zu gave %g expected %g", name, idx, acc[idx], ref[idx]);
+            break;
+        }
+    }
+
+    AlsaMatrixFree(matrix);
+    free(in);
+    free(acc);
+    free(ref);
+}
+
+STATIC void CheckMatrix(void) {
+    const float identity[4 * 4] = {
+        1, 0, 0, 0,
+        0, 1, 0, 0,
+        0, 0, 1, 0,
+        0, 0, 0, 1,
+    };
+    const float stereoTo6[2 * 6] = {
+        1.0f, 0.0f, 0.7f, 0.5f, 0.8f, 0.0f,
+        0.0f, 1.0f, 0.7f, 0.5f, 0.0f, 0.8f,
+    };
+    const float swap[2 * 2] = {
+        0, 1,
+        1, 0,
+    };
+    const float subset[4 * 6] = {
+        0, 0, 0, 0, 0, 0,
+        0, 0, 0.5f, 0, 0, 0,
+        0, 0, 0, 0, 1, 0,
+        0, 0, 0, 0, 0, 0,
+    };
+    const float downmix[6 * 2] = {
+        1.0f, 0.0f,
+        0.0f, 1.0f,
+        0.7f, 0.7f,
+        0.5f, 0.5f,
+        0.7f, 0.0f,
+        0.0f, 0.7f,
+    };
+    const float dense[3 * 4] = {
+        0.1f, 0.2f, 0.3f, 0.4f,
+        0.5f, 0.6f, 0.7f, 0.8f,
+        0.9f, 1.0f, 1.1f, 1.2f,
+    };
+
+    CheckMatrixCase("identity", 4, 4, identity, "identity");
+    CheckMatrixCase("2to6", 2, 6, stereoTo6, "2xN");
+    CheckMatrixCase("swap", 2, 2, swap, "sparse");
+    CheckMatrixCase("subset", 4, 6, subset, "sparse");
+    CheckMatrixCase("6to2", 6, 2, downmix, "Nx2");
+    CheckMatrixCase("dense", 3, 4, dense, "dense");
+}
+
+// whatever the controller does, chunks never exceed what the sink asked and total
+// output stays within the max correction of the input
+STATIC void CheckDrift(SoftMixerT *mixer) {
+    const snd_pcm_uframes_t period = 64, periods = 2000;
+    const size_t frameSize = 2 * sizeof (int16_t);
+    AlsaPcmHwInfoT params = {.format = SND_PCM_FORMAT_S16_LE, .channels = 2, .rate = 48000};
+    alsa_ringbuf_t *rbuf = alsa_ringbuf_new(4 * period, frameSize);
+    int16_t *src = calloc(period, frameSize);
+    const void *out = NULL, *in = NULL;
+    snd_pcm_uframes_t pushed = 0, pulled = 0, used = 0;
+
+    AlsaDriftT *drift = AlsaDriftCreate(mixer, &params, frameSize, period);
+    CHECK(drift, "fail to create drift resampler");
+    if (!drift) goto OnExit;
+
+    // direct process never writes past its output buffer
+    for (snd_pcm_uframes_t idx = 0; idx < period; idx++) src[2 * idx] = src[2 * idx + 1] = (int16_t) (idx * 100);
+    snd_pcm_uframes_t produced = AlsaDriftProcess(drift, src, period, &used, 4 * period, &out);
+    CHECK(produced <= period, "process produced=%lu over buffer size=%lu", produced, period);
+    CHECK(used <= period, "process consumed=%lu over input=%lu", used, period);
+    AlsaDriftReset(drift);
+    CHECK(AlsaDriftPull(drift, rbuf, period, &out) == 0, "pull on an empty ring after reset");
+
+    for (snd_pcm_uframes_t pdx = 0, step = 0; pdx < periods; pdx++) {
+        pushed += alsa_ringbuf_frames_push(rbuf, src, period);
+
+        // latency far off target in both directions, drives the ratio to its limits
+        double ratio = AlsaDriftUpdate(drift, (pdx / 500) % 2 ? 10000 : 10);
+        CHECK(ratio >= 1.0 - 2000e-6 && ratio <= 1.0 + 2000e-6, "ratio=%f out of bounds", ratio);
+
+        // sink room changes on every write, and every third write is short
+        for (;;) {
+            snd_pcm_uframes_t maxFrames = 1 + (step * 13) % period;
+            snd_pcm_uframes_t frames = AlsaDriftPull(drift, rbuf, maxFrames, &out);
+            if (!frames) break;
+
+            CHECK(frames <= maxFrames, "pull gave frames=%lu over max=%lu", frames, maxFrames);
+            if (++step % 3 == 0) frames /= 2;
+            AlsaDriftRelease(drift, frames);
+            pulled += frames;
+        }
+        CHECK(alsa_ringbuf_frames_pop_region(rbuf, &in) == 0, "pull left input in the ring");
+    }
+
+    double bound = (double) pushed * 2000e-6 + 4.0;
+    CHECK(fabs((double) pulled - (double) pushed) <= bound, "pushed=%lu pulled=%lu differ more than %f", pushed, pulled, bound);
+
+OnExit:
+    AlsaDriftFree(drift);
+    alsa_ringbuf_free(rbuf);
+    free(src);
+}
+
+int main(int argc, char *argv[]) {
+    SoftMixerT mixer = {.uid = "check", .info = "smixer-check", .api = &checkApi};
+    const char *suites[] = {"ringbuf", "convert", "matrix", "drift"};
+    int count = (argc > 1) ? argc - 1 : (int) (sizeof (suites) / sizeof (suites[0]));
+
+    for (int idx = 0; idx < count; idx++) {
+        const char *suite = (argc > 1) ? argv[idx + 1] : suites[idx];
+        int before = checkFailed;
+
+        if (!strcmp(suite, "ringbuf")) CheckRingbuf();
+        else if (!strcmp(suite, "convert")) CheckConvert();
+        else if (!strcmp(suite, "matrix")) CheckMatrix();
+        else if (!strcmp(suite, "drift")) CheckDrift(&mixer);
+        else {
+            fprintf(stderr, "smixer-check: unknown suite=%s (ringbuf|convert|matrix|drift)\n", suite);
+            return 2;
+        }
+
+        printf("%s: %s\n", suite, checkFailed == before ? "ok" : "FAILED");
+    }
+
+    return checkFailed ? 1 : 0;
+}